@@ -0,0 +1,127 @@
+// Connection churn against a running ws-test-server: every thread connects, does one exchange and
+// closes, as fast as it can. Reports connections per second and the p50/p99 of one connect-to-close
+// cycle. Run the server once with --session-pool=on and once with off to see what recycling saves.
+//
+// Usage: conn-bench <address> <port> [ws|http] [threads] [seconds]
+//      ws   - upgrade on /socket-units-server/ with a DeviceID, then close the websocket (default)
+//      http - GET / with "Connection: close"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+
+namespace beast     = boost::beast;
+namespace http      = beast::http;
+namespace websocket = beast::websocket;
+namespace net       = boost::asio;
+using tcp           = net::ip::tcp;
+
+namespace {
+
+struct worker_result_t {
+    uint64_t connections = 0;
+    uint64_t errors      = 0;
+    std::vector<std::chrono::microseconds> cycles;
+};
+
+void run_worker(tcp::endpoint endpoint, bool ws, int id, std::chrono::steady_clock::time_point until, worker_result_t& res) {
+    net::io_context ioc{ 1 };
+    const std::string device_id = "bench-" + std::to_string(id);
+
+    while(std::chrono::steady_clock::now() < until) {
+        auto start = std::chrono::steady_clock::now();
+        beast::error_code ec;
+
+        if(ws) {
+            websocket::stream<tcp::socket> stream(ioc);
+            stream.next_layer().connect(endpoint, ec);
+            if(!ec) {
+                stream.set_option(websocket::stream_base::decorator(
+                    [&](websocket::request_type& req) { req.set("DeviceID", device_id); }));
+                stream.handshake(endpoint.address().to_string(), "/socket-units-server/", ec);
+            }
+            if(!ec) stream.close(websocket::close_code::normal, ec);
+        } else {
+            tcp::socket socket(ioc);
+            socket.connect(endpoint, ec);
+            if(!ec) {
+                http::request<http::empty_body> req{ http::verb::get, "/", 11 };
+                req.set(http::field::host, endpoint.address().to_string());
+                req.keep_alive(false);
+                http::write(socket, req, ec);
+            }
+            if(!ec) {
+                beast::flat_buffer buffer;
+                http::response<http::string_body> response;
+                http::read(socket, buffer, response, ec);
+            }
+            // the server may have closed first, that doesn't fail the cycle
+            beast::error_code shutdown_ec;
+            socket.shutdown(tcp::socket::shutdown_both, shutdown_ec);
+        }
+
+        if(ec) {
+            res.errors++;
+            continue;
+        }
+        res.connections++;
+        res.cycles.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    if(argc < 3) {
+        std::cerr << "Usage: conn-bench <address> <port> [ws|http] [threads] [seconds]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const tcp::endpoint endpoint{ net::ip::make_address(argv[1]), static_cast<unsigned short>(std::atoi(argv[2])) };
+    const bool ws      = argc <= 3 || std::string(argv[3]) != "http";
+    const int  threads = (argc > 4) ? std::atoi(argv[4]) : 4;
+    const int  seconds = (argc > 5) ? std::atoi(argv[5]) : 5;
+
+    std::vector<worker_result_t> results(threads);
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    auto until = start + std::chrono::seconds(seconds);
+    for(int t = 0; t < threads; t++) {
+        workers.emplace_back(run_worker, endpoint, ws, t, until, std::ref(results[t]));
+    }
+    for(auto& worker : workers) {
+        worker.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t connections = 0, errors = 0;
+    std::vector<std::chrono::microseconds> cycles;
+    for(auto& res : results) {
+        connections += res.connections;
+        errors += res.errors;
+        cycles.insert(cycles.end(), res.cycles.begin(), res.cycles.end());
+    }
+    std::sort(cycles.begin(), cycles.end());
+    auto percentile = [&](double p) {
+        return cycles.empty() ? 0.0 : cycles[static_cast<std::size_t>(p / 100 * (cycles.size() - 1))].count() / 1000.0;
+    };
+
+    std::cout << std::fixed << std::setprecision(2) << (ws ? "ws" : "http") << ", threads: " << threads
+              << ", connections: " << connections << ", errors: " << errors << ", conn/s: " << connections / elapsed
+              << ", cycle p50/p99: " << percentile(50) << "/" << percentile(99) << " ms" << std::endl;
+
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,105 @@
+// Single-thread throughput of the device frame parser on the payloads the client sends, and how fast
+// it turns away malformed ones. A malformed frame should cost no more than a valid one, and less when
+// the damage is near the start. "main + sequence" is what the server does per frame with --sequence.
+//
+// Usage: frame-bench [iterations]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "device_payloads.hpp"
+#include "frame_parser.hpp"
+#include "frame_sequence.hpp"
+
+namespace {
+
+// keeps the results alive so the loops aren't optimized away
+volatile uint64_t sink;
+
+template <class F>
+void run(const std::string& name, const payload_t& payload, long iterations, F&& parse) {
+    uint64_t acc = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(long i = 0; i < iterations; i++) {
+        acc += parse(payload.data(), payload.size());
+    }
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink = acc;
+
+    std::cout << std::left << std::setw(22) << name << std::setw(8) << payload.size()
+              << std::setw(14) << static_cast<long>(iterations / seconds)
+              << std::fixed << std::setprecision(1) << iterations * payload.size() / seconds / 1e6 << std::endl;
+}
+
+uint64_t validate(const uint8_t* data, std::size_t size) {
+    return static_cast<uint64_t>(validate_frame(data, size).error);
+}
+
+}
+
+int main(int argc, char** argv) {
+    const long iterations = (argc > 1) ? std::atol(argv[1]) : 2000000;
+
+    // the second main payload with bad payloads on is the bad one
+    const auto main_payload = ws_get_payload("main_payload", true)->front();
+    const auto bad_payload  = ws_get_payload("main_payload", true)->front();
+    const auto probes       = ws_get_payload("get_probes", false)->front();
+    const auto event        = ws_get_payload("event", false)->front();
+
+    std::cout << "frame                 bytes   frames/s      MB/s\n";
+
+    run("main", main_payload, iterations, validate);
+    run("event", event, iterations, validate);
+    run("probes", probes, iterations / 4, validate);
+
+    run("main + fields", main_payload, iterations, [](const uint8_t* data, std::size_t size) {
+        auto res = validate_frame(data, size);
+        uint64_t acc = 0;
+        for(auto& field : res.frame) {
+            acc += field.value ? field.as_uint32() : field.flag();
+        }
+        return acc;
+    });
+
+    run("bad (18 frames)", bad_payload, iterations / 18, [](const uint8_t* data, std::size_t size) {
+        uint64_t frames = 0;
+        for(std::size_t offset = 0; offset < size; frames++) {
+            auto res = parse_frame(data + offset, size - offset);
+            if(!res) break;
+            offset += res.frame.size();
+        }
+        return frames;
+    });
+
+    payload_t stamped;
+    stamp_frame(main_payload, { 0, sequence_clock_us() }, stamped);
+    sequence_tracker_t tracker;
+    uint32_t sequence = 0;
+    run("main + sequence", stamped, iterations, [&](const uint8_t* data, std::size_t size) {
+        auto res = validate_frame(data, size);
+        auto stamp = res ? find_stamp(res.frame) : std::nullopt;
+        // the stamp is the same every time, the tracker sees the numbers of a device in order
+        return stamp ? static_cast<uint64_t>(tracker.on_frame(sequence++ + stamp->sequence).kind) : 0;
+    });
+
+    auto bad_checksum = main_payload;
+    bad_checksum.back() ^= 0xff;
+    run("reject checksum", bad_checksum, iterations, validate);
+
+    auto bad_field = main_payload;
+    bad_field[2] = 0x00;
+    run("reject field", bad_field, iterations, validate);
+
+    auto unknown_kind = main_payload;
+    unknown_kind[0] = 0x00;
+    run("reject kind", unknown_kind, iterations, validate);
+
+    auto truncated = probes;
+    truncated.resize(truncated.size() - 1);
+    run("reject truncated", truncated, iterations, validate);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+// Multi-threaded throughput of utl_log: every thread logs a typical device line as fast as it can,
+// for 1, 2, 4, ... threads. With no shared lock on the per-record path the total rate should grow
+// with the thread count until the cores run out, instead of flattening at the single thread rate.
+//
+// Two passes: synchronous sinks first, where the threads only share the sink lock, then the async
+// backend the client uses. For the async pass the rate of the logging threads (formatting and the
+// ring push, what the per-record metadata costs) is shown apart from the rate the writer thread
+// gets the messages out at.
+//
+// Usage: log-bench [messages-per-thread] [max-threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utl_log.hpp"
+
+namespace {
+
+// Discards everything, so the benchmark measures the logger and not the terminal
+struct null_buffer_t : std::streambuf {
+    int_type overflow(int_type c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+struct rates_t {
+    double logged  = 0; // until the logging threads are done
+    double written = 0; // until the sinks have every message
+};
+
+rates_t run(int threads, long messages) {
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    for(int t = 0; t < threads; t++) {
+        workers.emplace_back([messages]() {
+            for(long i = 0; i < messages; i++) {
+                UTL_LOG_INFO("Payload sent, ID: ", 1000000000 + i, " bytes: ", 136);
+            }
+        });
+    }
+    for(auto& worker : workers) {
+        worker.join();
+    }
+    auto logged = std::chrono::steady_clock::now();
+    utl::log::flush();
+    auto written = std::chrono::steady_clock::now();
+
+    const double total = static_cast<double>(threads) * messages;
+    return { total / std::chrono::duration<double>(logged - start).count(),
+             total / std::chrono::duration<double>(written - start).count() };
+}
+
+void run_pass(const char* mode, int max_threads, long messages) {
+    rates_t single;
+    for(int threads = 1; threads <= max_threads; threads *= 2) {
+        rates_t rates = run(threads, messages);
+        if(threads == 1) single = rates;
+
+        std::cout << std::left << std::setw(7) << mode << std::setw(9) << threads
+                  << std::setw(13) << static_cast<long>(rates.logged)
+                  << std::fixed << std::setprecision(2) << rates.logged / single.logged << std::setw(5) << "x"
+                  << std::setw(13) << static_cast<long>(rates.written)
+                  << rates.written / single.written << "x" << std::endl;
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    const long messages    = (argc > 1) ? std::atol(argv[1]) : 200000;
+    const int  max_threads = (argc > 2) ? std::atoi(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+
+    null_buffer_t null_buffer;
+    std::ostream  null_stream(&null_buffer);
+
+    utl::log::add_ostream_sink(null_stream, utl::log::Verbosity::INFO, utl::log::Colors::DISABLE);
+
+    std::cout << "mode   threads  logged/s     scaling  written/s    scaling\n";
+
+    // the sink lock is the only thing the threads share, logged and written are the same here
+    run_pass("sync", max_threads, messages);
+
+    // same setup as the client, can't be turned off again
+    utl::log::enable_async(std::size_t{1} << 20, utl::log::Overflow::BLOCK, std::size_t{64} << 20);
+    run_pass("async", max_threads, messages);
+
+    return EXIT_SUCCESS;
+}
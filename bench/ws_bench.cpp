@@ -0,0 +1,471 @@
+// Microbenchmarks of the client's hot paths. Every benchmark runs in growing batches until it has
+// taken --min-time, then reports the cost of one operation. --json writes the results one benchmark
+// per line, and --baseline compares against such a file from an earlier build: a benchmark slower
+// by more than --threshold percent is reported and the exit code is 1.
+//
+// Usage: ws-bench [--filter=<substring>] [--min-time=<ms>] [--json=<file>] [--baseline=<file>] [--threshold=<percent>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/local/connect_pair.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core/flat_static_buffer.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/detail/frame.hpp>
+#include <boost/beast/websocket/detail/mask.hpp>
+
+#include "device_payloads.hpp"
+#include "frame_encoder.hpp"
+#include "frame_parser.hpp"
+#include "id_loader.hpp"
+#include "metrics_file.hpp"
+#include "util.hpp"
+#include "utl_log.hpp"
+
+namespace net       = boost::asio;
+namespace websocket = boost::beast::websocket;
+
+namespace {
+
+struct result_t {
+    std::string name;
+    int         threads        = 1;
+    uint64_t    iterations     = 0;
+    std::size_t bytes_per_op   = 0;
+    double      ns_per_op      = 0;
+};
+
+// keeps the results alive so the loops aren't optimized away
+std::atomic<uint64_t> sink{0};
+
+struct null_buffer_t : std::streambuf {
+    int_type overflow(int_type c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+class runner_t {
+    public:
+    runner_t(std::string filter, std::chrono::milliseconds min_time) : filter_(std::move(filter)), min_time_(min_time) {}
+
+    // op(n) performs n operations on one thread
+    template <class Op>
+    void run(const std::string& name, std::size_t bytes_per_op, Op&& op) {
+        run(name, 1, bytes_per_op, [&](int, uint64_t n) { op(n); });
+    }
+
+    // op(thread, n) performs n operations, on every thread at once; the cost is per operation of one thread
+    template <class Op>
+    void run(const std::string& name, int threads, std::size_t bytes_per_op, Op&& op) {
+        if(name.find(filter_) == std::string::npos) return;
+
+        auto batch = [&](uint64_t n) {
+            std::vector<std::thread> workers;
+            auto start = std::chrono::steady_clock::now();
+            if(threads == 1) {
+                op(0, n);
+            } else {
+                for(int t = 0; t < threads; t++) {
+                    workers.emplace_back([&op, t, n] { op(t, n); });
+                }
+                for(auto& worker : workers) {
+                    worker.join();
+                }
+            }
+            return std::chrono::steady_clock::now() - start;
+        };
+
+        // warm up, then double the batch until it takes long enough to measure
+        batch(1);
+        uint64_t n = 1;
+        auto elapsed = batch(n);
+        while(elapsed < min_time_) {
+            n *= 2;
+            elapsed = batch(n);
+        }
+
+        result_t res{ name, threads, n, bytes_per_op,
+                      std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(n) };
+
+        std::cout << std::left << std::setw(28) << res.name << std::right << std::setw(4) << res.threads
+                  << std::setw(14) << std::fixed << std::setprecision(1) << res.ns_per_op
+                  << std::setw(16) << static_cast<uint64_t>(1e9 / res.ns_per_op * threads);
+        if(bytes_per_op > 0) {
+            std::cout << std::setw(12) << std::setprecision(1) << bytes_per_op * 1e3 / res.ns_per_op;
+        }
+        std::cout << std::endl;
+
+        results_.push_back(std::move(res));
+    }
+
+    const std::vector<result_t>& results() const { return results_; }
+
+    // Result of the benchmark if it was the last one run, nullptr when the filter skipped it
+    const result_t* last(const std::string& name) const {
+        return !results_.empty() && results_.back().name == name ? &results_.back() : nullptr;
+    }
+
+    private:
+    std::string               filter_;
+    std::chrono::milliseconds min_time_;
+    std::vector<result_t>     results_;
+};
+
+// one line per benchmark, so an earlier file can be read back without a JSON parser
+void write_json(std::ostream& out, const std::vector<result_t>& results) {
+    out << "{\n";
+#if defined(__VERSION__)
+    out << "\"compiler\": \"" << __VERSION__ << "\",\n";
+#endif
+#if defined(NDEBUG)
+    out << "\"build\": \"release\",\n";
+#else
+    out << "\"build\": \"debug\",\n";
+#endif
+    out << "\"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "\"benchmarks\": [\n";
+    for(std::size_t i = 0; i < results.size(); i++) {
+        auto& res = results[i];
+        out << "{\"name\": \"" << res.name << "\", \"threads\": " << res.threads << ", \"iterations\": " << res.iterations
+            << ", \"bytes_per_op\": " << res.bytes_per_op << ", \"ns_per_op\": " << std::setprecision(3) << std::fixed
+            << res.ns_per_op << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n}\n";
+}
+
+std::map<std::string, double> read_baseline(const std::string& filename) {
+    std::map<std::string, double> res;
+    std::ifstream in(filename);
+    std::string line;
+    while(std::getline(in, line)) {
+        auto name = line.find("{\"name\": \"");
+        auto ns   = line.find("\"ns_per_op\": ");
+        if(name == std::string::npos || ns == std::string::npos) continue;
+        name += 10;
+        res[line.substr(name, line.find('"', name) - name)] = std::strtod(line.c_str() + ns + 13, nullptr);
+    }
+    return res;
+}
+
+void bench_payloads(runner_t& runner) {
+    runner.run("payload/main_payload", 0, [](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            sink.fetch_add(ws_get_payload("main_payload", false)->front().size(), std::memory_order_relaxed);
+        }
+    });
+    runner.run("payload/get_probes", 0, [](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            sink.fetch_add(ws_get_payload("get_probes", false)->size(), std::memory_order_relaxed);
+        }
+    });
+    runner.run("payload/event", 0, [](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            sink.fetch_add(ws_get_payload("event", false)->size(), std::memory_order_relaxed);
+        }
+    });
+    // dispatch only, nothing is copied
+    runner.run("payload/unknown_request", 0, [](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            sink.fetch_add(ws_get_payload("set_settings", false).has_value(), std::memory_order_relaxed);
+        }
+    });
+}
+
+void bench_run_with_timeout(runner_t& runner) {
+    runner.run("util/run_with_timeout", 0, [](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            run_with_timeout([] { sink.fetch_add(1, std::memory_order_relaxed); }, std::chrono::seconds(1), "bench");
+        }
+    });
+}
+
+void bench_log(runner_t& runner) {
+    runner.run("log/format", 0, [](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            UTL_LOG_INFO("Payload sent, ID: ", 1000000000 + i, " bytes: ", 136);
+        }
+        utl::log::flush();
+    });
+
+    const int threads = std::max(2u, std::thread::hardware_concurrency());
+    runner.run("log/format_mt", threads, 0, [](int, uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            UTL_LOG_INFO("Payload sent, ID: ", 1000000000 + i, " bytes: ", 136);
+        }
+        utl::log::flush();
+    });
+}
+
+void bench_ids(runner_t& runner) {
+    constexpr std::size_t count = 100000;
+
+    std::vector<std::string> ids;
+    ids.reserve(count);
+    for(std::size_t i = 0; i < count; i++) {
+        ids.push_back(format_device_id(i * 0x9e3779b97ull & device_id_max));
+    }
+
+    runner.run("ids/parse_device_id", 10, [&](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            sink.fetch_add(parse_device_id(ids[i % count]).value_or(0), std::memory_order_relaxed);
+        }
+    });
+
+    auto filename = (std::filesystem::temp_directory_path() / "ws-bench-ids.txt").string();
+    {
+        std::ofstream out(filename, std::ios::binary);
+        for(auto& id : ids) {
+            out << id << '\n';
+        }
+    }
+    // one operation is one load of the whole file, the cost per id is derived from it
+    const auto file_size = std::filesystem::file_size(filename);
+    runner.run("ids/load_file", file_size, [&](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            sink.fetch_add(load_device_ids(filename)->ids.size(), std::memory_order_relaxed);
+        }
+    });
+    if(auto res = runner.last("ids/load_file")) {
+        std::cout << "  = " << std::fixed << std::setprecision(1) << res->ns_per_op / count << " ns per id" << std::endl;
+    }
+    std::filesystem::remove(filename);
+}
+
+void bench_frames(runner_t& runner) {
+    const auto main_payload = ws_get_payload("main_payload", false)->front();
+    const auto probes       = ws_get_payload("get_probes", false)->front();
+
+    runner.run("frame/crc16_probes", probes.size(), [&](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            sink.fetch_add(crc16_ccitt(probes.data(), probes.size() - 2), std::memory_order_relaxed);
+        }
+    });
+    runner.run("frame/validate_main", main_payload.size(), [&](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            sink.fetch_add(static_cast<uint64_t>(validate_frame(main_payload.data(), main_payload.size()).error),
+                           std::memory_order_relaxed);
+        }
+    });
+}
+
+// What beast does for every message the client writes: a frame header with a fresh key, then the masked payload
+void bench_websocket(runner_t& runner) {
+    const auto main_payload = ws_get_payload("main_payload", false)->front();
+
+    runner.run("ws/serialize_mask_main", main_payload.size(), [&](uint64_t n) {
+        boost::beast::flat_static_buffer<14> header;
+        std::vector<uint8_t> out(main_payload.size());
+        for(uint64_t i = 0; i < n; i++) {
+            websocket::detail::frame_header fh;
+            fh.op     = websocket::detail::opcode::binary;
+            fh.fin    = true;
+            fh.rsv1   = fh.rsv2 = fh.rsv3 = false;
+            fh.len    = main_payload.size();
+            fh.mask   = true;
+            fh.key    = static_cast<uint32_t>(i * 0x9e3779b9u);
+            header.clear();
+            websocket::detail::write(header, fh);
+
+            websocket::detail::prepared_key key;
+            websocket::detail::prepare_key(key, fh.key);
+            std::copy(main_payload.begin(), main_payload.end(), out.begin());
+            boost::asio::mutable_buffer buffer(out.data(), out.size());
+            websocket::detail::mask_inplace(buffer, key);
+            sink.fetch_add(header.size() + out[0], std::memory_order_relaxed);
+        }
+    });
+
+    for(std::size_t size : { std::size_t{ 150 }, std::size_t{ 4096 }, std::size_t{ 65536 } }) {
+        runner.run("ws/mask_" + std::to_string(size), size, [size](uint64_t n) {
+            std::vector<uint8_t> data(size, 0x5a);
+            websocket::detail::prepared_key key;
+            websocket::detail::prepare_key(key, 0x12345678);
+            for(uint64_t i = 0; i < n; i++) {
+                boost::asio::mutable_buffer buffer(data.data(), data.size());
+                websocket::detail::mask_inplace(buffer, key);
+            }
+            sink.fetch_add(data[0], std::memory_order_relaxed);
+        });
+        runner.run("ws/mask_" + std::string(mask_kernel_name()) + "_" + std::to_string(size), size, [size](uint64_t n) {
+            std::vector<uint8_t> data(size, 0x5a);
+            for(uint64_t i = 0; i < n; i++) {
+                mask_payload(data.data(), data.size(), { 0x12, 0x34, 0x56, 0x78 });
+            }
+            sink.fetch_add(data[0], std::memory_order_relaxed);
+        });
+        runner.run("ws/mask_scalar_" + std::to_string(size), size, [size](uint64_t n) {
+            std::vector<uint8_t> data(size, 0x5a);
+            for(uint64_t i = 0; i < n; i++) {
+                mask_payload_scalar(data.data(), data.size(), { 0x12, 0x34, 0x56, 0x78 });
+            }
+            sink.fetch_add(data[0], std::memory_order_relaxed);
+        });
+    }
+
+    runner.run("ws/encode_main", main_payload.size(), [&](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            auto key = static_cast<uint32_t>(i * 0x9e3779b9u);
+            sink.fetch_add(encode_client_frame(main_payload, { uint8_t(key), uint8_t(key >> 8), uint8_t(key >> 16), uint8_t(key >> 24) }).size(),
+                           std::memory_order_relaxed);
+        }
+    });
+}
+
+// A device write end to end on one core: beast's write, which serializes and masks every frame, against
+// a pre-masked frame written to the socket as it is. The other end of a socket pair is drained by a thread.
+void bench_write_path(runner_t& runner) {
+    using socket_t = net::local::stream_protocol::socket;
+
+    net::io_context ioc;
+    socket_t client_socket(ioc), server_socket(ioc);
+    net::local::connect_pair(client_socket, server_socket);
+
+    websocket::stream<socket_t> client(std::move(client_socket));
+    websocket::stream<socket_t> server(std::move(server_socket));
+
+    std::thread accept([&] { server.accept(); });
+    client.handshake("localhost", "/");
+    accept.join();
+    client.binary(true);
+
+    // the server side is read raw, only the bytes matter
+    std::thread drain([&] {
+        std::vector<uint8_t> buffer(std::size_t{1} << 16);
+        boost::system::error_code ec;
+        while(!ec) {
+            server.next_layer().read_some(net::buffer(buffer), ec);
+        }
+    });
+
+    const auto& main_payload = ws_find_payload("main_payload", false)->front();
+    premasked_payload_t premasked(main_payload, 64);
+
+    runner.run("ws/write_beast_main", main_payload.size(), [&](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            client.write(net::buffer(main_payload));
+        }
+    });
+    runner.run("ws/write_premasked_main", main_payload.size(), [&](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            net::write(client.next_layer(), net::buffer(premasked.next_frame()));
+        }
+    });
+
+    boost::system::error_code ec;
+    client.next_layer().shutdown(socket_t::shutdown_both, ec);
+    drain.join();
+}
+
+// A row of --metrics as the client writes it every interval, chunk growth included. The file starts
+// over every 64K rows so a long run doesn't fill the disk.
+void bench_metrics(runner_t& runner) {
+    const auto filename = (std::filesystem::temp_directory_path() / "ws-bench-metrics.bin").string();
+
+    std::vector<std::string> columns;
+    for(int i = 0; i < 16; i++) {
+        columns.push_back("column_" + std::to_string(i));
+    }
+    auto writer = metrics_writer_t::open(filename, columns, std::chrono::milliseconds(1000));
+    if(!writer) return;
+
+    std::vector<double> row(columns.size(), 1.5);
+    runner.run("metrics/append_row_16", row.size() * 24, [&](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            if(writer->rows() == 65536) {
+                writer.reset();
+                writer = metrics_writer_t::open(filename, columns, std::chrono::milliseconds(1000));
+            }
+            writer->append(row);
+        }
+    });
+
+    writer.reset();
+    std::error_code ec;
+    std::filesystem::remove(filename, ec);
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::string filter;
+    long long   min_time  = 200;
+    double      threshold = 10;
+    std::optional<std::string> json_file;
+    std::optional<std::string> baseline_file;
+
+    if(auto opt = get_option(argc, argv, 1, "filter")) {
+        filter = std::string(*opt);
+    }
+    if(auto opt = get_option(argc, argv, 1, "min-time")) {
+        min_time = std::stoll(std::string(*opt));
+    }
+    if(auto opt = get_option(argc, argv, 1, "json")) {
+        json_file = std::string(*opt);
+    }
+    if(auto opt = get_option(argc, argv, 1, "baseline")) {
+        baseline_file = std::string(*opt);
+    }
+    if(auto opt = get_option(argc, argv, 1, "threshold")) {
+        threshold = std::stod(std::string(*opt));
+    }
+
+    // the logger formats and queues as in the client, the records are thrown away
+    null_buffer_t null_buffer;
+    std::ostream  null_stream(&null_buffer);
+    utl::log::add_ostream_sink(null_stream, utl::log::Verbosity::INFO, utl::log::Colors::DISABLE);
+    utl::log::enable_async(std::size_t{1} << 20, utl::log::Overflow::BLOCK);
+
+    runner_t runner(filter, std::chrono::milliseconds(min_time));
+
+    std::cout << "benchmark                   threads     ns/op         ops/s        MB/s\n";
+
+    bench_payloads(runner);
+    bench_run_with_timeout(runner);
+    bench_log(runner);
+    bench_ids(runner);
+    bench_frames(runner);
+    bench_websocket(runner);
+    bench_write_path(runner);
+    bench_metrics(runner);
+
+    if(json_file) {
+        std::ofstream out(*json_file);
+        write_json(out, runner.results());
+    }
+
+    int res = EXIT_SUCCESS;
+    if(baseline_file) {
+        auto baseline = read_baseline(*baseline_file);
+        if(baseline.empty()) {
+            std::cout << "No results in baseline: " << *baseline_file << std::endl;
+            return EXIT_FAILURE;
+        }
+        for(auto& result : runner.results()) {
+            auto it = baseline.find(result.name);
+            if(it == baseline.end() || it->second <= 0) continue;
+
+            double change = (result.ns_per_op / it->second - 1) * 100;
+            if(change > threshold) {
+                std::cout << "Regression: " << result.name << " " << std::setprecision(1) << it->second << " -> "
+                          << result.ns_per_op << " ns/op (+" << change << "%)" << std::endl;
+                res = EXIT_FAILURE;
+            }
+        }
+    }
+
+    return res;
+}
@@ -0,0 +1,33 @@
+// libFuzzer target for the device frame parser: any input must parse without reading past it,
+// and whatever it accepts has to hold up to a second look.
+//
+// Build with -DBUILD_FUZZERS=ON and clang, run: frame-fuzz [corpus-dir]
+
+#include <cstdlib>
+
+#include "frame_parser.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size) {
+    for(std::size_t offset = 0; offset < size;) {
+        auto res = parse_frame(data + offset, size - offset);
+        if(res.offset > size - offset) std::abort();
+        if(!res) break;
+
+        auto& frame = res.frame;
+        if(frame.size() < 3 || frame.size() != res.offset) std::abort();
+        if(crc16_ccitt(frame.data(), frame.size() - 2) != frame.checksum()) std::abort();
+
+        // fields stay inside the body
+        const uint8_t* end = frame.body() + frame.body_size();
+        for(auto& field : frame) {
+            if(field.value && (field.value < frame.body() || field.value + 4 > end)) std::abort();
+            if(field.type() == field_type_t::float32) static_cast<void>(field.as_float());
+        }
+
+        offset += frame.size();
+    }
+
+    auto res = validate_frame(data, size);
+    if(res && res.frame.size() != size) std::abort();
+    return 0;
+}
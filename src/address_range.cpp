@@ -0,0 +1,42 @@
+#include "address_range.hpp"
+
+#include <boost/asio/ip/address.hpp>
+
+address_range_t address_range_t::slice(size_t k, size_t n) const {
+    if(n >= size()) {
+        uint32_t address = first + static_cast<uint32_t>(k % size());
+        return { address, address };
+    }
+
+    const size_t begin = size() * k / n;
+    const size_t end   = size() * (k + 1) / n;
+
+    return { first + static_cast<uint32_t>(begin), first + static_cast<uint32_t>(end - 1) };
+}
+
+std::string address_range_t::to_string() const {
+    auto res = boost::asio::ip::address_v4(first).to_string();
+    if(last != first) {
+        res += '-' + boost::asio::ip::address_v4(last).to_string();
+    }
+    return res;
+}
+
+std::optional<address_range_t> parse_address_range(std::string_view text) {
+    auto parse = [](std::string_view address) -> std::optional<uint32_t> {
+        boost::system::error_code ec;
+        auto parsed = boost::asio::ip::make_address_v4(std::string(address), ec);
+        if(ec) return std::nullopt;
+        return parsed.to_uint();
+    };
+
+    auto dash  = text.find('-');
+    auto first = parse(text.substr(0, dash));
+    auto last  = (dash == std::string_view::npos) ? first : parse(text.substr(dash + 1));
+
+    if(!first || !last || *last < *first) {
+        return std::nullopt;
+    }
+
+    return address_range_t{ *first, *last };
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <boost/asio/ip/address_v4.hpp>
+
+// Inclusive range of IPv4 source addresses, "10.0.0.1-10.0.0.8" or a single "10.0.0.1".
+// Devices bind their sockets to these round-robin to get past the ephemeral port limit of one address.
+struct address_range_t {
+    uint32_t first = 0;
+    uint32_t last  = 0;
+
+    size_t size() const { return static_cast<size_t>(last - first) + 1; }
+
+    boost::asio::ip::address_v4 at(size_t index) const {
+        return boost::asio::ip::address_v4(first + static_cast<uint32_t>(index % size()));
+    }
+
+    // k-th of n contiguous slices. With more slices than addresses, slices share single addresses.
+    address_range_t slice(size_t k, size_t n) const;
+
+    std::string to_string() const;
+};
+
+std::optional<address_range_t> parse_address_range(std::string_view text);
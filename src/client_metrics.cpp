@@ -0,0 +1,141 @@
+#include "client_metrics.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include "utl_log.hpp"
+
+namespace {
+
+// the order of the values in sample_row()
+constexpr std::array columns = {
+    "connected",
+    "connects_per_s",
+    "connect_errors_per_s",
+    "handshake_errors_per_s",
+    "frames_sent_per_s",
+    "bytes_sent_per_s",
+    "write_errors_per_s",
+    "frames_received_per_s",
+    "write_queue_depth",
+    "queue_dropped_per_s",
+    "queue_coalesced_per_s",
+    "backpressure_ms_per_s",
+    "connect_p50_ms",
+    "connect_p99_ms",
+    "reply_p50_ms",
+    "reply_p99_ms",
+};
+
+target_stats_snapshot_t merged_stats(const target_pool_t& target_pool) {
+    target_stats_snapshot_t res;
+    for(auto& endpoint : target_pool.all_endpoints()) {
+        res.merge(endpoint->stats.snapshot());
+    }
+    return res;
+}
+
+// NaN when nothing was recorded in the interval
+double percentile_ms(const histogram_counts_t& histogram, double p) {
+    if(histogram.count() == 0) return std::numeric_limits<double>::quiet_NaN();
+    return histogram.percentile(p).count() / 1000.0;
+}
+
+std::array<double, columns.size()> sample_row(const target_stats_snapshot_t& now, const target_stats_snapshot_t& last, double seconds) {
+    auto rate = [&](uint64_t total, uint64_t before) {
+        return seconds > 0 ? static_cast<double>(total - before) / seconds : 0.0;
+    };
+
+    const auto connect_latency = now.connect_latency.since(last.connect_latency);
+    const auto reply_latency   = now.reply_latency.since(last.reply_latency);
+
+    return {
+        static_cast<double>(now.active_connections),
+        rate(now.connect_attempts, last.connect_attempts),
+        rate(now.connect_errors, last.connect_errors),
+        rate(now.handshake_errors, last.handshake_errors),
+        rate(now.frames_sent, last.frames_sent),
+        rate(now.bytes_sent, last.bytes_sent),
+        rate(now.write_errors, last.write_errors),
+        rate(now.frames_received, last.frames_received),
+        static_cast<double>(now.write_queue_depth),
+        rate(now.write_queue_dropped, last.write_queue_dropped),
+        rate(now.write_queue_coalesced, last.write_queue_coalesced),
+        rate(now.backpressure_us, last.backpressure_us) / 1000.0,
+        percentile_ms(connect_latency, 50),
+        percentile_ms(connect_latency, 99),
+        percentile_ms(reply_latency, 50),
+        percentile_ms(reply_latency, 99),
+    };
+}
+
+}
+
+std::unique_ptr<client_metrics_t> client_metrics_t::open(const std::string& filename, std::chrono::milliseconds interval,
+                                                         const target_pool_t& target_pool) {
+    auto writer = metrics_writer_t::open(filename, std::vector<std::string>(columns.begin(), columns.end()), interval);
+    if(!writer) return nullptr;
+    return std::unique_ptr<client_metrics_t>(new client_metrics_t(std::move(writer), interval, target_pool));
+}
+
+client_metrics_t::~client_metrics_t() {
+    stop();
+}
+
+void client_metrics_t::start() {
+    thread_ = std::thread([this]() { loop(); });
+}
+
+void client_metrics_t::stop() {
+    {
+        std::lock_guard lock(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+
+    if(thread_.joinable()) {
+        thread_.join();
+    }
+    writer_->close();
+}
+
+void client_metrics_t::loop() {
+    using clock = std::chrono::steady_clock;
+
+    auto last      = merged_stats(target_pool_);
+    auto last_time = clock::now();
+    auto next      = last_time + interval_;
+
+    auto append = [&]() {
+        auto now  = merged_stats(target_pool_);
+        auto time = clock::now();
+
+        auto row = sample_row(now, last, std::chrono::duration<double>(time - last_time).count());
+        if(!writer_->append(row)) {
+            return false;
+        }
+
+        last      = std::move(now);
+        last_time = time;
+        return true;
+    };
+
+    std::unique_lock lock(stop_mutex_);
+    // on the schedule of the start, a slow sample doesn't shift the ones after it
+    while(!stop_cv_.wait_until(lock, next, [this]() { return stopping_; })) {
+        lock.unlock();
+        if(!append()) {
+            UTL_LOG_ERR("Metrics file can't grow, no more samples are written");
+            return;
+        }
+        // after a stall, e.g. a suspended process, the next sample is an interval away instead of catching up
+        const auto now = clock::now();
+        next += interval_;
+        if(next < now) {
+            next = now + interval_;
+        }
+        lock.lock();
+    }
+    append(); // final row
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "metrics_file.hpp"
+#include "target_pool.hpp"
+
+// --metrics: samples the merged stats of every target each interval and appends a row to a
+// metrics_writer_t - rates over the interval, connected devices, queued frames and the latency
+// percentiles of the interval alone. A last row is written on stop().
+class client_metrics_t {
+public:
+    // nullptr if the file can't be created
+    static std::unique_ptr<client_metrics_t> open(const std::string& filename, std::chrono::milliseconds interval,
+                                                  const target_pool_t& target_pool);
+    ~client_metrics_t();
+
+    void start();
+    void stop();
+
+    uint64_t rows() const { return writer_->rows(); }
+
+private:
+    client_metrics_t(std::unique_ptr<metrics_writer_t> writer, std::chrono::milliseconds interval, const target_pool_t& target_pool)
+        : writer_(std::move(writer)), interval_(interval), target_pool_(target_pool) {}
+
+    void loop();
+
+    std::unique_ptr<metrics_writer_t> writer_;
+    std::chrono::milliseconds         interval_;
+    const target_pool_t&              target_pool_;
+
+    std::mutex              stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool                    stopping_ = false;
+    std::thread             thread_;
+};
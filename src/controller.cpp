@@ -0,0 +1,792 @@
+#include "controller.hpp"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+
+#include <boost/asio.hpp>
+#include <boost/core/ignore_unused.hpp>
+
+#if !defined(_WIN32)
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "address_range.hpp"
+#include "id_generator.hpp"
+#include "util.hpp"
+#include "utl_log.hpp"
+
+namespace net = boost::asio;
+
+namespace {
+
+constexpr uint32_t stats_magic   = 0x53545357; // "WSTS"
+constexpr uint32_t stats_version = 3;
+
+template <class T>
+void put(std::string& out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+template <class T>
+bool get(std::string_view& in, T& value) {
+    if(in.size() < sizeof(T)) return false;
+    std::memcpy(&value, in.data(), sizeof(T));
+    in.remove_prefix(sizeof(T));
+    return true;
+}
+
+// histograms are sparse, only the non-empty buckets are sent
+void put_histogram(std::string& out, const histogram_counts_t& h) {
+    uint32_t used = 0;
+    for(auto b : h.buckets) used += (b != 0);
+    put<uint32_t>(out, used);
+    for(uint32_t i = 0; i < h.buckets.size(); i++) {
+        if(h.buckets[i] == 0) continue;
+        put<uint32_t>(out, i);
+        put<uint64_t>(out, h.buckets[i]);
+    }
+}
+
+bool get_histogram(std::string_view& in, histogram_counts_t& h) {
+    uint32_t used = 0;
+    if(!get(in, used)) return false;
+
+    for(uint32_t i = 0; i < used; i++) {
+        uint32_t index;
+        uint64_t count;
+        if(!get(in, index) || !get(in, count) || index >= h.buckets.size()) return false;
+        h.buckets[index] = count;
+    }
+    return true;
+}
+
+void put_snapshot(std::string& out, const target_stats_snapshot_t& s) {
+    put<uint64_t>(out, s.connect_attempts);
+    put<uint64_t>(out, s.connect_errors);
+    put<uint64_t>(out, s.handshake_errors);
+    put<int64_t>(out, s.active_connections);
+    put<uint64_t>(out, s.frames_sent);
+    put<uint64_t>(out, s.bytes_sent);
+    put<uint64_t>(out, s.write_errors);
+    put<uint64_t>(out, s.frames_received);
+    put<int64_t>(out, s.write_queue_depth);
+    put<uint64_t>(out, s.write_queue_dropped);
+    put<uint64_t>(out, s.write_queue_coalesced);
+    put<uint64_t>(out, s.backpressure_us);
+
+    put_histogram(out, s.connect_latency);
+    put_histogram(out, s.reply_latency);
+}
+
+bool get_snapshot(std::string_view& in, target_stats_snapshot_t& s) {
+    bool ok = get(in, s.connect_attempts) && get(in, s.connect_errors) && get(in, s.handshake_errors)
+              && get(in, s.active_connections) && get(in, s.frames_sent) && get(in, s.bytes_sent)
+              && get(in, s.write_errors) && get(in, s.frames_received) && get(in, s.write_queue_depth)
+              && get(in, s.write_queue_dropped) && get(in, s.write_queue_coalesced) && get(in, s.backpressure_us);
+
+    return ok && get_histogram(in, s.connect_latency) && get_histogram(in, s.reply_latency);
+}
+
+}
+
+std::string encode_worker_stats(int worker_id, const named_stats_t& stats) {
+    std::string out;
+    put<uint32_t>(out, stats_magic);
+    put<uint32_t>(out, stats_version);
+    put<int32_t>(out, worker_id);
+    put<uint32_t>(out, static_cast<uint32_t>(stats.size()));
+
+    for(auto& [name, snapshot] : stats) {
+        put<uint32_t>(out, static_cast<uint32_t>(name.size()));
+        out += name;
+        put_snapshot(out, snapshot);
+    }
+
+    return out;
+}
+
+bool decode_worker_stats(std::string_view payload, int& worker_id, named_stats_t& stats) {
+    uint32_t magic, version, count;
+    int32_t  id;
+    if(!get(payload, magic) || magic != stats_magic) return false;
+    if(!get(payload, version) || version != stats_version) return false;
+    if(!get(payload, id) || !get(payload, count)) return false;
+
+    stats.clear();
+    for(uint32_t i = 0; i < count; i++) {
+        uint32_t name_size;
+        if(!get(payload, name_size) || payload.size() < name_size) return false;
+
+        auto& [name, snapshot] = stats.emplace_back();
+        name = std::string(payload.substr(0, name_size));
+        payload.remove_prefix(name_size);
+
+        if(!get_snapshot(payload, snapshot)) return false;
+    }
+
+    worker_id = id;
+    return payload.empty();
+}
+
+named_stats_t snapshot_target_pool(const target_pool_t& target_pool) {
+    named_stats_t res;
+    for(auto& endpoint : target_pool.all_endpoints()) {
+        res.emplace_back(endpoint->name, endpoint->stats.snapshot());
+    }
+    return res;
+}
+
+// ===============
+// --- Worker ---
+// ===============
+
+worker_stats_stream_t::worker_stats_stream_t(std::string socket_path, int worker_id, const target_pool_t& target_pool)
+    : socket_path_(std::move(socket_path)), worker_id_(worker_id), target_pool_(target_pool) {}
+
+worker_stats_stream_t::~worker_stats_stream_t() {
+    stop();
+}
+
+void worker_stats_stream_t::start(std::chrono::milliseconds interval) {
+    thread_ = std::thread([this, interval]() { loop(interval); });
+}
+
+void worker_stats_stream_t::stop() {
+    {
+        std::lock_guard lock(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+
+    if(thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void worker_stats_stream_t::loop(std::chrono::milliseconds interval) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    using local = net::local::stream_protocol;
+
+    net::io_context ioc;
+    local::socket   socket(ioc);
+
+    try {
+        socket.connect(local::endpoint(socket_path_));
+    } catch(std::exception const& e) {
+        UTL_LOG_ERR("Failed to connect to controller: ", socket_path_, " ", e.what());
+        return;
+    }
+
+    auto send = [&]() {
+        auto payload = encode_worker_stats(worker_id_, snapshot_target_pool(target_pool_));
+
+        std::string message;
+        put<uint32_t>(message, static_cast<uint32_t>(payload.size()));
+        message += payload;
+
+        net::write(socket, net::buffer(message));
+    };
+
+    try {
+        std::unique_lock lock(stop_mutex_);
+        while(!stop_cv_.wait_for(lock, interval, [this]() { return stopping_; })) {
+            send();
+        }
+        send(); // final totals
+    } catch(std::exception const& e) {
+        UTL_LOG_ERR("Lost connection to controller: ", e.what());
+    }
+#else
+    UTL_LOG_ERR("Stats streaming needs Unix domain sockets, not available on this platform");
+#endif
+}
+
+// ===================
+// --- Controller ---
+// ===================
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS) && !defined(_WIN32)
+
+namespace {
+
+using local = net::local::stream_protocol;
+
+struct worker_t {
+    pid_t         pid = -1;
+    bool          exited = false;
+    int           exit_code = 0;
+    named_stats_t stats;
+};
+
+// Reads length prefixed stats messages of one worker
+class worker_connection_t : public std::enable_shared_from_this<worker_connection_t> {
+public:
+    worker_connection_t(local::socket socket, std::map<int, worker_t>& workers)
+        : socket_(std::move(socket)), workers_(workers) {}
+
+    void run() { read_header(); }
+
+private:
+    void read_header() {
+        net::async_read(socket_, net::buffer(&size_, sizeof(size_)),
+                        [self = shared_from_this()](boost::system::error_code ec, size_t) {
+                            if(ec) return;
+                            self->payload_.resize(self->size_);
+                            self->read_payload();
+                        });
+    }
+
+    void read_payload() {
+        net::async_read(socket_, net::buffer(payload_),
+                        [self = shared_from_this()](boost::system::error_code ec, size_t) {
+                            if(ec) return;
+
+                            int           worker_id;
+                            named_stats_t stats;
+                            if(!decode_worker_stats(self->payload_, worker_id, stats)) {
+                                UTL_LOG_ERR("Malformed stats message from a worker");
+                                return;
+                            }
+
+                            auto it = self->workers_.find(worker_id);
+                            if(it != self->workers_.end()) {
+                                it->second.stats = std::move(stats);
+                            }
+
+                            self->read_header();
+                        });
+    }
+
+    local::socket            socket_;
+    std::map<int, worker_t>& workers_;
+    uint32_t                 size_ = 0;
+    std::string              payload_;
+};
+
+void log_merged_stats(const std::map<int, worker_t>& workers, std::string_view title) {
+    std::map<std::string, target_stats_snapshot_t> by_target;
+    target_stats_snapshot_t                        total;
+
+    for(auto& [id, worker] : workers) {
+        for(auto& [name, snapshot] : worker.stats) {
+            by_target[name].merge(snapshot);
+            total.merge(snapshot);
+        }
+    }
+
+    UTL_LOG_INFO(title, " (", workers.size(), " workers)");
+    for(auto& [name, snapshot] : by_target) {
+        UTL_LOG_INFO("Target ", name, " ", format_target_stats(snapshot));
+    }
+    UTL_LOG_INFO("Total ", format_target_stats(total));
+}
+
+std::string self_executable(const char* argv0) {
+    std::error_code ec;
+    auto path = std::filesystem::read_symlink("/proc/self/exe", ec);
+    return ec ? std::string(argv0) : path.string();
+}
+
+// args[0] is the executable, returns -1 if the fork failed. before_exec runs in this process
+// while the child waits to exec, for whatever has to be set up on it before it starts.
+pid_t spawn_process(std::vector<std::string> args, const std::function<void(pid_t)>& before_exec = {}) {
+    std::vector<char*> c_args;
+    for(auto& a : args) c_args.push_back(a.data());
+    c_args.push_back(nullptr);
+
+    int gate[2] = { -1, -1 };
+    if(before_exec && ::pipe(gate) != 0) {
+        return -1;
+    }
+
+    pid_t pid = ::fork();
+    if(pid == 0) {
+        if(before_exec) {
+            // released when the parent closes its end
+            char byte;
+            ::close(gate[1]);
+            while(::read(gate[0], &byte, 1) < 0 && errno == EINTR) {}
+            ::close(gate[0]);
+        }
+        ::execv(c_args[0], c_args.data());
+        std::perror("execv");
+        ::_exit(127);
+    }
+
+    if(before_exec) {
+        ::close(gate[0]);
+        if(pid > 0) before_exec(pid);
+        ::close(gate[1]);
+    }
+    return pid;
+}
+
+}
+
+int run_controller(int argc, char** argv) {
+    if(argc < 4) {
+        std::cout << "Usage: ws-test-client controller <workers> <client arguments...>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const int worker_count = std::stoi(argv[2]);
+    if(worker_count < 1) {
+        std::cout << "Worker count must be at least 1" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // client arguments, without the ones the controller hands out per worker
+    std::vector<std::string>       client_args;
+    std::optional<address_range_t> bind_range;
+    long long                      stats_interval = 10;
+
+    for(int i = 3; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if(arg.starts_with("--bind=")) {
+            bind_range = parse_address_range(arg.substr(sizeof("--bind=") - 1));
+            if(!bind_range) {
+                std::cout << "Bad source address range: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        if(arg.starts_with("--shard=") || arg.starts_with("--worker-id=") || arg.starts_with("--stats-socket=")) {
+            continue;
+        }
+        if(arg.starts_with("--stats-interval=")) {
+            stats_interval = std::stoll(std::string(arg.substr(sizeof("--stats-interval=") - 1)));
+        }
+        client_args.emplace_back(arg);
+    }
+
+    auto socket_path = (std::filesystem::temp_directory_path()
+                        / ("ws-test-client-" + std::to_string(::getpid()) + ".sock")).string();
+    std::filesystem::remove(socket_path);
+
+    net::io_context   ioc;
+    local::acceptor   acceptor(ioc, local::endpoint(socket_path));
+    std::map<int, worker_t> workers;
+
+    const auto executable = self_executable(argv[0]);
+
+    for(int k = 0; k < worker_count; k++) {
+        std::vector<std::string> args;
+        args.push_back(executable);
+        for(auto& arg : client_args) {
+            // every worker needs its own binary log, metrics file and recording
+            const bool per_worker = arg.starts_with("--log-binary=") || arg.starts_with("--metrics=")
+                                    || arg.starts_with("--record=");
+            args.push_back(per_worker ? arg + '.' + std::to_string(k) : arg);
+        }
+        args.push_back("--shard=" + std::to_string(k) + "/" + std::to_string(worker_count));
+        args.push_back("--worker-id=" + std::to_string(k));
+        args.push_back("--stats-socket=" + socket_path);
+        if(bind_range) {
+            args.push_back("--bind=" + bind_range->slice(k, worker_count).to_string());
+        }
+
+        pid_t pid = spawn_process(std::move(args));
+        if(pid < 0) {
+            UTL_LOG_ERR("Failed to start worker ", k, ": ", std::strerror(errno));
+            continue;
+        }
+
+        UTL_LOG_INFO("Started worker ", k, ", pid ", pid, bind_range ? ", bind " + bind_range->slice(k, worker_count).to_string() : "");
+        workers[k].pid = pid;
+    }
+
+    std::function<void()> do_accept = [&]() {
+        acceptor.async_accept([&](boost::system::error_code ec, local::socket socket) {
+            if(ec) return;
+            std::make_shared<worker_connection_t>(std::move(socket), workers)->run();
+            do_accept();
+        });
+    };
+    do_accept();
+
+    // Forward Ctrl+C / kill to the workers and wait for them to report and exit
+    net::signal_set signals(ioc, SIGINT, SIGTERM);
+    std::function<void()> do_wait_signal = [&]() {
+        signals.async_wait([&](boost::system::error_code ec, int signal) {
+            if(ec) return;
+            UTL_LOG_INFO("Signal ", signal, ", stopping workers");
+            for(auto& [id, worker] : workers) {
+                if(!worker.exited) ::kill(worker.pid, signal);
+            }
+            do_wait_signal();
+        });
+    };
+    do_wait_signal();
+
+    net::steady_timer timer(ioc);
+    auto              next_report = std::chrono::steady_clock::now() + std::chrono::seconds(stats_interval);
+
+    std::function<void()> do_tick = [&]() {
+        timer.expires_after(std::chrono::milliseconds(200));
+        timer.async_wait([&](boost::system::error_code ec) {
+            if(ec) return;
+
+            for(auto& [id, worker] : workers) {
+                int status = 0;
+                if(!worker.exited && ::waitpid(worker.pid, &status, WNOHANG) == worker.pid) {
+                    worker.exited    = true;
+                    worker.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                    UTL_LOG_INFO("Worker ", id, " exited with code ", worker.exit_code);
+                }
+            }
+
+            bool all_exited = std::all_of(workers.begin(), workers.end(), [](auto& w) { return w.second.exited; });
+            if(all_exited) {
+                // no more ticks, run() returns once the worker connections have read their last
+                // stats messages up to the end of the stream
+                boost::system::error_code ignored;
+                acceptor.close(ignored);
+                signals.cancel(ignored);
+                return;
+            }
+
+            if(stats_interval > 0 && std::chrono::steady_clock::now() >= next_report) {
+                log_merged_stats(workers, "Merged stats");
+                next_report = std::chrono::steady_clock::now() + std::chrono::seconds(stats_interval);
+            }
+
+            do_tick();
+        });
+    };
+    do_tick();
+
+    ioc.run();
+
+    log_merged_stats(workers, "Final merged stats");
+    std::filesystem::remove(socket_path);
+
+    bool failed = std::any_of(workers.begin(), workers.end(), [](auto& w) { return w.second.exit_code != 0; });
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+// ==================
+// --- Loopback ---
+// ==================
+
+namespace {
+
+// A limit of the loopback run, unset ones aren't checked
+struct loopback_threshold_t {
+    std::string_view      option;
+    bool                  lower; // the value must be at least the limit, otherwise at most
+    std::optional<double> limit;
+};
+
+std::chrono::microseconds::rep cpu_us(const struct rusage& usage) {
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// Counts the syscalls of a process and every thread it starts, through the raw_syscalls:sys_enter
+// tracepoint. -1 without tracefs, or without perf_event_paranoid -1 or CAP_PERFMON.
+int open_syscall_counter(pid_t pid) {
+#if defined(__linux__)
+    uint64_t id = 0;
+    for(auto tracefs : { "/sys/kernel/tracing", "/sys/kernel/debug/tracing" }) {
+        std::ifstream in(std::string(tracefs) + "/events/raw_syscalls/sys_enter/id");
+        if(in >> id) break;
+    }
+    if(id == 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    struct perf_event_attr attr{};
+    attr.type    = PERF_TYPE_TRACEPOINT;
+    attr.size    = sizeof(attr);
+    attr.config  = id;
+    attr.inherit = 1;
+    return static_cast<int>(::syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+#else
+    boost::ignore_unused(pid);
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Count of a counter whose process is gone, its threads' counts are added in as they exit
+std::optional<uint64_t> read_syscall_counter(int fd) {
+    uint64_t count = 0;
+    if(fd < 0 || ::read(fd, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count))) return std::nullopt;
+    return count;
+}
+
+// What `<client> io-backend` prints, "unknown" for a client without it
+std::string client_io_backend(const std::string& client) {
+    std::string res;
+    if(FILE* out = ::popen(("'" + client + "' io-backend 2>/dev/null").c_str(), "r")) {
+        char line[64] = {};
+        if(std::fgets(line, sizeof(line), out)) {
+            res = line;
+        }
+        ::pclose(out);
+    }
+    while(!res.empty() && std::isspace(static_cast<unsigned char>(res.back()))) {
+        res.pop_back();
+    }
+    // an older client prints its usage instead
+    return res.empty() || res.find(' ') != std::string::npos ? "unknown" : res;
+}
+
+bool wait_for_port(unsigned short port, std::chrono::milliseconds timeout) {
+    net::io_context ioc;
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while(std::chrono::steady_clock::now() < deadline) {
+        net::ip::tcp::socket socket(ioc);
+        boost::system::error_code ec;
+        socket.connect({ net::ip::address_v4::loopback(), port }, ec);
+        if(!ec) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+}
+
+}
+
+int run_loopback(int argc, char** argv) {
+    if(argc < 4) {
+        std::cout << "Usage: ws-test-client loopback <devices> <seconds> [options]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const uint64_t  devices = std::stoull(argv[2]);
+    const long long seconds = std::stoll(argv[3]);
+    if(devices < 1 || seconds < 1) {
+        std::cout << "Devices and seconds must be at least 1" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto executable = self_executable(argv[0]);
+
+    std::string server         = (std::filesystem::path(executable).parent_path() / "ws-test-server").string();
+    std::string client         = executable;
+    unsigned short port        = 18080;
+    long long interval         = 1;
+    long long threads          = 4;
+    long long server_threads   = 2;
+    long long command_interval = 0;
+
+    std::vector<loopback_threshold_t> thresholds = {
+        { "min-conn-rate", true, std::nullopt },
+        { "min-frame-rate", true, std::nullopt },
+        { "max-cpu-per-1k", false, std::nullopt },
+        { "max-rss-per-device", false, std::nullopt },
+        { "max-connect-p99", false, std::nullopt },
+        { "max-reply-p99", false, std::nullopt },
+        { "max-errors", false, 0 },
+        { "max-syscalls-per-frame", false, std::nullopt },
+    };
+
+    if(auto opt = get_option(argc, argv, 4, "server")) {
+        server = std::string(*opt);
+    }
+    if(auto opt = get_option(argc, argv, 4, "client")) {
+        client = std::string(*opt);
+    }
+    if(auto opt = get_option(argc, argv, 4, "port")) {
+        port = static_cast<unsigned short>(std::stoi(std::string(*opt)));
+    }
+    if(auto opt = get_option(argc, argv, 4, "interval")) {
+        interval = std::stoll(std::string(*opt));
+    }
+    if(auto opt = get_option(argc, argv, 4, "threads")) {
+        threads = std::stoll(std::string(*opt));
+    }
+    if(auto opt = get_option(argc, argv, 4, "server-threads")) {
+        server_threads = std::stoll(std::string(*opt));
+    }
+    if(auto opt = get_option(argc, argv, 4, "command-interval")) {
+        command_interval = std::stoll(std::string(*opt));
+    }
+    for(auto& threshold : thresholds) {
+        if(auto opt = get_option(argc, argv, 4, threshold.option)) {
+            threshold.limit = std::stod(std::string(*opt));
+        }
+    }
+
+    auto work_dir = std::filesystem::temp_directory_path() / ("ws-test-loopback-" + std::to_string(::getpid()));
+    std::filesystem::create_directories(work_dir);
+    const auto ids_file    = (work_dir / "ids.txt").string();
+    const auto socket_path = (work_dir / "stats.sock").string();
+
+    // the same ids every run, so two runs differ only by the build
+    if(!generate_device_ids(ids_file, devices, 1, std::thread::hardware_concurrency())) {
+        return EXIT_FAILURE;
+    }
+
+    // serves until killed, the duration is a safety net should this process die first
+    pid_t server_pid = spawn_process({ server, "127.0.0.1", std::to_string(port), work_dir.string(), std::to_string(server_threads),
+                                       "--main-interval=" + std::to_string(command_interval), "--stats-interval=0", "--duration=" + std::to_string(seconds + 60) });
+    if(server_pid < 0 || !wait_for_port(port, std::chrono::seconds(5))) {
+        UTL_LOG_ERR("Server didn't start: ", server);
+        if(server_pid > 0) ::kill(server_pid, SIGKILL);
+        std::filesystem::remove_all(work_dir);
+        return EXIT_FAILURE;
+    }
+
+    net::io_context ioc;
+    local::acceptor acceptor(ioc, local::endpoint(socket_path));
+    std::map<int, worker_t> workers;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    const auto backend = client_io_backend(client);
+
+    // attached before the client execs, so its threads inherit the counter
+    int syscall_counter = -1;
+    workers[0].pid = spawn_process({ client, "127.0.0.1", "/socket-units-server/", std::to_string(port), std::to_string(interval), "1",
+                                     std::to_string(threads), "no-bad", "no-events", ids_file, "--duration=" + std::to_string(seconds),
+                                     "--stats-interval=0", "--worker-id=0", "--stats-socket=" + socket_path },
+                                   [&](pid_t pid) {
+                                       syscall_counter = open_syscall_counter(pid);
+                                       if(syscall_counter < 0) {
+                                           UTL_LOG_WARN("Client syscalls aren't counted, the raw_syscalls tracepoint needs tracefs and "
+                                                        "CAP_PERFMON or kernel.perf_event_paranoid=-1: ", std::strerror(errno));
+                                       }
+                                   });
+    UTL_LOG_INFO("Loopback: ", devices, " devices for ", seconds, " s, server pid ", server_pid, ", client pid ", workers[0].pid,
+                 ", client I/O backend: ", backend);
+
+    acceptor.async_accept([&](boost::system::error_code ec, local::socket socket) {
+        if(!ec) std::make_shared<worker_connection_t>(std::move(socket), workers)->run();
+    });
+
+    struct rusage client_usage{};
+    auto elapsed = std::chrono::steady_clock::duration::zero();
+
+    net::steady_timer timer(ioc);
+    std::function<void()> do_tick = [&]() {
+        timer.expires_after(std::chrono::milliseconds(100));
+        timer.async_wait([&](boost::system::error_code ec) {
+            if(ec) return;
+
+            auto& worker = workers[0];
+            int status = 0;
+            if(worker.pid > 0 && ::wait4(worker.pid, &status, WNOHANG, &client_usage) == worker.pid) {
+                elapsed          = std::chrono::steady_clock::now() - start;
+                worker.exited    = true;
+                worker.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                // run() returns once the last stats message of the client is read
+                boost::system::error_code ignored;
+                acceptor.close(ignored);
+                return;
+            }
+            do_tick();
+        });
+    };
+    do_tick();
+
+    ioc.run();
+
+    struct rusage server_usage{};
+    int server_status = 0;
+    ::kill(server_pid, SIGTERM);
+    ::wait4(server_pid, &server_status, 0, &server_usage);
+    std::filesystem::remove_all(work_dir);
+
+    auto& worker = workers[0];
+    target_stats_snapshot_t total;
+    for(auto& [name, snapshot] : worker.stats) {
+        total.merge(snapshot);
+    }
+
+    // rates over the client's duration, the drain at the end is left out
+    const double frames       = static_cast<double>(total.frames_sent);
+    const double conn_rate    = total.connect_attempts / static_cast<double>(seconds);
+    const double frame_rate   = frames / seconds;
+    const double cpu_per_1k   = frames > 0 ? cpu_us(client_usage) / 1000.0 / (frames / 1000) : 0;
+    const double server_per_1k = frames > 0 ? cpu_us(server_usage) / 1000.0 / (frames / 1000) : 0;
+    // ru_maxrss is in KB on Linux
+    const double rss_per_device = static_cast<double>(client_usage.ru_maxrss) / devices;
+    const double errors = static_cast<double>(total.connect_errors + total.handshake_errors + total.write_errors);
+    const auto   client_syscalls    = read_syscall_counter(syscall_counter);
+    const double syscalls_per_frame = client_syscalls && frames > 0 ? *client_syscalls / frames : 0;
+    const double switches_per_frame = frames > 0 ? (client_usage.ru_nvcsw + client_usage.ru_nivcsw) / frames : 0;
+    auto p = [&](double percentile) { return total.connect_latency.percentile(percentile).count() / 1000.0; };
+    auto reply_p = [&](double percentile) { return total.reply_latency.percentile(percentile).count() / 1000.0; };
+
+    UTL_LOG_INFO("Loopback done in ", std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), " ms, client exit code ",
+                 worker.exit_code);
+    UTL_LOG_INFO("Total ", format_target_stats(total));
+    UTL_LOG_INFO("conn/s: ", conn_rate, ", frames/s: ", frame_rate, ", bytes/s: ", total.bytes_sent / static_cast<double>(seconds));
+    UTL_LOG_INFO("CPU per 1k frames, client: ", cpu_per_1k, " ms, server: ", server_per_1k, " ms; client max RSS per device: ",
+                 rss_per_device, " KB");
+    UTL_LOG_INFO("Client I/O backend: ", backend, ", syscalls per frame: ",
+                 client_syscalls ? std::to_string(syscalls_per_frame) : std::string("not counted"),
+                 ", context switches per frame: ", switches_per_frame);
+    UTL_LOG_INFO("Connect latency p50/p90/p99: ", p(50), "/", p(90), "/", p(99), " ms");
+    UTL_LOG_INFO("Command reply latency p50/p90/p99: ", reply_p(50), "/", reply_p(90), "/", reply_p(99), " ms, replies: ",
+                 total.reply_latency.count());
+
+    const std::map<std::string_view, double> measured = {
+        { "min-conn-rate", conn_rate },
+        { "min-frame-rate", frame_rate },
+        { "max-cpu-per-1k", cpu_per_1k },
+        { "max-rss-per-device", rss_per_device },
+        { "max-connect-p99", p(99) },
+        { "max-reply-p99", reply_p(99) },
+        { "max-errors", errors },
+        { "max-syscalls-per-frame", syscalls_per_frame },
+    };
+
+    bool failed = worker.exit_code != 0 || worker.stats.empty();
+    if(worker.stats.empty()) {
+        UTL_LOG_ERR("No stats received from the client");
+    }
+    if(syscall_counter >= 0) {
+        ::close(syscall_counter);
+    }
+
+    for(auto& threshold : thresholds) {
+        if(!threshold.limit) continue;
+        if(threshold.option == "max-syscalls-per-frame" && !client_syscalls) {
+            UTL_LOG_ERR("Threshold not checked: --", threshold.option, ", the client's syscalls weren't counted");
+            failed = true;
+            continue;
+        }
+        const double value = measured.at(threshold.option);
+        if(threshold.lower ? value < *threshold.limit : value > *threshold.limit) {
+            UTL_LOG_ERR("Threshold missed: --", threshold.option, "=", *threshold.limit, ", measured ", value);
+            failed = true;
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#else
+
+int run_controller(int argc, char** argv) {
+    boost::ignore_unused(argc, argv);
+    UTL_LOG_ERR("Controller mode needs fork() and Unix domain sockets, not available on this platform");
+    return EXIT_FAILURE;
+}
+
+int run_loopback(int argc, char** argv) {
+    boost::ignore_unused(argc, argv);
+    UTL_LOG_ERR("Loopback mode needs fork() and Unix domain sockets, not available on this platform");
+    return EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "stats.hpp"
+#include "target_pool.hpp"
+
+// Controller/worker mode: the controller starts N copies of the client on the same host,
+// each with its own shard of the ids file and slice of the source address range.
+// Workers stream stats snapshots over a Unix socket, the controller merges them by target.
+
+using named_stats_t = std::vector<std::pair<std::string, target_stats_snapshot_t>>;
+
+// Stats message payload (without the 4 byte length prefix used on the socket)
+std::string encode_worker_stats(int worker_id, const named_stats_t& stats);
+bool decode_worker_stats(std::string_view payload, int& worker_id, named_stats_t& stats);
+
+named_stats_t snapshot_target_pool(const target_pool_t& target_pool);
+
+// Worker side, sends a snapshot of the target pool every interval and a last one on stop()
+class worker_stats_stream_t {
+public:
+    worker_stats_stream_t(std::string socket_path, int worker_id, const target_pool_t& target_pool);
+    ~worker_stats_stream_t();
+
+    void start(std::chrono::milliseconds interval);
+    void stop();
+
+private:
+    void loop(std::chrono::milliseconds interval);
+
+    std::string          socket_path_;
+    int                  worker_id_;
+    const target_pool_t& target_pool_;
+
+    std::mutex              stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool                    stopping_ = false;
+    std::thread             thread_;
+};
+
+// "ws-test-client controller <workers> <client arguments...>", returns the process exit code
+int run_controller(int argc, char** argv);
+
+// "ws-test-client loopback <devices> <seconds> [options]": runs ws-test-server and one client worker
+// against it on 127.0.0.1, reports rates, CPU, memory and latency, and fails on a missed threshold
+int run_loopback(int argc, char** argv);
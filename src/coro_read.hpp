@@ -26,7 +26,7 @@ void read_handler(boost::beast::error_code ec
     
         // ws_state.ws.async_read(ws_state.buffer, beast::bind_front_handler(read_h));
         LOCK_GUARD(*ws_state.ws_state_mutex);
-        ws_state.extra_payload = ws_get_payload(
+        ws_state.extra_payload = ws_find_payload(
             boost::beast::buffers_to_string(ws_state.buffer.data())
             , send_bad_payloads
         );
@@ -1,4 +1,5 @@
 #include "device_payloads.hpp"
+#include "frame_parser.hpp"
 #include "utl_log.hpp"
 
 std::vector<payload_t> ws_get_probes_payload = {
@@ -36,9 +37,19 @@ payload_t ws_bad_payload = {
 
 };
 
+// the main payloads as the one frame groups ws_find_payload hands out
+const std::vector<payload_t> ws_main_group = { ws_payload };
+const std::vector<payload_t> ws_bad_group  = { ws_bad_payload };
+
 std::optional<std::vector<payload_t>>  ws_get_payload (std::string_view request, bool include_bad_payloads) {
+    if(auto group = ws_find_payload(request, include_bad_payloads)) {
+        return *group;
+    }
+    return std::nullopt;
+}
+
+const std::vector<payload_t>* ws_find_payload(std::string_view request, bool include_bad_payloads) {
 
-    static int current_probe = 1;
     static size_t which_main_payload = 1;
 
     std::string base_main_payload = "main_payload";
@@ -49,19 +60,57 @@ std::optional<std::vector<payload_t>>  ws_get_payload (std::string_view request,
         if((which_main_payload % 2 == 0) && include_bad_payloads) {
             which_main_payload++;
             UTL_LOG_DINFO("picking bad payload");
-            return std::vector<payload_t>{ws_bad_payload};
+            return &ws_bad_group;
         } else {
             which_main_payload++;
             UTL_LOG_DINFO("picking good payload");
-            return std::vector<payload_t>{ws_payload};
+            return &ws_main_group;
         }
     } else if (request.find(base_get_probes) != std::string::npos) {
         UTL_LOG_DINFO("picking good payload");
-        return ws_get_probes_payload;
+        return &ws_get_probes_payload;
     } else if (request.find(base_event) != std::string::npos) {
         UTL_LOG_DINFO("picking good payload");
-        return ws_event_payload;
+        return &ws_event_payload;
+    }
+
+    return nullptr;
+}
+
+std::vector<const std::vector<payload_t>*> ws_payload_groups() {
+    return { &ws_main_group, &ws_bad_group, &ws_get_probes_payload, &ws_event_payload };
+}
+
+bool ws_check_payloads() {
+    bool ok = true;
+    auto check = [&](std::string_view name, const payload_t& payload) {
+        auto res = validate_frame(payload.data(), payload.size());
+        if(!res) {
+            UTL_LOG_ERR("Payload ", name, " is not a valid frame: ", to_string(res.error), " at byte ", res.offset);
+            ok = false;
+        }
+    };
+
+    check("main_payload", ws_payload);
+    for(auto& payload : ws_get_probes_payload) {
+        check("get_probes", payload);
+    }
+    for(auto& payload : ws_event_payload) {
+        check("event", payload);
+    }
+
+    // the bad payload is several valid frames sent as one message
+    std::size_t frames = 0;
+    for(std::size_t offset = 0; offset < ws_bad_payload.size(); frames++) {
+        auto res = parse_frame(ws_bad_payload.data() + offset, ws_bad_payload.size() - offset);
+        if(!res) {
+            UTL_LOG_ERR("Bad payload has a broken frame: ", to_string(res.error), " at byte ", offset + res.offset);
+            ok = false;
+            break;
+        }
+        offset += res.frame.size();
     }
+    UTL_LOG_DINFO("Bad payload: ", frames, " frames in one message");
 
-    return std::nullopt;;
+    return ok;
 }
@@ -11,4 +11,13 @@
 // extern payload_t ws_payload;
 
 // return payload based on value of request
-std::optional<std::vector<payload_t>> ws_get_payload (std::string_view request, bool include_bad_payloads);
\ No newline at end of file
+std::optional<std::vector<payload_t>> ws_get_payload (std::string_view request, bool include_bad_payloads);
+
+// Same as ws_get_payload without the copy, the frames of a static table, nullptr for an unknown request
+const std::vector<payload_t>* ws_find_payload(std::string_view request, bool include_bad_payloads);
+
+// Every group ws_find_payload can return
+std::vector<const std::vector<payload_t>*> ws_payload_groups();
+
+// Checks the payloads against the frame format, each good one must be exactly one valid frame
+bool ws_check_payloads();
\ No newline at end of file
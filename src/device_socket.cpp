@@ -0,0 +1,82 @@
+#include "device_socket.hpp"
+
+#include <algorithm>
+
+namespace net = boost::asio;
+
+void device_socket_t::reset_frames() {
+    fail_frames();
+    framed_       = false;
+    header_size_  = 0;
+    payload_left_ = 0;
+    in_message_   = false;
+}
+
+void device_socket_t::async_write_frame(net::const_buffer frame, write_handler_t handler) {
+    pending_ = pending_frame_t{ frame, std::move(handler) };
+    if(!beast_writing_ && !beast_waiting_ && at_boundary()) {
+        start_pending();
+    }
+}
+
+void device_socket_t::fail_frames() {
+    if(!pending_) return;
+
+    auto handler = std::move(pending_->handler);
+    pending_.reset();
+    net::post(get_executor(), [handler = std::move(handler)]() { handler(net::error::operation_aborted, 0); });
+}
+
+void device_socket_t::start_pending() {
+    if(!pending_) return;
+
+    auto frame = *std::exchange(pending_, std::nullopt);
+    raw_writing_ = true;
+    // the base socket, the bytes of a raw frame aren't beast's
+    net::async_write(static_cast<net::ip::tcp::socket&>(*this), frame.frame,
+        [this, handler = std::move(frame.handler)](boost::system::error_code ec, std::size_t written) {
+            raw_writing_ = false;
+            gate_.cancel();
+            handler(ec, written);
+        });
+}
+
+// Client frames: 2 bytes, a 16 or 64 bit length for 126 and 127, then the 4 byte mask key
+void device_socket_t::follow(const uint8_t* data, std::size_t size) {
+    while(size > 0) {
+        if(payload_left_ > 0) {
+            const auto take = static_cast<std::size_t>(std::min<uint64_t>(payload_left_, size));
+            payload_left_ -= take;
+            data += take;
+            size -= take;
+            continue;
+        }
+
+        header_[header_size_++] = *data++;
+        size--;
+        if(header_size_ < 2) continue;
+
+        const uint8_t length7 = header_[1] & 0x7f;
+        const std::size_t extended = length7 == 126 ? 2 : length7 == 127 ? 8 : 0;
+        const std::size_t needed = 2 + extended + ((header_[1] & 0x80) ? 4 : 0);
+        if(header_size_ < needed) continue;
+
+        uint64_t length = length7;
+        if(extended) {
+            length = 0;
+            for(std::size_t i = 0; i < extended; i++) {
+                length = (length << 8) | header_[2 + i];
+            }
+        }
+
+        // control frames may go between the frames of a message, they don't end it
+        const bool fin    = header_[0] & 0x80;
+        const uint8_t op  = header_[0] & 0x0f;
+        if(op < 0x8) {
+            in_message_ = !fin;
+        }
+
+        header_size_  = 0;
+        payload_left_ = length;
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core/buffers_prefix.hpp>
+#include <boost/beast/core/role.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+
+// Socket under the websocket::stream of a device that can also take complete frames built ahead of
+// time, see --premasked, without cutting into the frames beast writes itself - messages, and the
+// pongs and close replies its read sends on its own.
+//
+// beast's writes are followed frame by frame from the bytes they put on the socket. A raw frame is
+// only written at a message boundary with no beast write in progress, and a write beast starts while
+// a raw frame goes out waits for it. Everything runs on the one executor of the stream.
+class device_socket_t : public boost::asio::ip::tcp::socket {
+public:
+    using write_handler_t = std::function<void(boost::system::error_code, std::size_t)>;
+
+    explicit device_socket_t(boost::asio::io_context& ioc) : boost::asio::ip::tcp::socket(ioc), gate_(ioc) {}
+
+    device_socket_t(device_socket_t&&) = default;
+
+    // Before the handshake of a new connection: what is written until start_frames() isn't framed
+    void reset_frames();
+    // After the handshake, the bytes written from now on are websocket frames
+    void start_frames() { framed_ = true; }
+
+    // Writes a complete masked frame, once the frame beast is writing is out. One at a time.
+    void async_write_frame(boost::asio::const_buffer frame, write_handler_t handler);
+
+    // The connection is closed: a raw frame still waiting for its turn completes with operation_aborted
+    void fail_frames();
+
+    // Used by beast for every write, including the ones of its read and close
+    template <class ConstBufferSequence, class WriteHandler>
+    auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+        return boost::asio::async_initiate<WriteHandler, void(boost::system::error_code, std::size_t)>(
+            [this](auto handler, const ConstBufferSequence& buffers) { write_some_of_beast(buffers, std::move(handler)); },
+            handler, buffers);
+    }
+
+private:
+    // Executor, allocator and cancellation slot of a handler of beast, carried over to the operations
+    // that complete it through a handler of our own
+    template <class Handler>
+    struct associations_t {
+        boost::asio::associated_executor_t<Handler, executor_type> executor;
+        boost::asio::associated_allocator_t<Handler>               allocator;
+        boost::asio::associated_cancellation_slot_t<Handler>       slot;
+
+        associations_t(const Handler& handler, const executor_type& fallback)
+            : executor(boost::asio::get_associated_executor(handler, fallback)),
+              allocator(boost::asio::get_associated_allocator(handler)),
+              slot(boost::asio::get_associated_cancellation_slot(handler)) {}
+
+        template <class Function>
+        auto bind(Function&& function) const {
+            return boost::asio::bind_cancellation_slot(slot,
+                boost::asio::bind_allocator(allocator,
+                    boost::asio::bind_executor(executor, std::forward<Function>(function))));
+        }
+    };
+
+    template <class ConstBufferSequence, class Handler>
+    void write_some_of_beast(const ConstBufferSequence& buffers, Handler handler) {
+        // read before the handler is moved into ours
+        const associations_t<Handler> associations(handler, get_executor());
+
+        if(raw_writing_) {
+            // woken by the end of the raw frame
+            beast_waiting_ = true;
+            gate_.expires_at(boost::asio::steady_timer::time_point::max());
+            gate_.async_wait(associations.bind([this, buffers, handler = std::move(handler)](boost::system::error_code ec) mutable {
+                beast_waiting_ = false;
+                if(ec == boost::asio::error::operation_aborted && raw_writing_) {
+                    // cancelled through the slot of beast's handler, not by the end of the raw frame
+                    handler(ec, 0);
+                    return;
+                }
+                write_some_of_beast(buffers, std::move(handler));
+            }));
+            return;
+        }
+
+        beast_writing_ = true;
+        boost::asio::ip::tcp::socket::async_write_some(buffers, associations.bind(
+            [this, buffers, handler = std::move(handler)](boost::system::error_code ec, std::size_t written) mutable {
+                beast_writing_ = false;
+                if(framed_) {
+                    for(auto buffer : boost::beast::buffers_prefix(written, buffers)) {
+                        follow(static_cast<const uint8_t*>(buffer.data()), buffer.size());
+                    }
+                }
+                if(ec) {
+                    fail_frames();
+                } else if(at_boundary()) {
+                    start_pending();
+                }
+                handler(ec, written);
+            }));
+    }
+
+    // Advances the frame beast is writing by the bytes it wrote
+    void follow(const uint8_t* data, std::size_t size);
+    bool at_boundary() const { return header_size_ == 0 && payload_left_ == 0 && !in_message_; }
+    void start_pending();
+
+    boost::asio::steady_timer gate_;
+    bool beast_writing_ = false;
+    // a raw frame that comes next lets it go first
+    bool beast_waiting_ = false;
+    bool raw_writing_   = false;
+    bool framed_        = false;
+
+    // frame beast is writing: the header read so far, then the payload bytes still to come
+    std::array<uint8_t, 14> header_{};
+    std::size_t             header_size_  = 0;
+    uint64_t                payload_left_ = 0;
+    // a data frame without FIN went out, the frames up to the final one belong to its message
+    bool                    in_message_   = false;
+
+    struct pending_frame_t {
+        boost::asio::const_buffer frame;
+        write_handler_t           handler;
+    };
+    std::optional<pending_frame_t> pending_;
+};
+
+// Found by beast through ADL, the close handshake ends on the tcp socket underneath
+inline void teardown(boost::beast::role_type role, device_socket_t& socket, boost::system::error_code& ec) {
+    boost::beast::websocket::teardown(role, static_cast<boost::asio::ip::tcp::socket&>(socket), ec);
+}
+
+template <class TeardownHandler>
+void async_teardown(boost::beast::role_type role, device_socket_t& socket, TeardownHandler&& handler) {
+    boost::beast::websocket::async_teardown(role, static_cast<boost::asio::ip::tcp::socket&>(socket),
+                                            std::forward<TeardownHandler>(handler));
+}
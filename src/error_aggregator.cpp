@@ -0,0 +1,82 @@
+#include "error_aggregator.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "utl_log.hpp"
+
+error_aggregator_t::~error_aggregator_t() {
+    stop();
+}
+
+void error_aggregator_t::start(std::chrono::seconds interval) {
+    if(interval.count() <= 0) {
+        return;
+    }
+
+    immediate_ = false;
+    background_thread_ = std::thread([this, interval]() { background_loop(interval); });
+}
+
+void error_aggregator_t::stop() {
+    {
+        std::lock_guard lock(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+
+    if(background_thread_.joinable()) {
+        background_thread_.join();
+        report();
+    }
+}
+
+void error_aggregator_t::add(std::string_view message, std::string_view device_id) {
+    if(immediate_) {
+        UTL_LOG_ERR(message, " ID: ", device_id);
+        return;
+    }
+
+    std::lock_guard lock(entries_mutex_);
+
+    auto it = entries_.find(std::string(message));
+    if(it == entries_.end()) {
+        it = entries_.emplace(std::string(message), entry_t{}).first;
+    }
+
+    auto& entry = it->second;
+    entry.count++;
+    if(entry.last_device != device_id) {
+        entry.last_device = device_id;
+        entry.devices.emplace(device_id);
+    }
+}
+
+void error_aggregator_t::report() {
+    std::unordered_map<std::string, entry_t> entries;
+    {
+        std::lock_guard lock(entries_mutex_);
+        entries.swap(entries_);
+    }
+
+    // most frequent first
+    std::vector<std::pair<const std::string*, const entry_t*>> sorted;
+    for(auto& [message, entry] : entries) {
+        sorted.emplace_back(&message, &entry);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](auto& l, auto& r) { return l.second->count > r.second->count; });
+
+    for(auto& [message, entry] : sorted) {
+        UTL_LOG_ERR(entry->count, "x ", *message, " across ", entry->devices.size(), " devices (last ID: ", entry->last_device, ")");
+    }
+}
+
+void error_aggregator_t::background_loop(std::chrono::seconds interval) {
+    std::unique_lock lock(stop_mutex_);
+
+    while(!stop_cv_.wait_for(lock, interval, [this]() { return stopping_; })) {
+        lock.unlock();
+        report();
+        lock.lock();
+    }
+}
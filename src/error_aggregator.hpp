@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+// Collapses repeated per-device errors into periodic "N x <message> across M devices" summaries,
+// so an outage of the server shows up as a few lines instead of one per device per retry.
+class error_aggregator_t {
+public:
+    ~error_aggregator_t();
+
+    // interval 0 - log every error right away, like a plain UTL_LOG_ERR
+    void start(std::chrono::seconds interval);
+    void stop();
+
+    // message should not contain the device id, it is the key errors are grouped by
+    void add(std::string_view message, std::string_view device_id);
+
+    // logs and resets the summaries collected since the last report
+    void report();
+
+private:
+    struct entry_t {
+        uint64_t                        count = 0;
+        std::unordered_set<std::string> devices;
+        std::string                     last_device;
+    };
+
+    void background_loop(std::chrono::seconds interval);
+
+    bool immediate_ = true;
+
+    std::mutex                               entries_mutex_;
+    std::unordered_map<std::string, entry_t> entries_;
+
+    std::mutex              stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool                    stopping_ = false;
+    std::thread             background_thread_;
+};
@@ -0,0 +1,161 @@
+#include "file_cache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <utility>
+
+#include <boost/beast/version.hpp>
+
+std::string_view mime_type(std::string_view path) {
+    static constexpr std::array<std::pair<std::string_view, std::string_view>, 22> types{ {
+        { ".htm", "text/html" },
+        { ".html", "text/html" },
+        { ".php", "text/html" },
+        { ".css", "text/css" },
+        { ".txt", "text/plain" },
+        { ".js", "application/javascript" },
+        { ".json", "application/json" },
+        { ".xml", "application/xml" },
+        { ".swf", "application/x-shockwave-flash" },
+        { ".flv", "video/x-flv" },
+        { ".png", "image/png" },
+        { ".jpe", "image/jpeg" },
+        { ".jpeg", "image/jpeg" },
+        { ".jpg", "image/jpeg" },
+        { ".gif", "image/gif" },
+        { ".bmp", "image/bmp" },
+        { ".ico", "image/vnd.microsoft.icon" },
+        { ".tiff", "image/tiff" },
+        { ".tif", "image/tiff" },
+        { ".svg", "image/svg+xml" },
+        { ".svgz", "image/svg+xml" },
+        { ".wasm", "application/wasm" },
+    } };
+
+    auto const pos = path.rfind('.');
+    if(pos == std::string_view::npos)
+        return "application/text";
+
+    auto const ext = path.substr(pos);
+    auto iequals   = [](std::string_view l, std::string_view r) {
+        return l.size() == r.size() && std::equal(l.begin(), l.end(), r.begin(), [](char a, char b) {
+                   return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+               });
+    };
+
+    for(auto& [extension, type] : types) {
+        if(iequals(ext, extension)) return type;
+    }
+    return "application/text";
+}
+
+bool cached_file_t::matches(std::string_view if_none_match) const {
+    if(if_none_match.empty()) return false;
+    if(if_none_match == "*") return true;
+
+    // a list of tags, weak comparison
+    while(!if_none_match.empty()) {
+        auto comma = if_none_match.find(',');
+        auto tag   = if_none_match.substr(0, comma);
+        if_none_match = (comma == std::string_view::npos) ? std::string_view{} : if_none_match.substr(comma + 1);
+
+        while(!tag.empty() && tag.front() == ' ') tag.remove_prefix(1);
+        while(!tag.empty() && tag.back() == ' ') tag.remove_suffix(1);
+        if(tag.starts_with("W/")) tag.remove_prefix(2);
+
+        if(tag == std::string_view(etag).substr(2)) return true;
+    }
+    return false;
+}
+
+file_cache_t::file_cache_t(std::size_t in_memory_limit, std::chrono::milliseconds check_interval)
+    : in_memory_limit_(in_memory_limit), check_interval_(check_interval) {}
+
+cached_file_ptr_t file_cache_t::get(const std::string& path) {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+
+    cached_file_ptr_t file;
+    {
+        std::shared_lock lock(mutex_);
+        if(auto it = files_.find(path); it != files_.end()) {
+            file = it->second;
+        }
+    }
+
+    if(file) {
+        auto checked = file->checked.load(std::memory_order_relaxed);
+        if(now - checked < std::chrono::steady_clock::duration(check_interval_).count()) {
+            return file;
+        }
+        // one thread per interval goes to the file system, the others keep serving the entry
+        if(!file->checked.compare_exchange_strong(checked, now, std::memory_order_relaxed)) {
+            return file;
+        }
+
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(path, ec);
+        if(!ec && mtime == file->mtime && std::filesystem::file_size(path, ec) == file->size && !ec) {
+            return file;
+        }
+    }
+
+    auto loaded = load(path);
+
+    std::lock_guard lock(mutex_);
+    if(loaded) {
+        files_[path] = loaded;
+    } else {
+        files_.erase(path);
+    }
+    return loaded;
+}
+
+cached_file_ptr_t file_cache_t::load(const std::string& path) const {
+    std::error_code ec;
+    if(!std::filesystem::is_regular_file(path, ec)) return nullptr;
+
+    auto file   = std::make_shared<cached_file_t>();
+    file->path  = path;
+    file->mtime = std::filesystem::last_write_time(path, ec);
+    if(ec) return nullptr;
+    file->size = std::filesystem::file_size(path, ec);
+    if(ec) return nullptr;
+
+    std::string body;
+    file->in_memory = file->size <= in_memory_limit_;
+    if(file->in_memory) {
+        std::ifstream in(path, std::ios::binary);
+        body.resize(file->size);
+        if(!in.read(body.data(), static_cast<std::streamsize>(body.size()))) return nullptr;
+    }
+
+    // weak tag, the same size and modification time are taken as the same content
+    char etag[64];
+    std::snprintf(etag, sizeof(etag), "W/\"%llx-%llx\"", static_cast<unsigned long long>(file->size),
+                  static_cast<unsigned long long>(file->mtime.time_since_epoch().count()));
+    file->etag = etag;
+
+    for(int keep_alive = 0; keep_alive < 2; keep_alive++) {
+        std::string common;
+        common += "Server: " BOOST_BEAST_VERSION_STRING "\r\n";
+        common += "ETag: " + file->etag + "\r\n";
+        common += "Cache-Control: no-cache\r\n";
+        if(!keep_alive) common += "Connection: close\r\n";
+
+        auto& ok = file->ok[keep_alive];
+        ok = "HTTP/1.1 200 OK\r\n" + common;
+        ok += "Content-Type: " + std::string(mime_type(path)) + "\r\n";
+        ok += "Content-Length: " + std::to_string(file->size) + "\r\n\r\n";
+        file->header_size[keep_alive] = ok.size();
+        ok += body;
+
+        file->not_modified[keep_alive] = "HTTP/1.1 304 Not Modified\r\n" + common + "\r\n";
+    }
+
+    file->checked.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    return file;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Return a reasonable mime type based on the extension of a file.
+std::string_view mime_type(std::string_view path);
+
+// Static file served by the server stand-in with its responses serialized in advance.
+// Entries are immutable, a changed file gets a new entry.
+struct cached_file_t {
+    std::string path;
+    std::string etag;
+    uint64_t    size = 0;
+
+    std::filesystem::file_time_type mtime;
+
+    // index 0 - "Connection: close", 1 - keep-alive
+    // full 200 response; for a large file only the header, the body goes out with sendfile
+    std::string ok[2];
+    std::string not_modified[2];
+
+    // header part of ok, what a HEAD request gets
+    std::size_t header_size[2] = { 0, 0 };
+
+    // the body is in ok, no file access needed to serve it
+    bool in_memory = false;
+
+    // steady_clock ticks of the last stat of the file
+    mutable std::atomic<int64_t> checked{0};
+
+    // If-None-Match value matches this version of the file
+    bool matches(std::string_view if_none_match) const;
+};
+
+using cached_file_ptr_t = std::shared_ptr<const cached_file_t>;
+
+class file_cache_t {
+public:
+    // Files up to in_memory_limit bytes are kept in memory, files are checked for changes
+    // at most once per check_interval
+    explicit file_cache_t(std::size_t in_memory_limit = 64 * 1024,
+                          std::chrono::milliseconds check_interval = std::chrono::seconds(1));
+
+    // nullptr if the file can't be read, the caller then reports the error as before
+    cached_file_ptr_t get(const std::string& path);
+
+private:
+    cached_file_ptr_t load(const std::string& path) const;
+
+    std::size_t               in_memory_limit_;
+    std::chrono::milliseconds check_interval_;
+
+    std::shared_mutex                                  mutex_;
+    std::unordered_map<std::string, cached_file_ptr_t> files_;
+};
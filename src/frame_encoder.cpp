@@ -0,0 +1,188 @@
+#include "frame_encoder.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#define WS_MASK_X86 1
+#endif
+
+namespace {
+
+uint32_t key_word(mask_key_t key) {
+    // the key bytes in memory order, whatever the byte order of the CPU
+    uint32_t word;
+    std::memcpy(&word, key.data(), sizeof(word));
+    return word;
+}
+
+#if defined(WS_MASK_X86)
+
+#if defined(__GNUC__)
+#define WS_TARGET_AVX2 __attribute__((target("avx2")))
+#define WS_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define WS_TARGET_AVX2
+#define WS_TARGET_SSE2
+#endif
+
+WS_TARGET_AVX2 std::size_t mask_avx2(uint8_t* data, std::size_t size, uint32_t word) {
+    const __m256i k = _mm256_set1_epi32(static_cast<int>(word));
+    std::size_t i = 0;
+    for(; i + 64 <= size; i += 64) {
+        auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_xor_si256(a, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i + 32), _mm256_xor_si256(b, k));
+    }
+    for(; i + 32 <= size; i += 32) {
+        auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_xor_si256(a, k));
+    }
+    return i;
+}
+
+WS_TARGET_SSE2 std::size_t mask_sse2(uint8_t* data, std::size_t size, uint32_t word) {
+    const __m128i k = _mm_set1_epi32(static_cast<int>(word));
+    std::size_t i = 0;
+    for(; i + 16 <= size; i += 16) {
+        auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(a, k));
+    }
+    return i;
+}
+
+#endif
+
+// 8 bytes at a time, then byte by byte; the vector kernels leave their tail here, always a multiple of 4 in
+std::size_t mask_words(uint8_t* data, std::size_t size, uint32_t word) {
+    const uint64_t k = (uint64_t{ word } << 32) | word;
+    std::size_t i = 0;
+    for(; i + 8 <= size; i += 8) {
+        uint64_t v;
+        std::memcpy(&v, data + i, sizeof(v));
+        v ^= k;
+        std::memcpy(data + i, &v, sizeof(v));
+    }
+    return i;
+}
+
+void mask_tail(uint8_t* data, std::size_t from, std::size_t size, mask_key_t key) {
+    for(std::size_t i = from; i < size; i++) {
+        data[i] ^= key[i & 3];
+    }
+}
+
+enum class kernel_t { scalar, sse2, avx2 };
+
+kernel_t pick_kernel() {
+#if defined(WS_MASK_X86) && defined(__GNUC__)
+    if(__builtin_cpu_supports("avx2")) return kernel_t::avx2;
+    if(__builtin_cpu_supports("sse2")) return kernel_t::sse2;
+#elif defined(WS_MASK_X86) && defined(__AVX2__)
+    return kernel_t::avx2;
+#elif defined(WS_MASK_X86)
+    return kernel_t::sse2;
+#endif
+    return kernel_t::scalar;
+}
+
+const kernel_t kernel = pick_kernel();
+
+}
+
+void mask_payload_scalar(uint8_t* data, std::size_t size, mask_key_t key) {
+    mask_tail(data, mask_words(data, size, key_word(key)), size, key);
+}
+
+void mask_payload(uint8_t* data, std::size_t size, mask_key_t key) {
+    const uint32_t word = key_word(key);
+    std::size_t done = 0;
+#if defined(WS_MASK_X86)
+    if(kernel == kernel_t::avx2) {
+        done = mask_avx2(data, size, word);
+    } else if(kernel == kernel_t::sse2) {
+        done = mask_sse2(data, size, word);
+    }
+#endif
+    done += mask_words(data + done, size - done, word);
+    mask_tail(data, done, size, key);
+}
+
+std::string_view mask_kernel_name() {
+    switch(kernel) {
+        case kernel_t::avx2: return "avx2";
+        case kernel_t::sse2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+payload_t encode_client_frame(const payload_t& payload, mask_key_t key) {
+    const std::size_t size = payload.size();
+
+    payload_t frame;
+    frame.reserve(14 + size);
+    frame.push_back(0x82); // FIN, binary
+
+    if(size < 126) {
+        frame.push_back(static_cast<uint8_t>(0x80 | size));
+    } else if(size <= 0xffff) {
+        frame.push_back(0x80 | 126);
+        frame.push_back(static_cast<uint8_t>(size >> 8));
+        frame.push_back(static_cast<uint8_t>(size));
+    } else {
+        frame.push_back(0x80 | 127);
+        for(int shift = 56; shift >= 0; shift -= 8) {
+            frame.push_back(static_cast<uint8_t>(static_cast<uint64_t>(size) >> shift));
+        }
+    }
+
+    frame.insert(frame.end(), key.begin(), key.end());
+    const std::size_t header = frame.size();
+    frame.insert(frame.end(), payload.begin(), payload.end());
+    mask_payload(frame.data() + header, size, key);
+    return frame;
+}
+
+premasked_payload_t::premasked_payload_t(const payload_t& payload, std::size_t keys) : payload_(&payload) {
+    std::random_device rd;
+    std::mt19937 rng(rd());
+
+    keys = std::max<std::size_t>(keys, 1);
+    frames_.reserve(keys);
+    for(std::size_t i = 0; i < keys; i++) {
+        const uint32_t r = rng();
+        frames_.push_back(encode_client_frame(payload, { uint8_t(r), uint8_t(r >> 8), uint8_t(r >> 16), uint8_t(r >> 24) }));
+    }
+}
+
+std::size_t premasked_payload_t::bytes() const {
+    std::size_t res = 0;
+    for(auto& frame : frames_) {
+        res += frame.size();
+    }
+    return res;
+}
+
+premasked_table_t::premasked_table_t(const std::vector<const std::vector<payload_t>*>& groups, std::size_t keys) {
+    for(auto group : groups) {
+        for(auto& payload : *group) {
+            payloads_.emplace(&payload, std::make_unique<premasked_payload_t>(payload, keys));
+        }
+    }
+}
+
+const premasked_payload_t* premasked_table_t::find(const payload_t* payload) const {
+    auto it = payloads_.find(payload);
+    return it != payloads_.end() ? it->second.get() : nullptr;
+}
+
+std::size_t premasked_table_t::bytes() const {
+    std::size_t res = 0;
+    for(auto& [payload, frames] : payloads_) {
+        res += frames->bytes();
+    }
+    return res;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using payload_t = std::vector<uint8_t>;
+
+// Client side WebSocket frames built ahead of time (RFC 6455 5.2). Every frame a client sends is
+// masked with a 4 byte key; beast copies and masks the payload on every write. The device payloads
+// never change, so the complete frames - header, key and masked payload - can be built once and
+// written to the socket as they are.
+
+using mask_key_t = std::array<uint8_t, 4>;
+
+// XORs data with the key repeated, AVX2 or SSE2 when the CPU has them, checked once at startup
+void mask_payload(uint8_t* data, std::size_t size, mask_key_t key);
+
+// Plain loop, the reference the vector kernels are checked against
+void mask_payload_scalar(uint8_t* data, std::size_t size, mask_key_t key);
+
+// "avx2", "sse2" or "scalar"
+std::string_view mask_kernel_name();
+
+// A final binary frame with the masked payload
+payload_t encode_client_frame(const payload_t& payload, mask_key_t key);
+
+// Frames of one payload, each masked with its own random key, handed out round-robin. A key is
+// reused every `keys` frames, fine for load generation against our own servers, though not the
+// fresh key per frame RFC 6455 asks of a browser.
+class premasked_payload_t {
+public:
+    premasked_payload_t(const payload_t& payload, std::size_t keys);
+
+    const payload_t& payload() const { return *payload_; }
+
+    // memory taken by the frames
+    std::size_t bytes() const;
+
+    // Safe to call from any thread
+    const payload_t& next_frame() const {
+        return frames_[next_.fetch_add(1, std::memory_order_relaxed) % frames_.size()];
+    }
+
+private:
+    const payload_t*                 payload_;
+    std::vector<payload_t>           frames_;
+    mutable std::atomic<std::size_t> next_{ 0 };
+};
+
+// Pre-masked frames of every payload of the static groups of device_payloads, built once before
+// the devices start and read-only afterwards
+class premasked_table_t {
+public:
+    premasked_table_t(const std::vector<const std::vector<payload_t>*>& groups, std::size_t keys);
+
+    // The frames of a payload of one of the groups, nullptr for any other payload
+    const premasked_payload_t* find(const payload_t* payload) const;
+
+    // memory taken by the frames of every payload
+    std::size_t bytes() const;
+
+private:
+    std::unordered_map<const payload_t*, std::unique_ptr<premasked_payload_t>> payloads_;
+};
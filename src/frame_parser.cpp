@@ -0,0 +1,117 @@
+#include "frame_parser.hpp"
+
+#include <array>
+
+namespace {
+
+constexpr std::size_t event_frame_size  = 20;
+constexpr std::size_t probes_frame_size = 607;
+
+constexpr std::array<uint16_t, 256> make_crc_table() {
+    std::array<uint16_t, 256> table{};
+    for(unsigned i = 0; i < 256; i++) {
+        uint16_t crc = static_cast<uint16_t>(i << 8);
+        for(int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr auto crc_table = make_crc_table();
+
+inline uint16_t crc_update(uint16_t crc, uint8_t byte) {
+    return static_cast<uint16_t>((crc << 8) ^ crc_table[(crc >> 8) ^ byte]);
+}
+
+bool is_frame_kind(uint8_t byte) {
+    return byte == uint8_t(frame_kind_t::main) || byte == uint8_t(frame_kind_t::event) || byte == uint8_t(frame_kind_t::probes);
+}
+
+bool trailer_matches(const uint8_t* trailer, uint16_t crc) {
+    return trailer[0] == (crc & 0xff) && trailer[1] == (crc >> 8);
+}
+
+frame_result_t parse_fixed(const uint8_t* data, std::size_t size, std::size_t frame_size) {
+    if(size < frame_size) return { frame_error_t::truncated, size, {} };
+    if(!trailer_matches(data + frame_size - 2, crc16_ccitt(data, frame_size - 2))) {
+        return { frame_error_t::bad_checksum, frame_size - 2, {} };
+    }
+    return { frame_error_t::none, frame_size, frame_view_t(data, frame_size) };
+}
+
+// Fields carry no length, so the CRC runs along with the walk and every field boundary is a candidate end
+frame_result_t parse_main(const uint8_t* data, std::size_t size) {
+    uint16_t crc = crc_update(0xffff, data[0]);
+    std::size_t pos = 1;
+
+    for(;;) {
+        const std::size_t left = size - pos;
+        if(left < 2) return { frame_error_t::truncated, pos, {} };
+        if(trailer_matches(data + pos, crc) && (left == 2 || is_frame_kind(data[pos + 2]))) {
+            return { frame_error_t::none, pos + 2, frame_view_t(data, pos + 2) };
+        }
+        if(left == 2) return { frame_error_t::bad_checksum, pos, {} };
+
+        const uint8_t tag = data[pos];
+        if(tag == 0x01) {
+            crc = crc_update(crc, tag);
+            pos++;
+            continue;
+        }
+
+        const uint8_t marker = data[pos + 1];
+        if(!(marker & 0x20) && (marker >> 6) == 0) return { frame_error_t::bad_field, pos + 1, {} };
+
+        // the field has to leave room for the trailer
+        const std::size_t field_size = (marker & 0x20) ? 2 : 6;
+        if(field_size + 2 > left) return { frame_error_t::truncated, pos, {} };
+
+        for(std::size_t i = 0; i < field_size; i++) {
+            crc = crc_update(crc, data[pos + i]);
+        }
+        pos += field_size;
+    }
+}
+
+}
+
+std::string_view to_string(frame_error_t error) {
+    switch(error) {
+        case frame_error_t::none: return "none";
+        case frame_error_t::empty: return "empty";
+        case frame_error_t::unknown_kind: return "unknown kind";
+        case frame_error_t::truncated: return "truncated";
+        case frame_error_t::bad_field: return "bad field";
+        case frame_error_t::bad_checksum: return "bad checksum";
+        case frame_error_t::trailing_bytes: return "trailing bytes";
+    }
+    return "unknown";
+}
+
+uint16_t crc16_ccitt(const uint8_t* data, std::size_t size, uint16_t crc) {
+    for(std::size_t i = 0; i < size; i++) {
+        crc = crc_update(crc, data[i]);
+    }
+    return crc;
+}
+
+frame_result_t parse_frame(const uint8_t* data, std::size_t size) {
+    if(size == 0) return { frame_error_t::empty, 0, {} };
+
+    switch(static_cast<frame_kind_t>(data[0])) {
+        case frame_kind_t::main: return parse_main(data, size);
+        case frame_kind_t::event: return parse_fixed(data, size, event_frame_size);
+        case frame_kind_t::probes: return parse_fixed(data, size, probes_frame_size);
+    }
+    return { frame_error_t::unknown_kind, 0, {} };
+}
+
+frame_result_t validate_frame(const uint8_t* data, std::size_t size) {
+    auto res = parse_frame(data, size);
+    if(res && res.offset != size) {
+        res.error = frame_error_t::trailing_bytes;
+    }
+    return res;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+
+// Binary frames sent by the devices, parsed in place: a frame view and its fields point into the
+// caller's buffer, nothing is copied or allocated.
+//
+// A frame starts with its kind byte and ends with a CRC-16/CCITT-FALSE of everything before the
+// trailer, little-endian.
+//      main (250)   - telemetry, fields up to the trailer
+//      event (2)    - 20 bytes
+//      probes (102) - 607 bytes
+// A field of a main frame is [tag][marker][value]. Marker bit 5 set - a flag, no value bytes,
+// otherwise bits 7-6 are the type of a 4-byte little-endian value. The low 5 bits are the channel.
+// A 0x01 in place of a tag separates groups of fields.
+
+enum class frame_kind_t : uint8_t {
+    event  = 2,
+    probes = 102,
+    main   = 250,
+};
+
+enum class frame_error_t : uint8_t {
+    none,
+    empty,
+    // the first byte is not a frame kind
+    unknown_kind,
+    // ends inside a field or before the trailer
+    truncated,
+    // a marker of no known type
+    bad_field,
+    bad_checksum,
+    // a valid frame with more data after it in the same message
+    trailing_bytes,
+};
+
+std::string_view to_string(frame_error_t error);
+
+uint16_t crc16_ccitt(const uint8_t* data, std::size_t size, uint16_t crc = 0xffff);
+
+enum class field_type_t : uint8_t { flag, int32, uint32, float32 };
+
+struct frame_field_t {
+    uint8_t tag    = 0;
+    uint8_t marker = 0;
+    // separators before the field
+    uint8_t group  = 0;
+    // 4 bytes, nullptr for a flag
+    const uint8_t* value = nullptr;
+
+    field_type_t type() const {
+        if(marker & 0x20) return field_type_t::flag;
+        switch(marker >> 6) {
+            case 1: return field_type_t::int32;
+            case 2: return field_type_t::uint32;
+            default: return field_type_t::float32;
+        }
+    }
+    uint8_t channel() const { return marker & 0x1f; }
+
+    // 0x20 - clear, 0xe0 - set
+    bool flag() const { return (marker & 0xc0) != 0; }
+    uint32_t as_uint32() const {
+        return uint32_t(value[0]) | uint32_t(value[1]) << 8 | uint32_t(value[2]) << 16 | uint32_t(value[3]) << 24;
+    }
+    int32_t as_int32() const { return static_cast<int32_t>(as_uint32()); }
+    float as_float() const {
+        auto bits = as_uint32();
+        float res;
+        std::memcpy(&res, &bits, sizeof(res));
+        return res;
+    }
+};
+
+// A validated frame
+class frame_view_t {
+    public:
+    frame_view_t() = default;
+    frame_view_t(const uint8_t* data, std::size_t size) : data_(data), size_(size) {}
+
+    frame_kind_t kind() const { return static_cast<frame_kind_t>(data_[0]); }
+    const uint8_t* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+    // between the kind byte and the trailer
+    const uint8_t* body() const { return data_ + 1; }
+    std::size_t body_size() const { return size_ - 3; }
+
+    uint16_t checksum() const { return uint16_t(data_[size_ - 2] | data_[size_ - 1] << 8); }
+
+    // Fields of a main frame in order, the frame is already validated so the walk checks nothing
+    class field_iterator_t {
+        public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = frame_field_t;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const frame_field_t*;
+        using reference         = const frame_field_t&;
+
+        field_iterator_t() = default;
+        field_iterator_t(const uint8_t* pos, const uint8_t* end) : pos_(pos), end_(end) { load(); }
+
+        reference operator*() const { return field_; }
+        pointer operator->() const { return &field_; }
+
+        field_iterator_t& operator++() {
+            pos_ += field_.value ? 6 : 2;
+            load();
+            return *this;
+        }
+        field_iterator_t operator++(int) {
+            auto res = *this;
+            ++*this;
+            return res;
+        }
+
+        bool operator==(const field_iterator_t& other) const { return pos_ == other.pos_; }
+
+        private:
+        void load() {
+            while(pos_ != end_ && *pos_ == 0x01) {
+                field_.group++;
+                pos_++;
+            }
+            if(pos_ == end_) return;
+            field_.tag    = pos_[0];
+            field_.marker = pos_[1];
+            field_.value  = (pos_[1] & 0x20) ? nullptr : pos_ + 2;
+        }
+
+        const uint8_t* pos_ = nullptr;
+        const uint8_t* end_ = nullptr;
+        frame_field_t  field_;
+    };
+
+    field_iterator_t begin() const {
+        auto end = kind() == frame_kind_t::main ? body() + body_size() : body();
+        return field_iterator_t(body(), end);
+    }
+    field_iterator_t end() const {
+        auto end = kind() == frame_kind_t::main ? body() + body_size() : body();
+        return field_iterator_t(end, end);
+    }
+
+    private:
+    const uint8_t* data_ = nullptr;
+    std::size_t    size_ = 0;
+};
+
+struct frame_result_t {
+    frame_error_t error = frame_error_t::none;
+    // end of the frame, or the byte where parsing failed
+    std::size_t  offset = 0;
+    frame_view_t frame;
+
+    explicit operator bool() const { return error == frame_error_t::none; }
+};
+
+// The frame at the start of data. A message may hold more than one, the next starts at frame.size().
+// The end of a main frame is where the trailer matches and the data ends or the next frame kind follows.
+frame_result_t parse_frame(const uint8_t* data, std::size_t size);
+
+// data must be exactly one frame
+frame_result_t validate_frame(const uint8_t* data, std::size_t size);
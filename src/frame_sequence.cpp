@@ -0,0 +1,106 @@
+#include "frame_sequence.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+void put_u32(uint8_t* at, uint32_t value) {
+    at[0] = uint8_t(value);
+    at[1] = uint8_t(value >> 8);
+    at[2] = uint8_t(value >> 16);
+    at[3] = uint8_t(value >> 24);
+}
+
+uint32_t get_u32(const uint8_t* at) {
+    return uint32_t(at[0]) | uint32_t(at[1]) << 8 | uint32_t(at[2]) << 16 | uint32_t(at[3]) << 24;
+}
+
+}
+
+uint32_t sequence_clock_us() {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+bool stamp_frame(const std::vector<uint8_t>& frame, frame_stamp_t stamp, std::vector<uint8_t>& out) {
+    if(frame.empty() || frame[0] != uint8_t(frame_kind_t::main) || !validate_frame(frame.data(), frame.size())) {
+        return false;
+    }
+
+    const std::size_t body = frame.size() - 2;
+    out.resize(body + sequence_fields_size + 2);
+    std::copy(frame.begin(), frame.begin() + body, out.begin());
+
+    uint8_t* at = out.data() + body;
+    at[0] = sequence_tag;
+    at[1] = 0x80;
+    put_u32(at + 2, stamp.sequence);
+    at[6] = send_time_tag;
+    at[7] = 0x80;
+    put_u32(at + 8, stamp.send_time_us);
+
+    // the CRC of the unchanged part goes on from where it was
+    const uint16_t crc = crc16_ccitt(at, sequence_fields_size, crc16_ccitt(frame.data(), body));
+    at[12] = uint8_t(crc);
+    at[13] = uint8_t(crc >> 8);
+    return true;
+}
+
+std::optional<frame_stamp_t> find_stamp(const frame_view_t& frame) {
+    if(frame.kind() != frame_kind_t::main || frame.body_size() < sequence_fields_size) return std::nullopt;
+
+    const uint8_t* at = frame.body() + frame.body_size() - sequence_fields_size;
+    if(at[0] != sequence_tag || at[1] != 0x80 || at[6] != send_time_tag || at[7] != 0x80) return std::nullopt;
+    return frame_stamp_t{ get_u32(at + 2), get_u32(at + 8) };
+}
+
+void sequence_tracker_t::start(uint32_t sequence) {
+    bits_.fill(0);
+    started_ = true;
+    highest_ = sequence;
+    mark(sequence);
+}
+
+sequence_tracker_t::result_t sequence_tracker_t::on_frame(uint32_t sequence) {
+    if(!started_) {
+        start(sequence);
+        return { kind_t::first, 0 };
+    }
+
+    const uint32_t ahead = sequence - highest_;
+    if(ahead == 0) {
+        return { kind_t::duplicate, 0 };
+    }
+
+    // a client sequence starts at 0, unless the counter wrapped this is a new one
+    if(sequence == 0 && highest_ != UINT32_MAX) {
+        start(sequence);
+        return { kind_t::restart, 0 };
+    }
+
+    if(ahead < (uint32_t{1} << 31)) {
+        // the numbers skipped leave the window unseen
+        if(ahead >= window) {
+            bits_.fill(0);
+        } else {
+            for(uint32_t s = highest_ + 1; s != sequence; s++) {
+                clear(s);
+            }
+        }
+        mark(sequence);
+        highest_ = sequence;
+        return ahead == 1 ? result_t{ kind_t::in_order, 0 } : result_t{ kind_t::gap, ahead - 1 };
+    }
+
+    const uint32_t behind = highest_ - sequence;
+    if(behind >= window) {
+        start(sequence);
+        return { kind_t::restart, 0 };
+    }
+    if(seen(sequence)) {
+        return { kind_t::duplicate, 0 };
+    }
+    mark(sequence);
+    return { kind_t::late, 0 };
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "frame_parser.hpp"
+
+// Sequence numbers of device frames, to tell what the server lost, got twice or got out of order.
+//
+// With --sequence the client appends two fields to every main frame it writes, with tags no device
+// field uses, and recomputes the trailer:
+//      [0x7e][0x80][u32 sequence]      - per device, from 0 at the client's start, across reconnects
+//      [0x7f][0x80][u32 send time]     - low 32 bits of system_clock microseconds, sequence_clock_us()
+// Event and probes frames have a fixed size and go out as they are.
+
+constexpr uint8_t sequence_tag  = 0x7e;
+constexpr uint8_t send_time_tag = 0x7f;
+
+constexpr std::size_t sequence_fields_size = 12;
+
+struct frame_stamp_t {
+    uint32_t sequence     = 0;
+    uint32_t send_time_us = 0;
+};
+
+// Wrapping microsecond clock of the send times, differences are good for about 35 minutes
+uint32_t sequence_clock_us();
+
+// Writes the frame with the stamp fields into out, reusing its memory. False if frame isn't exactly
+// one main frame, a message of several frames (the bad payload) can't be stamped.
+bool stamp_frame(const std::vector<uint8_t>& frame, frame_stamp_t stamp, std::vector<uint8_t>& out);
+
+// The stamp of a validated frame, nullopt if it carries none. The fields are the last before the
+// trailer, so this looks at 12 bytes whatever the frame size.
+std::optional<frame_stamp_t> find_stamp(const frame_view_t& frame);
+
+// Loss, duplicate and reorder detection over the sequence numbers of one device, O(1) per frame.
+// The last `window` numbers are remembered: a number behind the highest one seen is a duplicate if
+// it was seen, else a late frame that had been counted as missing. Farther back than the window, or
+// a 0 out of nowhere, the device started over (a restarted client) and the count starts anew.
+class sequence_tracker_t {
+public:
+    static constexpr uint32_t window = 1024;
+
+    enum class kind_t : uint8_t {
+        first,
+        in_order,
+        gap,        // ahead of the next expected one, `missing` frames skipped
+        late,       // one counted as missing before, came out of order
+        duplicate,
+        restart,
+    };
+
+    struct result_t {
+        kind_t   kind    = kind_t::first;
+        uint32_t missing = 0;
+    };
+
+    result_t on_frame(uint32_t sequence);
+
+private:
+    bool seen(uint32_t sequence) const { return bits_[(sequence % window) / 64] & (uint64_t{1} << (sequence % 64)); }
+    void mark(uint32_t sequence) { bits_[(sequence % window) / 64] |= uint64_t{1} << (sequence % 64); }
+    void clear(uint32_t sequence) { bits_[(sequence % window) / 64] &= ~(uint64_t{1} << (sequence % 64)); }
+    void start(uint32_t sequence);
+
+    bool     started_ = false;
+    uint32_t highest_ = 0;
+    std::array<uint64_t, window / 64> bits_{};
+};
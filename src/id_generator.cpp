@@ -0,0 +1,139 @@
+#include "id_generator.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "id_loader.hpp"
+#include "utl_log.hpp"
+
+namespace bip = boost::interprocess;
+
+namespace {
+
+uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// "xxxxxxxxxx\n"
+constexpr size_t line_size = device_id_digits + 1;
+
+struct hex_table_t {
+    std::array<std::array<char, 2>, 256> pairs;
+
+    constexpr hex_table_t() : pairs() {
+        constexpr char digits[] = "0123456789abcdef";
+        for(size_t i = 0; i < 256; i++) {
+            pairs[i] = { digits[i >> 4], digits[i & 0xf] };
+        }
+    }
+};
+
+constexpr hex_table_t hex_table;
+
+void write_line(char* out, uint64_t id) {
+    for(size_t i = 0; i < device_id_digits / 2; i++) {
+        auto& pair = hex_table.pairs[(id >> (32 - 8 * i)) & 0xff];
+        out[2 * i]     = pair[0];
+        out[2 * i + 1] = pair[1];
+    }
+    out[device_id_digits] = '\n';
+}
+
+}
+
+id_permutation_t::id_permutation_t(uint64_t seed) {
+    for(auto& key : keys_) {
+        key = splitmix64(seed);
+    }
+}
+
+uint64_t id_permutation_t::operator()(uint64_t value) const {
+    uint64_t left  = (value >> half_bits) & half_mask;
+    uint64_t right = value & half_mask;
+
+    for(auto key : keys_) {
+        uint64_t f = (right ^ key) * 0x9e3779b97f4a7c15ULL;
+        f ^= f >> 29;
+        uint64_t next_right = left ^ (f & half_mask);
+        left  = right;
+        right = next_right;
+    }
+
+    return (left << half_bits) | right;
+}
+
+uint64_t id_permutation_t::id_at(uint64_t index) const {
+    // Permute [1, 2^40) onto itself by cycle walking past 0, so every index still maps to a unique id
+    uint64_t id = (*this)(index + 1);
+    while(id == 0) {
+        id = (*this)(id);
+    }
+    return id;
+}
+
+bool generate_device_ids(const std::string& filename, uint64_t count, uint64_t seed, size_t threads) {
+    if(count > device_id_max) {
+        UTL_LOG_ERR("Can't generate more than ", device_id_max, " unique ids");
+        return false;
+    }
+
+    {
+        std::ofstream file(filename, std::ios::out | std::ios::trunc | std::ios::binary);
+        if(!file.is_open()) {
+            UTL_LOG_ERR("Failed to open file: ", filename);
+            return false;
+        }
+    }
+
+    if(count == 0) {
+        return true;
+    }
+
+    const uint64_t size = count * line_size;
+
+    bip::mapped_region region;
+
+    try {
+        std::filesystem::resize_file(filename, size);
+        bip::file_mapping file(filename.c_str(), bip::read_write);
+        region = bip::mapped_region(file, bip::read_write);
+    } catch(std::exception const& e) {
+        UTL_LOG_ERR("Failed to map file: ", filename, " ", e.what());
+        return false;
+    }
+
+    char* data = static_cast<char*>(region.get_address());
+
+    const id_permutation_t permutation(seed);
+
+    threads = std::max<size_t>(1, std::min<uint64_t>(threads, count));
+    const uint64_t per_thread = (count + threads - 1) / threads;
+
+    std::vector<std::thread> workers;
+    for(size_t t = 0; t < threads; t++) {
+        const uint64_t begin = t * per_thread;
+        const uint64_t end   = std::min(count, begin + per_thread);
+
+        workers.emplace_back([=, &permutation]() {
+            for(uint64_t i = begin; i < end; i++) {
+                write_line(data + i * line_size, permutation.id_at(i));
+            }
+        });
+    }
+
+    for(auto& worker : workers) {
+        worker.join();
+    }
+
+    region.flush();
+
+    return true;
+}
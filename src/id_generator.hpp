@@ -0,0 +1,28 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Keyed bijection of the 40 bit id space: a Feistel network over two 20 bit halves.
+// Different indices always give different ids, the same seed always gives the same sequence.
+class id_permutation_t {
+public:
+    static constexpr size_t   rounds    = 6;
+    static constexpr unsigned half_bits = 20;
+    static constexpr uint64_t half_mask = (uint64_t{1} << half_bits) - 1;
+
+    explicit id_permutation_t(uint64_t seed);
+
+    uint64_t operator()(uint64_t value) const;
+
+    // i-th id (0-based) of the sequence, never 0
+    uint64_t id_at(uint64_t index) const;
+
+private:
+    std::array<uint64_t, rounds> keys_;
+};
+
+// Write count unique ids, one per line, to filename using threads workers.
+// Returns false if the file can't be created.
+bool generate_device_ids(const std::string& filename, uint64_t count, uint64_t seed, size_t threads);
@@ -0,0 +1,232 @@
+#include "id_loader.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ID_LOADER_SSE2 1
+#endif
+
+#include "utl_log.hpp"
+
+namespace bip = boost::interprocess;
+
+std::string format_device_id(uint64_t id) {
+    static constexpr char digits[] = "0123456789abcdef";
+
+    std::string res(device_id_digits, '0');
+    for(size_t i = device_id_digits; i > 0; i--) {
+        res[i - 1] = digits[id & 0xf];
+        id >>= 4;
+    }
+    return res;
+}
+
+std::optional<id_shard_t> parse_shard(std::string_view text) {
+    auto slash = text.find('/');
+    if(slash == std::string_view::npos) return std::nullopt;
+
+    id_shard_t shard;
+    auto k = std::from_chars(text.data(), text.data() + slash, shard.index);
+    auto n = std::from_chars(text.data() + slash + 1, text.data() + text.size(), shard.count);
+
+    if(k.ec != std::errc() || k.ptr != text.data() + slash) return std::nullopt;
+    if(n.ec != std::errc() || n.ptr != text.data() + text.size()) return std::nullopt;
+    if(shard.count == 0 || shard.index >= shard.count) return std::nullopt;
+
+    return shard;
+}
+
+namespace {
+
+std::optional<uint64_t> parse_id_scalar(const char* p) {
+    uint64_t id = 0;
+    for(size_t i = 0; i < device_id_digits; i++) {
+        const char c = p[i];
+        uint64_t   nibble;
+        if(c >= '0' && c <= '9') nibble = c - '0';
+        else if(c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+        else if(c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+        else return std::nullopt;
+        id = (id << 4) | nibble;
+    }
+    return id;
+}
+
+#ifdef ID_LOADER_SSE2
+// Validate and convert 10 hex digits at once. Reads 16 bytes, the caller makes sure they are mapped.
+std::optional<uint64_t> parse_id_sse2(const char* p) {
+    const __m128i v     = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+
+    // bytes >= 0x80 are negative for the signed compares and fail both ranges
+    const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                           _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    const __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                           _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+
+    const int valid = _mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha));
+    if((valid & 0x3ff) != 0x3ff) {
+        return std::nullopt;
+    }
+
+    const __m128i nibbles = _mm_or_si128(_mm_and_si128(is_digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+                                         _mm_and_si128(is_alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+
+    // each 16 bit lane holds two digits (high nibble first in memory), join them into one byte
+    const __m128i joined = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(nibbles, 4), _mm_set1_epi16(0x00f0)),
+                                        _mm_srli_epi16(nibbles, 8));
+    const __m128i packed = _mm_packus_epi16(joined, joined);
+
+    uint64_t bytes;
+    std::memcpy(&bytes, &packed, sizeof(bytes));
+
+    // bytes 0..4 hold the id big-endian
+    uint64_t id = 0;
+    for(size_t i = 0; i < device_id_digits / 2; i++) {
+        id = (id << 8) | ((bytes >> (8 * i)) & 0xff);
+    }
+    return id;
+}
+#endif
+
+// Open addressing set of ids, sized up front from the expected line count
+class id_set_t {
+public:
+    explicit id_set_t(size_t expected) {
+        size_t capacity = 16;
+        while(capacity < expected * 2) capacity <<= 1;
+        slots_.assign(capacity, 0);
+        mask_ = capacity - 1;
+    }
+
+    // false if the id was already there
+    bool insert(uint64_t id) {
+        if(size_ * 2 >= slots_.size()) grow();
+
+        const uint64_t key = id + 1; // 0 marks an empty slot
+        for(size_t i = hash(key) & mask_;; i = (i + 1) & mask_) {
+            if(slots_[i] == key) return false;
+            if(slots_[i] == 0) {
+                slots_[i] = key;
+                size_++;
+                return true;
+            }
+        }
+    }
+
+private:
+    static size_t hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return static_cast<size_t>(key);
+    }
+
+    void grow() {
+        std::vector<uint64_t> old = std::move(slots_);
+        slots_.assign(old.size() * 2, 0);
+        mask_ = slots_.size() - 1;
+        size_ = 0;
+        for(auto key : old) {
+            if(key != 0) insert(key - 1);
+        }
+    }
+
+    std::vector<uint64_t> slots_;
+    size_t                mask_ = 0;
+    size_t                size_ = 0;
+};
+
+}
+
+std::optional<uint64_t> parse_device_id(std::string_view text) {
+    if(text.size() != device_id_digits) return std::nullopt;
+    return parse_id_scalar(text.data());
+}
+
+std::optional<id_load_result_t> load_device_ids(const std::string& filename, id_shard_t shard) {
+    id_load_result_t res;
+
+    bip::file_mapping  file;
+    bip::mapped_region region;
+
+    try {
+        file   = bip::file_mapping(filename.c_str(), bip::read_only);
+        region = bip::mapped_region(file, bip::read_only);
+    } catch(std::exception const& e) {
+        // an empty file can't be mapped, treat it as no ids
+        std::ifstream probe(filename);
+        if(probe.is_open() && probe.peek() == std::ifstream::traits_type::eof()) {
+            return res;
+        }
+        UTL_LOG_ERR("Failed to map file: ", filename, " ", e.what());
+        return std::nullopt;
+    }
+
+    region.advise(bip::mapped_region::advice_sequential);
+
+    const char*  data = static_cast<const char*>(region.get_address());
+    const size_t size = region.get_size();
+
+    // byte range of the shard, moved forward to line starts
+    auto line_start_at = [&](size_t pos) -> size_t {
+        if(pos == 0) return 0;
+        if(pos >= size) return size;
+        if(data[pos - 1] == '\n') return pos;
+        auto nl = static_cast<const char*>(std::memchr(data + pos, '\n', size - pos));
+        return nl ? static_cast<size_t>(nl - data) + 1 : size;
+    };
+
+    const size_t begin = line_start_at(size / shard.count * shard.index);
+    const size_t end   = (shard.index + 1 == shard.count) ? size : line_start_at(size / shard.count * (shard.index + 1));
+
+    const size_t expected = (end - begin) / (device_id_digits + 1) + 1;
+    res.ids.reserve(expected);
+    id_set_t seen(expected);
+
+    for(size_t pos = begin; pos < end;) {
+        auto   nl       = static_cast<const char*>(std::memchr(data + pos, '\n', end - pos));
+        size_t line_end = nl ? static_cast<size_t>(nl - data) : end;
+        size_t next     = nl ? line_end + 1 : end;
+
+        size_t len = line_end - pos;
+        if(len > 0 && data[line_end - 1] == '\r') len--;
+
+        if(len == 0) {
+            pos = next;
+            continue;
+        }
+
+        res.lines++;
+
+        std::optional<uint64_t> id;
+        if(len == device_id_digits) {
+#ifdef ID_LOADER_SSE2
+            // 16 byte loads must stay inside the mapping
+            if(pos + 16 <= size) id = parse_id_sse2(data + pos);
+            else id = parse_id_scalar(data + pos);
+#else
+            id = parse_id_scalar(data + pos);
+#endif
+        }
+
+        if(!id) {
+            res.invalid++;
+            UTL_LOG_DWARN("Invalid id at byte ", pos, " of ", filename);
+        } else if(!seen.insert(*id)) {
+            res.duplicates++;
+        } else {
+            res.ids.push_back(*id);
+        }
+
+        pos = next;
+    }
+
+    return res;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Device ids are 10 hex digits, i.e. 40 bit integers
+constexpr size_t   device_id_digits = 10;
+constexpr uint64_t device_id_max    = (uint64_t{1} << 40) - 1;
+
+// 10 lowercase hex digits, zero padded
+std::string format_device_id(uint64_t id);
+
+// Device ids packed into 5 bytes each
+class device_id_list_t {
+public:
+    static constexpr size_t packed_size = 5;
+
+    size_t size() const { return bytes_.size() / packed_size; }
+    bool empty() const { return bytes_.empty(); }
+
+    void reserve(size_t count) { bytes_.reserve(count * packed_size); }
+
+    void push_back(uint64_t id) {
+        for(size_t i = 0; i < packed_size; i++) {
+            bytes_.push_back(static_cast<uint8_t>(id >> (8 * i)));
+        }
+    }
+
+    uint64_t operator[](size_t index) const {
+        const uint8_t* p = bytes_.data() + index * packed_size;
+        uint64_t id = 0;
+        for(size_t i = 0; i < packed_size; i++) {
+            id |= uint64_t{p[i]} << (8 * i);
+        }
+        return id;
+    }
+
+private:
+    std::vector<uint8_t> bytes_;
+};
+
+// Slice k of N of the id file, by byte range: a line belongs to the shard holding its first byte
+struct id_shard_t {
+    size_t index = 0;
+    size_t count = 1;
+};
+
+// "k/N", 0 <= k < N
+std::optional<id_shard_t> parse_shard(std::string_view text);
+
+struct id_load_result_t {
+    device_id_list_t ids;
+
+    size_t lines      = 0; // non-empty lines in the shard
+    size_t invalid    = 0; // lines that are not exactly 10 hex digits
+    size_t duplicates = 0; // valid ids seen before in the shard
+};
+
+// Memory map the file and parse one id per line ("\n" or "\r\n"), skipping invalid and duplicate ids.
+// Returns nullopt if the file can't be opened.
+std::optional<id_load_result_t> load_device_ids(const std::string& filename, id_shard_t shard = {});
+
+// Parse a single id. Returns nullopt unless exactly 10 hex digits.
+std::optional<uint64_t> parse_device_id(std::string_view text);
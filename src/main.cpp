@@ -20,8 +20,6 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/lexical_cast.hpp>
-#include "boost/random.hpp"
-#include "boost/generator_iterator.hpp"
 #include <boost/thread/mutex.hpp>
 #include <cstdlib>
 #include <iostream>
@@ -33,6 +31,9 @@
 #include <thread>
 #include <fstream>
 #include <condition_variable>
+#include <random>
+#include <atomic>
+#include <memory>
 
 #include "utl_log.hpp"
 
@@ -40,6 +41,17 @@
 #include "device_payloads.hpp"
 #include "util.hpp"
 #include "coro_read.hpp"
+#include "target_pool.hpp"
+#include "id_loader.hpp"
+#include "id_generator.hpp"
+#include "address_range.hpp"
+#include "controller.hpp"
+#include "replay.hpp"
+#include "traffic_log.hpp"
+#include "error_aggregator.hpp"
+#include "frame_encoder.hpp"
+#include "frame_sequence.hpp"
+#include "client_metrics.hpp"
 
 namespace beast     = boost::beast;         // from <boost/beast.hpp>
 namespace http      = beast::http;          // from <boost/beast/http.hpp>
@@ -49,7 +61,24 @@ namespace net       = boost::asio;          // from <boost/asio.hpp>
 namespace ssl       = boost::asio::ssl;       // from <boost/asio/ssl.hpp>
 
 using tcp           = boost::asio::ip::tcp; // from <boost/asio/ip/tcp.hpp>
-using resolver_result_t = boost::asio::ip::basic_resolver_results<boost::asio::ip::tcp>;
+
+// Set on SIGINT/SIGTERM or when --duration runs out, device threads then drain and exit
+std::atomic<bool> stop_requested{false};
+
+// Per-device errors, summarized every --error-interval seconds
+error_aggregator_t device_errors;
+
+// Every message to and from the devices, see --record
+std::unique_ptr<traffic_recorder_t> traffic_recorder;
+
+// Complete masked frames of the device payloads, written to the socket as they are, see --premasked
+std::unique_ptr<premasked_table_t> premasked_frames;
+
+// Stamp main frames with a sequence number and send time, see frame_sequence.hpp and --sequence
+bool sequence_frames = false;
+
+// Hot path debug logs, per callsite
+constexpr utl::log::RateLimit device_log_limit{1, 20};
 
 // jj,,
 // const char* ws_path = "/socket-units-server/"; 
@@ -74,28 +103,7 @@ using resolver_result_t = boost::asio::ip::basic_resolver_results<boost::asio::i
     
 // }
 
-void generate_random_ids(std::string filename, size_t count) {
-    typedef boost::mt19937 RNGType;
-    RNGType rng(std::random_device{}());
-    boost::uniform_int<size_t> one_to_six( 1, 0xffffffffff);
-    boost::variate_generator< RNGType, boost::uniform_int<size_t> >
-                  dice(rng, one_to_six);
-    
-    std::fstream file(filename, std::ios::out | std::ios::trunc);
-
-    if(!file.is_open()) {
-        UTL_LOG_ERR("Failed to open file: ", filename);
-        return;
-    }
-
-    for(int i = 0; i < count; i++) {
-        
-        size_t d = dice();
-        file << std::hex << std::setw(10) << std::setfill('0') << d << std::endl;
-    }
-}
-
-void ws_init(websocket::stream<tcp::socket>& ws, std::string device_id, std::string fw) {
+void ws_init(websocket::stream<device_socket_t>& ws, std::string device_id, std::string fw) {
 
     // Set a decorator to change the User-Agent of the handshake
     ws.set_option(websocket::stream_base::decorator([device_id, fw](websocket::request_type& req) {
@@ -106,78 +114,235 @@ void ws_init(websocket::stream<tcp::socket>& ws, std::string device_id, std::str
     }));
 }
 
-void ws_async_read(ws_state_t& ws_state, bool send_bad_payloads) {
-    auto handler = [&]() {
-        while(1) {
-            try {
-                if(ws_state.ws.is_open()) {
-                    ws_state.ws.read(ws_state.buffer);
-                    UTL_LOG_DNOTE("Async read: ", beast::make_printable(ws_state.buffer.data()), " ID: ", ws_state.device_id);
-                    LOCK_GUARD(*ws_state.ws_state_mutex);
-                    ws_state.extra_payload = ws_get_payload(beast::buffers_to_string(ws_state.buffer.data()), send_bad_payloads);
-                }
-            } catch(std::exception const& e) {
-                UTL_LOG_ERR("Async read error: ", e.what(), "ID: ", ws_state.device_id);
-            }
+write_queue_t::push_res_t ws_push(ws_state_t& ws_state, const std::vector<payload_t>& frames, frame_tag_t tag,
+                                  std::optional<std::chrono::steady_clock::time_point> received = std::nullopt);
+
+ws_status_t ws_status(ws_state_t& ws_state) {
+    LOCK_GUARD(*ws_state.ws_state_mutex);
+    return ws_state.status;
+}
+
+void ws_set_status(ws_state_t& ws_state, ws_status_t status) {
+    LOCK_GUARD(*ws_state.ws_state_mutex);
+    ws_state.status = status;
+}
+
+// Drop the endpoint of a connection that is gone, so it stops counting as active
+void ws_release_endpoint(ws_state_t& ws_state) {
+    LOCK_GUARD(*ws_state.ws_state_mutex);
+    if(ws_state.endpoint) {
+        ws_state.endpoint->stats.active_connections--;
+        ws_state.endpoint = nullptr;
+    }
+}
+
+// Ends the operations pending on the stream, a premasked frame still waiting for its turn included
+void ws_close_socket(ws_state_t& ws_state) {
+    beast::error_code ec;
+    ws_state.ws.next_layer().close(ec);
+    ws_state.ws.next_layer().fail_frames();
+}
+
+// Completes the close once no handler is pending on the stream, the manage thread may then connect again
+void ws_closed_if_idle(ws_state_t& ws_state) {
+    if(ws_state.status != ws_status_t::closing || ws_state.io_pending > 0) return;
+
+    ws_close_socket(ws_state);
+    ws_state.write_queue->clear();
+    ws_release_endpoint(ws_state);
+    ws_set_status(ws_state, ws_status_t::closed);
+
+    if(ws_state.on_closed) {
+        std::exchange(ws_state.on_closed, nullptr)();
+    }
+}
+
+// An operation on an open connection failed: the socket is closed, which ends the operations still
+// pending on it, the last of them completes the close
+void ws_lost(ws_state_t& ws_state, std::string_view what, beast::error_code ec) {
+    if(ws_state.status == ws_status_t::open) {
+        if(!stop_requested) {
+            device_errors.add(std::string(what) + ec.message(), ws_state.device_id);
+        }
+        ws_set_status(ws_state, ws_status_t::closing);
+        ws_close_socket(ws_state);
+    }
+    ws_closed_if_idle(ws_state);
+}
+
+// Reads the messages of the device one after another on the executor of the stream, for as long as
+// the connection is open. The reply to a server command goes into the write queue right away.
+void ws_read_next(ws_state_t& ws_state, bool send_bad_payloads) {
+    ws_state.io_pending++;
+    ws_state.ws.async_read(ws_state.buffer, [&ws_state, send_bad_payloads](beast::error_code ec, std::size_t) {
+        ws_state.io_pending--;
+        if(ec) {
             ws_state.buffer.clear();
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            ws_lost(ws_state, "Read error: ", ec);
+            return;
         }
-    };
 
-    std::thread t(handler);
-    t.detach();
+        const auto received = std::chrono::steady_clock::now();
+        UTL_LOG_DLIMITED(NOTE, device_log_limit, "Async read: ", beast::make_printable(ws_state.buffer.data()), " ID: ", ws_state.device_id);
+        if(traffic_recorder) {
+            auto data = ws_state.buffer.cdata();
+            traffic_recorder->record(traffic_direction_t::to_device, ws_state.ws.got_text(), ws_state.device_number,
+                                     data.data(), data.size());
+        }
+        {
+            LOCK_GUARD(*ws_state.ws_state_mutex);
+            if(ws_state.endpoint) {
+                ws_state.endpoint->stats.frames_received++;
+            }
+        }
+
+        // behind what is already queued
+        auto reply = ws_find_payload(beast::buffers_to_string(ws_state.buffer.data()), send_bad_payloads);
+        if(reply && ws_push(ws_state, *reply, frame_tag_t::reply, received) == write_queue_t::push_res_t::held) {
+            LOCK_GUARD(*ws_state.ws_state_mutex);
+            ws_state.extra_payload          = reply;
+            ws_state.extra_payload_received = received;
+        }
+        ws_state.buffer.clear();
+
+        if(ws_state.status == ws_status_t::open) {
+            ws_read_next(ws_state, send_bad_payloads);
+        } else {
+            ws_closed_if_idle(ws_state);
+        }
+    });
 }
 
-ws_conn_res_t ws_connect(std::string_view original_host, std::string_view path
-                            , ws_state_t& ws_state, const resolver_result_t& resolver_result
-                            , bool send_bad_payloads
-                        ) {
-    ws_conn_res_t res{};
+// Connect and handshake of a device, both within connect_timeout
+struct ws_connect_attempt_t {
+    static constexpr auto connect_timeout = std::chrono::milliseconds(8000);
+
+    net::steady_timer                     timer;
+    std::shared_ptr<target_endpoint_t>    endpoint;
+    std::string                           host;
+    std::string                           path;
+    bool                                  send_bad_payloads = false;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::function<void(bool)>             done;
+    // set by the timer, or once the attempt is over so a late timer leaves the connection alone
+    bool timed_out = false;
+    bool finished  = false;
+};
+
+void ws_connect_failed(ws_state_t& ws_state, ws_connect_attempt_t& attempt, std::string_view what, beast::error_code ec) {
+    attempt.finished = true;
+    attempt.timer.cancel();
+    if(attempt.timed_out) {
+        ec = beast::error::timeout;
+    }
 
-    std::string host{original_host};
+    device_errors.add(std::string(what) + ec.message(), ws_state.device_id);
+    if(what.starts_with("Connect")) {
+        attempt.endpoint->stats.connect_errors++;
+    } else {
+        attempt.endpoint->stats.handshake_errors++;
+    }
 
-    try {
+    ws_close_socket(ws_state);
+    ws_set_status(ws_state, ws_status_t::closed);
+    attempt.done(false);
+}
 
-        UTL_LOG_DINFO("Connecting to: ", host, "ID: ", ws_state.device_id);
-        auto ep      = net::connect(ws_state.ws.next_layer(), resolver_result);
-        host += ':' + std::to_string(ep.port());
+void ws_connected(ws_state_t& ws_state, ws_connect_attempt_t& attempt) {
+    attempt.finished = true;
+    attempt.timer.cancel();
 
-    } catch(std::exception const& e) {
-        UTL_LOG_ERR("Connect Error: ", e.what(), "ID: ", ws_state.device_id);
-        res.error = true;
-        return res;
+    attempt.endpoint->stats.connect_latency.record(std::chrono::steady_clock::now() - attempt.start);
+    attempt.endpoint->stats.active_connections++;
+    {
+        LOCK_GUARD(*ws_state.ws_state_mutex);
+        ws_state.endpoint = attempt.endpoint;
+        ws_state.status   = ws_status_t::open;
     }
+    ws_state.write_queue->attach(attempt.endpoint);
+    ws_state.ws.next_layer().start_frames();
 
-    try {
-        UTL_LOG_DINFO("Handshake, ID: ", ws_state.device_id);
-        bool done = run_with_timeout(
-            [&]() {
-               ws_state.ws.handshake(host, path);
-            }, 
-            std::chrono::milliseconds(8000),
-            "Handshake"
-        );
+    ws_read_next(ws_state, attempt.send_bad_payloads);
+    attempt.done(true);
+}
 
-        if(!done) {
-            res.error = true;
-            return res;
+// Runs on the executor of the stream while it is closed, so no handler of the last connection is
+// pending when the socket is opened again
+void ws_start_connect(ws_state_t& ws_state, std::shared_ptr<ws_connect_attempt_t> attempt) {
+    ws_set_status(ws_state, ws_status_t::connecting);
+    attempt->endpoint->stats.connect_attempts++;
+
+    attempt->timer.expires_after(ws_connect_attempt_t::connect_timeout);
+    attempt->timer.async_wait([&ws_state, attempt](beast::error_code ec) {
+        if(ec || attempt->finished) return;
+        attempt->timed_out = true;
+        ws_close_socket(ws_state);
+    });
+
+    auto& socket = ws_state.ws.next_layer();
+    beast::error_code ec;
+    socket.close(ec);
+    socket.reset_frames();
+    if(ws_state.bind_address) {
+        socket.open(tcp::v4(), ec);
+        if(!ec) socket.bind(tcp::endpoint(*ws_state.bind_address, 0), ec);
+        if(ec) {
+            ws_connect_failed(ws_state, *attempt, "Connect Error: ", ec);
+            return;
         }
+    }
 
-        // auto read_h = [&ws_state](beast::error_code ec, std::size_t bytes_transferred) {
-        //     read_handler(ec, bytes_transferred, ws_state);
-        // };
+    ws_state.io_pending++;
+    socket.async_connect(attempt->endpoint->endpoint, [&ws_state, attempt](beast::error_code ec) {
+        ws_state.io_pending--;
+        if(ec || attempt->timed_out) {
+            ws_connect_failed(ws_state, *attempt, "Connect Error: ", ec);
+            return;
+        }
 
-        // ws_state.ws.async_read(ws_state.buffer, beast::bind_front_handler(read_h));
+        UTL_LOG_DLIMITED(INFO, device_log_limit, "Handshake, ID: ", ws_state.device_id);
+        ws_state.io_pending++;
+        ws_state.ws.async_handshake(attempt->host, attempt->path, [&ws_state, attempt](beast::error_code ec) {
+            ws_state.io_pending--;
+            if(ec || attempt->timed_out) {
+                ws_connect_failed(ws_state, *attempt, "Handshake Error: ", ec);
+                return;
+            }
+            ws_connected(ws_state, *attempt);
+        });
+    });
+}
 
-        ws_async_read(ws_state, send_bad_payloads);
+// Connects the device on the executor of its stream and waits for the result
+ws_conn_res_t ws_connect(std::string_view path
+                            , ws_state_t& ws_state, target_pool_t& target_pool
+                            , bool send_bad_payloads
+                        ) {
+    ws_conn_res_t res{};
 
-    
-        res.error = false;
-    } catch(std::exception const& e) {
-        UTL_LOG_ERR("Handshake Error: ", e.what(), "ID: ", ws_state.device_id);
+    auto endpoint = target_pool.pick(ws_state.device_id);
+    if(!endpoint) {
+        device_errors.add("No target endpoint available", ws_state.device_id);
         res.error = true;
+        return res;
     }
 
+    UTL_LOG_DLIMITED(INFO, device_log_limit, "Connecting to: ", endpoint->name, "ID: ", ws_state.device_id);
+
+    auto connected = std::make_shared<std::promise<bool>>();
+    auto done      = connected->get_future();
+
+    auto attempt = std::make_shared<ws_connect_attempt_t>(ws_connect_attempt_t{
+        .timer             = net::steady_timer(ws_state.ws.get_executor()),
+        .endpoint          = endpoint,
+        .host              = endpoint->host + ':' + std::to_string(endpoint->endpoint.port()),
+        .path              = std::string(path),
+        .send_bad_payloads = send_bad_payloads,
+        .done              = [connected](bool ok) { connected->set_value(ok); },
+    });
+    net::post(ws_state.ws.get_executor(), [&ws_state, attempt]() { ws_start_connect(ws_state, attempt); });
+
+    res.error = !done.get();
     return res;
 }
 
@@ -195,32 +360,136 @@ bool is_time(long long time, std::chrono::steady_clock::time_point& last_run_tim
     return true;
 }
 
-void ws_manage_ws(std::string_view host, std::string_view path, ws_state_t& ws_state, resolver_result_t& resolver_result
+// Count a written frame towards the endpoint of the connection, and record it as written
+void ws_count_sent(ws_state_t& ws_state, const queued_frame_t& frame, const payload_t& written, bool done) {
+    const auto now = std::chrono::steady_clock::now();
+    if(traffic_recorder && done) {
+        traffic_recorder->record(traffic_direction_t::to_server, false, ws_state.device_number, written.data(), written.size());
+    }
+
+    LOCK_GUARD(*ws_state.ws_state_mutex);
+    if(!ws_state.endpoint) return;
+
+    auto& stats = ws_state.endpoint->stats;
+    if(!done) {
+        stats.write_errors++;
+        return;
+    }
+
+    stats.frames_sent++;
+    stats.bytes_sent += written.size();
+    if(frame.received) {
+        stats.reply_latency.record(now - *frame.received);
+    }
+}
+
+// The writer of the device ran out of frames, a drain waiting for it may close the connection now
+void ws_writer_stopped(ws_state_t& ws_state) {
+    if(ws_state.on_drained) {
+        std::exchange(ws_state.on_drained, nullptr)();
+    }
+}
+
+// Writes the queued frames of the device one after another, runs on the executor of the stream.
+// Frames queued while the connection is not open are dropped, which also stops the writer.
+void ws_write_next(ws_state_t& ws_state) {
+    if(ws_state.status != ws_status_t::open) {
+        ws_state.write_queue->clear();
+    }
+    auto frame = ws_state.write_queue->next();
+    if(!frame) {
+        ws_writer_stopped(ws_state);
+        return;
+    }
+
+    // numbered as they go out, so the server sees any reordering done after this point
+    const payload_t* written = frame->data;
+    if(sequence_frames && frame->tag == frame_tag_t::main
+       && stamp_frame(*frame->data, { ws_state.sequence, sequence_clock_us() }, ws_state.stamped)) {
+        ws_state.sequence++;
+        written = &ws_state.stamped;
+    }
+
+    auto on_written = [&ws_state, frame, written](beast::error_code ec, std::size_t) {
+        ws_state.io_pending--;
+        ws_count_sent(ws_state, *frame, *written, !ec);
+        if(ec) {
+            ws_lost(ws_state, "Write error: ", ec);
+        }
+        if(ws_state.write_queue->done()) {
+            ws_write_next(ws_state);
+        } else {
+            ws_writer_stopped(ws_state);
+        }
+        ws_closed_if_idle(ws_state);
+    };
+
+    ws_state.io_pending++;
+    // one final frame either way, the socket holds it back while beast is in the middle of one of its
+    // own, e.g. the pong to a ping of the server
+    if(auto premasked = premasked_frames && written == frame->data ? premasked_frames->find(frame->data) : nullptr) {
+        ws_state.ws.next_layer().async_write_frame(net::buffer(premasked->next_frame()), std::move(on_written));
+        return;
+    }
+
+    ws_state.ws.binary(true);
+    ws_state.ws.async_write(net::buffer(*written), std::move(on_written));
+}
+
+// Queues frames of the device under its write policy, starts the writer if it is idle.
+// Called by the manage thread and, for replies, by the read handler of the device.
+write_queue_t::push_res_t ws_push(ws_state_t& ws_state, const std::vector<payload_t>& frames, frame_tag_t tag,
+                                  std::optional<std::chrono::steady_clock::time_point> received) {
+    bool start_writing = false;
+    auto res = ws_state.write_queue->push(frames, tag, start_writing, received);
+    if(start_writing) {
+        net::post(ws_state.ws.get_executor(), [&ws_state]() { ws_write_next(ws_state); });
+    }
+    return res;
+}
+
+void ws_manage_ws(std::string_view path, ws_state_t& ws_state, target_pool_t& target_pool
                     , long long time_between_packets, long long time_reconnect
                     , bool send_bad_payloads, bool send_events
                 ) {
 
-    if(ws_state.ws.is_open() && ws_state.extra_payload) {
-        UTL_LOG_DINFO("Sending extra payload, ID:", ws_state.device_id);
-        run_with_timeout(
-            [&]() {
-                LOCK_GUARD(*ws_state.ws_state_mutex);
-                for(auto& p : ws_state.extra_payload.value()) {
-                    ws_state.ws.write(net::buffer(p));
-                }
-            }, 
-            std::chrono::milliseconds(5000),
-            "Extra payload Write"
-        );
+    const auto status = ws_status(ws_state);
+
+    if(status == ws_status_t::open) {
+        // the read handler sets it on the I/O thread
+        const std::vector<payload_t>* extra_payload = nullptr;
+        std::chrono::steady_clock::time_point received;
+        {
+            LOCK_GUARD(*ws_state.ws_state_mutex);
+            std::swap(extra_payload, ws_state.extra_payload);
+            received = ws_state.extra_payload_received;
+        }
+        if(extra_payload) {
+            UTL_LOG_DLIMITED(INFO, device_log_limit, "Sending held back reply, ID:", ws_state.device_id);
+        }
+        if(extra_payload && ws_push(ws_state, *extra_payload, frame_tag_t::reply, received) == write_queue_t::push_res_t::held) {
+            // tried again on the next pass, unless the server sent a newer command meanwhile
+            LOCK_GUARD(*ws_state.ws_state_mutex);
+            if(!ws_state.extra_payload) {
+                ws_state.extra_payload          = extra_payload;
+                ws_state.extra_payload_received = received;
+            }
+        }
+    }
 
-        ws_state.extra_payload = std::nullopt;
+    // the queue and the endpoint are already dropped on the executor of the stream
+    if(ws_state.connected && status != ws_status_t::open) {
+        UTL_LOG_DLIMITED(WARN, device_log_limit, "Connection closed, ID: ", ws_state.device_id);
+        ws_state.connected = false;
     }
 
-    if(!ws_state.connected || !ws_state.ws.is_open()) {
+    if(!ws_state.connected) {
+        // handlers of the last connection are still pending on the stream
+        if(status != ws_status_t::closed) return;
 
         if((ws_state.last_run_time == std::chrono::steady_clock::time_point{}) || is_time(time_between_packets, ws_state.last_run_time)) {
 
-            auto conn_res = ws_connect(host, path, ws_state, resolver_result, send_bad_payloads);
+            auto conn_res = ws_connect(path, ws_state, target_pool, send_bad_payloads);
             if(conn_res.error) {
                 return;
             }
@@ -229,82 +498,148 @@ void ws_manage_ws(std::string_view host, std::string_view path, ws_state_t& ws_s
         }
     }
 
+    const auto last_run_time = ws_state.last_run_time;
     if(!is_time(time_between_packets, ws_state.last_run_time)) return;
 
-    ws_state.ws.binary(true);
-    boost::beast::error_code ec;
+    static const std::vector<payload_t> no_payload;
 
+    const std::vector<payload_t>* event_payload = &no_payload;
     if(send_events) {
-        UTL_LOG_DDEBUG("Sending event payload, ID:", ws_state.device_id);
-        run_with_timeout(
-            [&]() {
-                auto payload = ws_get_payload("event", send_bad_payloads);
-                if(!payload) return;
-
-                //LOCK_GUARD(*ws_state.ws_state_mutex);
-                for(auto& p : payload.value()) {
-                    ws_state.ws.write(net::buffer(p));
+        UTL_LOG_DLIMITED(DEBUG, device_log_limit, "Sending event payload, ID:", ws_state.device_id);
+        if(auto found = ws_find_payload("event", send_bad_payloads)) event_payload = found;
+    }
+
+    UTL_LOG_DLIMITED(DEBUG, device_log_limit, "Sending main payload, ID:", ws_state.device_id);
+    const std::vector<payload_t>* main_payload = &no_payload;
+    if(auto found = ws_find_payload("main_payload", send_bad_payloads)) main_payload = found;
+
+    // a blocked device keeps its schedule until the server takes its frames, the others go on
+    if(ws_state.write_queue->policy() == write_policy_t::block
+       && !ws_state.write_queue->has_room(event_payload->size() + main_payload->size())) {
+        ws_state.write_queue->hold();
+        ws_state.last_run_time = last_run_time;
+        return;
+    }
+
+    ws_push(ws_state, *event_payload, frame_tag_t::event);
+    ws_push(ws_state, *main_payload, frame_tag_t::main);
+
+    if (ws_state.connected) {
+        //auto const time = std::chrono::current_zone()->to_local(std::chrono::system_clock::now());
+        UTL_LOG_DLIMITED(DEBUG, device_log_limit, "Payload queued, ID: ", ws_state.device_id);
+    }
+
+}
+
+// Closes the connection on the executor of the stream and calls closed() once no handler is pending
+// on it any more. With handshake the close frame is sent and the reply waited for until the deadline,
+// then the socket is just closed.
+void ws_close(ws_state_t& ws_state, bool handshake, std::chrono::steady_clock::time_point deadline, std::function<void()> closed) {
+    if(ws_state.status == ws_status_t::closed) {
+        closed();
+        return;
+    }
+    ws_state.on_closed = std::move(closed);
+
+    if(ws_state.status == ws_status_t::open) {
+        ws_set_status(ws_state, ws_status_t::closing);
+
+        if(handshake) {
+            auto timer = std::make_shared<net::steady_timer>(ws_state.ws.get_executor(), deadline);
+            timer->async_wait([&ws_state](beast::error_code ec) {
+                if(!ec) ws_close_socket(ws_state);
+            });
+
+            // the pending read ends with the reply of the server
+            ws_state.io_pending++;
+            ws_state.ws.async_close(websocket::close_code::going_away, [&ws_state, timer](beast::error_code) {
+                ws_state.io_pending--;
+                timer->cancel();
+                ws_closed_if_idle(ws_state);
+            });
+            return;
+        }
+
+        ws_close_socket(ws_state);
+    }
+    ws_closed_if_idle(ws_state);
+}
+
+// Flush what is pending for the device, then close the connection, runs on the executor of the stream
+// and calls closed() once the connection is closed. Past the deadline the socket is closed without
+// waiting for the close handshake.
+void ws_drain(ws_state_t& ws_state, std::chrono::steady_clock::time_point deadline, std::function<void()> closed) {
+    if(ws_state.status != ws_status_t::open || ws_state.write_queue->idle()) {
+        ws_close(ws_state, std::chrono::steady_clock::now() < deadline, deadline, std::move(closed));
+        return;
+    }
+
+    // whichever comes first, the writer running out of frames or the deadline
+    auto timer = std::make_shared<net::steady_timer>(ws_state.ws.get_executor(), deadline);
+    ws_state.on_drained = [&ws_state, deadline, closed, timer]() {
+        timer->cancel();
+        ws_close(ws_state, std::chrono::steady_clock::now() < deadline, deadline, closed);
+    };
+    timer->async_wait([&ws_state, deadline, closed, timer](beast::error_code ec) {
+        if(ec || !ws_state.on_drained) return;
+        ws_state.on_drained = nullptr;
+        ws_close(ws_state, false, deadline, closed);
+    });
+}
+
+// Drains all devices of the thread at once, so a slow peer doesn't use up the time of the others
+void ws_drain_all(std::vector<ws_state_t>& ws_states, std::chrono::steady_clock::time_point deadline) {
+    std::vector<std::future<void>> closed;
+    closed.reserve(ws_states.size());
+
+    for(auto& ws_state : ws_states) {
+        try {
+            if(ws_status(ws_state) == ws_status_t::open) {
+                const std::vector<payload_t>* extra_payload = nullptr;
+                std::chrono::steady_clock::time_point received;
+                {
+                    LOCK_GUARD(*ws_state.ws_state_mutex);
+                    std::swap(extra_payload, ws_state.extra_payload);
+                    received = ws_state.extra_payload_received;
                 }
-                // ws_state.ws.write(net::buffer(ws_get_payload("main_payload").value()), ec);
-            }, 
-            std::chrono::milliseconds(5000),
-            "Event write"
-        );
-    }
-
-    UTL_LOG_DDEBUG("Sending main payload, ID:", ws_state.device_id);
-    run_with_timeout(
-        [&]() {
-            auto payload = ws_get_payload("main_payload", send_bad_payloads);
-            if(!payload) return;
-            for(auto& p : payload.value()) {
-
-                //LOCK_GUARD(*ws_state.ws_state_mutex);
-                ws_state.ws.write(net::buffer(p));
+                if(extra_payload) ws_push(ws_state, *extra_payload, frame_tag_t::reply, received);
             }
-            // ws_state.ws.write(net::buffer(ws_get_payload("main_payload").value()), ec);
-        }, 
-        std::chrono::milliseconds(5000),
-        "Main payload write"
-    );
-
-    // ws_state.ws.async_write(net::buffer(ws_payload), beast::bind_front_handler(write_handler));
-
-    // if(ec || !ws_state.ws.next_layer().is_open()) {
-    //     ws_state.connected = false;
-    //     UTL_LOG_DWARN("Connection closed, ID: ", ws_state.device_id);
-    //     //ws_state.ws.close(websocket::close_code::normal);
-
-    //     run_with_timeout(
-    //         [&]() {
-    //             ws_state.ws.close(websocket::close_code::normal);
-    //         }, 
-    //         std::chrono::milliseconds(5000),
-    //         "Close"
-    //     );
-
-    if (ws_state.ws.next_layer().is_open()) {
-        //auto const time = std::chrono::current_zone()->to_local(std::chrono::system_clock::now());
-        UTL_LOG_DDEBUG("Payload sent, ID: ", ws_state.device_id);
+
+            auto done = std::make_shared<std::promise<void>>();
+            closed.push_back(done->get_future());
+            net::post(ws_state.ws.get_executor(), [&ws_state, deadline, done]() {
+                ws_drain(ws_state, deadline, [done]() { done->set_value(); });
+            });
+        } catch(std::exception const& e) {
+            device_errors.add(std::string("Drain exception: ") + e.what(), ws_state.device_id);
+        }
+    }
+
+    for(auto& done : closed) {
+        done.wait();
     }
 
+    for(auto& ws_state : ws_states) {
+        ws_state.connected = false;
+    }
 }
 
-void ws_manage_thread(std::string host, std::string path, std::vector<ws_state_t>* ws_states
-    , resolver_result_t& resolver_result, long long time_between_packets
+void ws_manage_thread(std::string path, std::vector<ws_state_t>& ws_states
+    , target_pool_t& target_pool, long long time_between_packets
     , long long time_reconnect, bool send_bad_payloads
-    , bool send_events
+    , bool send_events, std::chrono::milliseconds drain_timeout
     ) {
 
-    UTL_LOG_DINFO("Thread started, device count: ", ws_states->size());
+    UTL_LOG_DINFO("Thread started, device count: ", ws_states.size());
+
+    while(!stop_requested) {
+        for(auto& ws_state : ws_states) {
+            if(stop_requested) break;
 
-    while(true) {
-        for(auto& ws_state : *ws_states) {
-            
             try {
-                ws_manage_ws(host, path, ws_state, resolver_result, time_between_packets, time_reconnect, send_bad_payloads, send_events);
+                ws_manage_ws(path, ws_state, target_pool, time_between_packets, time_reconnect, send_bad_payloads, send_events);
             } catch(std::exception const& e) {
-                UTL_LOG_ERR("Exception: ", e.what(), " ID: ", ws_state.device_id);
+                device_errors.add(std::string("Exception: ") + e.what(), ws_state.device_id);
             }
 
             std::this_thread::sleep_for(std::chrono::milliseconds(time_between_devices_ms));
@@ -312,16 +647,103 @@ void ws_manage_thread(std::string host, std::string path, std::vector<ws_state_t
 
     }
 
-    delete ws_states;
+    ws_drain_all(ws_states, std::chrono::steady_clock::now() + drain_timeout);
+
+    UTL_LOG_DINFO("Thread stopped, device count: ", ws_states.size());
+}
+
+void log_final_summary(const target_pool_t& target_pool, std::chrono::steady_clock::duration run_time) {
+    target_stats_snapshot_t total;
+    for(auto& endpoint : target_pool.all_endpoints()) {
+        total.merge(endpoint->stats.snapshot());
+    }
+
+    auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(run_time).count();
+
+    UTL_LOG_INFO("Final stats after ", seconds, " s:");
+    target_pool.log_stats();
+    UTL_LOG_INFO("Total ", format_target_stats(total));
+    if(seconds > 0) {
+        UTL_LOG_INFO("Average send rate: ", total.frames_sent / seconds, " frames/s, ", total.bytes_sent / seconds, " B/s");
+    }
 }
 
 void print_usage() {
-    std::cout << "Usage: websocket-client-sync <host> <path> <port> <time-between-packets s> <time-reconnect s> <thread-count> <bad/no-bad> <events/no-events> <ids-file>\n"
+    std::cout << "Usage: websocket-client-sync <host> <path> <port> <time-between-packets s> <time-reconnect s> <thread-count> <bad/no-bad> <events/no-events> <ids-file> [options]\n"
+              << "      host - host[:port], or a comma separated list of them\n"
               << "      bad - send bad payloads\n"
+              << "Options:\n"
+              << "      --strategy=rr|hash|least    assign devices to resolved endpoints (default rr)\n"
+              << "      --resolve-interval=<s>      re-resolve targets every <s> seconds, 0 - never (default 60)\n"
+              << "      --stats-interval=<s>        log per-target stats every <s> seconds, 0 - never (default 10)\n"
+              << "      --shard=<k>/<N>             load only the k-th of N slices of the ids file\n"
+              << "      --bind=<ip>[-<ip>]          bind devices round-robin to these source addresses\n"
+              << "      --duration=<s>              stop after <s> seconds, 0 - run until SIGINT/SIGTERM (default 0)\n"
+              << "      --drain-timeout=<s>         time to flush and close connections on stop (default 5)\n"
+              << "      --log-overflow=block|drop   when the async log buffer of a thread is full (default block)\n"
+              << "      --log-binary=<file>         log to a binary file instead of the console, see logdump\n"
+              << "      --error-interval=<s>        summarize device errors every <s> seconds, 0 - log each one (default 10)\n"
+              << "      --record=<file>             record every message to and from the devices, see replay; in controller\n"
+              << "                                  mode every worker records to <file>.<k>\n"
+              << "      --write-queue=<n>           frames a device may have waiting to be written (default 64)\n"
+              << "      --write-policy=drop|coalesce|block\n"
+              << "                                  when the write queue of a device is full: drop the new frames, replace\n"
+              << "                                  queued ones of the same kind, or hold that device back (default block)\n"
+              << "      --premasked=<n>             build the masked frames ahead of time with <n> mask keys per payload and\n"
+              << "                                  write them as they are, 0 - beast masks every write (default 0)\n"
+              << "      --sequence=on|off           number the main frames of every device and stamp their send time, for\n"
+              << "                                  the loss, duplicate and reorder report of ws-test-server (default off);\n"
+              << "                                  stamped frames are masked by beast, --premasked then skips the main frames\n"
+              << "      --metrics=<file>            write rates, connected devices, queued frames and latency percentiles\n"
+              << "                                  to a time series file every --metrics-interval, see metrics-csv\n"
+              << "      --metrics-interval=<s>      (default 1)\n"
               << "Example:\n"
               << "      ws-test-client.exe test.secbuild.ru /socket-units-server/ 81 30 10 4 no-bad events ids.txt\n"
+              << "      ws-test-client.exe node1.local:81,node2.local /socket-units-server/ 81 30 10 4 no-bad events ids.txt --strategy=hash\n"
+              << "\n"
+              << "Usage: websocket-client-sync gen <ids-file> <count> [seed]\n"
+              << "      ids are unique, the same seed gives the same file\n"
+              << "\n"
+              << "Usage: websocket-client-sync controller <workers> <client arguments...>\n"
+              << "      runs <workers> client processes, each with its own shard of the ids file\n"
+              << "      and slice of the --bind range, and prints their merged stats\n"
+              << "      --log-binary, --metrics and --record files get the worker number as a .<k> suffix\n"
+              << "\n"
+              << "Usage: websocket-client-sync loopback <devices> <seconds> [options]\n"
+              << "      starts ws-test-server on 127.0.0.1 and drives <devices> devices against it for <seconds>,\n"
+              << "      exits with 1 when a threshold is missed\n"
+              << "      --server=<path>             server executable (default ws-test-server next to this one)\n"
+              << "      --client=<path>             client executable, e.g. a WS_IO_URING build to compare with epoll\n"
+              << "                                  (default this one)\n"
+              << "      --port=<n>                  (default 18080)\n"
+              << "      --interval=<s>              time between packets (default 1)\n"
+              << "      --threads=<n>               client threads (default 4)\n"
+              << "      --server-threads=<n>        (default 2)\n"
+              << "      --command-interval=<s>      the server sends every device a command every <s> seconds, 0 - never (default 0)\n"
+              << "      --min-conn-rate=<n>         connections per second\n"
+              << "      --min-frame-rate=<n>        frames sent per second\n"
+              << "      --max-cpu-per-1k=<ms>       client CPU time per 1000 frames\n"
+              << "      --max-rss-per-device=<KB>   client max RSS divided by the devices\n"
+              << "      --max-connect-p99=<ms>      connect latency\n"
+              << "      --max-reply-p99=<ms>        from a server command to the written reply, see --command-interval\n"
+              << "      --max-errors=<n>            connect, handshake and write errors (default 0)\n"
+              << "      --max-syscalls-per-frame=<n>\n"
+              << "                                  client syscalls per frame sent, counted on the raw_syscalls tracepoint\n"
+              << "                                  (Linux, tracefs and CAP_PERFMON or kernel.perf_event_paranoid=-1)\n"
               << "\n"
-              << "Usage: websocket-client-sync gen <ids-file> <count>"
+              << "Usage: websocket-client-sync replay <recording> <host> <path> <port> [options]\n"
+              << "      sends the device frames of a --record file to a server with their recorded timing\n"
+              << "      --speed=<x>|max             time scale, 2 - twice as fast, max - no waiting (default 1)\n"
+              << "      --threads=<n>               I/O threads (default 1)\n"
+              << "\n"
+              << "Usage: websocket-client-sync io-backend\n"
+              << "      prints the reactor of this build, epoll or io_uring on Linux, see WS_IO_URING in CMakeLists.txt\n"
+              << "\n"
+              << "Usage: websocket-client-sync logdump <binary-log-file>\n"
+              << "      prints a log written with --log-binary as text\n"
+              << "\n"
+              << "Usage: websocket-client-sync metrics-csv <metrics-file>\n"
+              << "      prints a file written with --metrics as CSV, one line per interval"
               << std::endl;
 }
 
@@ -339,9 +761,66 @@ int main(int argc, char** argv) {
     long long thread_count;
     bool bad_payloads = false;
     bool send_events = false;
+    assign_strategy_t strategy = assign_strategy_t::round_robin;
+    long long resolve_interval = 60;
+    long long stats_interval = 10;
+    id_shard_t shard;
+    std::optional<address_range_t> bind_range;
+    std::optional<std::string> stats_socket;
+    int worker_id = 0;
+    long long duration = 0;
+    long long drain_timeout = 5;
+    utl::log::Overflow log_overflow = utl::log::Overflow::BLOCK;
+    std::optional<std::string> log_binary;
+    long long error_interval = 10;
+    std::optional<std::string> record_file;
+    long long write_queue_limit = 64;
+    write_policy_t write_policy = write_policy_t::block;
+    long long premasked_keys = 0;
+    std::optional<std::string> metrics_file;
+    long long metrics_interval = 1;
+
+    if(argc >= 2 && std::string(argv[1]) == "controller") {
+        return run_controller(argc, argv);
+    }
+
+    if(argc >= 2 && std::string(argv[1]) == "loopback") {
+        return run_loopback(argc, argv);
+    }
+
+    if(argc >= 2 && std::string(argv[1]) == "replay") {
+        return run_replay(argc, argv);
+    }
+
+    if(argc == 2 && std::string(argv[1]) == "io-backend") {
+        std::cout << io_backend_name() << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    if(argc == 3 && std::string(argv[1]) == "logdump") {
+        std::ifstream file(argv[2], std::ios::binary);
+        if(!file) {
+            std::cout << "Failed to open file: " << argv[2] << std::endl;
+            return EXIT_FAILURE;
+        }
+        if(!utl::log::decode_binary_log(file, std::cout)) {
+            std::cout << "Malformed binary log: " << argv[2] << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(argc == 3 && std::string(argv[1]) == "metrics-csv") {
+        auto metrics = metrics_reader_t::open(argv[2]);
+        if(!metrics) {
+            return EXIT_FAILURE;
+        }
+        write_metrics_csv(*metrics, std::cout);
+        return EXIT_SUCCESS;
+    }
 
     // Check command line arguments.
-    if((argc == 10) && (std::string(argv[1]) != "gen")) {
+    if((argc >= 10) && (std::string(argv[1]) != "gen")) {
         host = argv[1];
         path = argv[2];
         port = argv[3];
@@ -362,102 +841,300 @@ int main(int argc, char** argv) {
             return EXIT_FAILURE;
         }
 
-    } else if((argc == 4) && (std::string(argv[1]) == "gen")) {
+        if(auto opt = get_option(argc, argv, 10, "strategy")) {
+            auto parsed = parse_assign_strategy(*opt);
+            if(!parsed) {
+                std::cout << "Unknown strategy: " << *opt << std::endl;
+                return EXIT_FAILURE;
+            }
+            strategy = *parsed;
+        }
+        if(auto opt = get_option(argc, argv, 10, "resolve-interval")) {
+            resolve_interval = std::stoll(std::string(*opt));
+        }
+        if(auto opt = get_option(argc, argv, 10, "stats-interval")) {
+            stats_interval = std::stoll(std::string(*opt));
+        }
+        if(auto opt = get_option(argc, argv, 10, "shard")) {
+            auto parsed = parse_shard(*opt);
+            if(!parsed) {
+                std::cout << "Shard must be k/N with 0 <= k < N: " << *opt << std::endl;
+                return EXIT_FAILURE;
+            }
+            shard = *parsed;
+        }
+        if(auto opt = get_option(argc, argv, 10, "bind")) {
+            bind_range = parse_address_range(*opt);
+            if(!bind_range) {
+                std::cout << "Bad source address range: " << *opt << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if(auto opt = get_option(argc, argv, 10, "stats-socket")) {
+            stats_socket = std::string(*opt);
+        }
+        if(auto opt = get_option(argc, argv, 10, "worker-id")) {
+            worker_id = std::stoi(std::string(*opt));
+        }
+        if(auto opt = get_option(argc, argv, 10, "duration")) {
+            duration = std::stoll(std::string(*opt));
+        }
+        if(auto opt = get_option(argc, argv, 10, "drain-timeout")) {
+            drain_timeout = std::stoll(std::string(*opt));
+        }
+        if(auto opt = get_option(argc, argv, 10, "log-overflow")) {
+            if(*opt != "block" && *opt != "drop") {
+                std::cout << "Log overflow must be block or drop: " << *opt << std::endl;
+                return EXIT_FAILURE;
+            }
+            log_overflow = (*opt == "drop") ? utl::log::Overflow::DROP : utl::log::Overflow::BLOCK;
+        }
+        if(auto opt = get_option(argc, argv, 10, "log-binary")) {
+            log_binary = std::string(*opt);
+        }
+        if(auto opt = get_option(argc, argv, 10, "error-interval")) {
+            error_interval = std::stoll(std::string(*opt));
+        }
+        if(auto opt = get_option(argc, argv, 10, "record")) {
+            record_file = std::string(*opt);
+        }
+        if(auto opt = get_option(argc, argv, 10, "write-queue")) {
+            write_queue_limit = std::stoll(std::string(*opt));
+            if(write_queue_limit < 1) {
+                std::cout << "Write queue must hold at least 1 frame: " << *opt << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if(auto opt = get_option(argc, argv, 10, "write-policy")) {
+            auto parsed = parse_write_policy(*opt);
+            if(!parsed) {
+                std::cout << "Write policy must be drop, coalesce or block: " << *opt << std::endl;
+                return EXIT_FAILURE;
+            }
+            write_policy = *parsed;
+        }
+        if(auto opt = get_option(argc, argv, 10, "sequence")) {
+            if(*opt != "on" && *opt != "off") {
+                std::cout << "Sequence must be on or off: " << *opt << std::endl;
+                return EXIT_FAILURE;
+            }
+            sequence_frames = *opt == "on";
+        }
+        if(auto opt = get_option(argc, argv, 10, "premasked")) {
+            premasked_keys = std::stoll(std::string(*opt));
+            if(premasked_keys < 0) {
+                std::cout << "Pre-masked key count can't be negative: " << *opt << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if(auto opt = get_option(argc, argv, 10, "metrics")) {
+            metrics_file = std::string(*opt);
+        }
+        if(auto opt = get_option(argc, argv, 10, "metrics-interval")) {
+            metrics_interval = std::stoll(std::string(*opt));
+            if(metrics_interval < 1) {
+                std::cout << "Metrics interval must be at least 1 s: " << *opt << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+    } else if((argc == 4 || argc == 5) && (std::string(argv[1]) == "gen")) {
         ids_file = argv[2];
         count = argv[3];
 
-        generate_random_ids(ids_file, std::stoi(count));
+        uint64_t seed = (argc == 5) ? std::stoull(argv[4]) : ((uint64_t{std::random_device{}()} << 32) | std::random_device{}());
+        UTL_LOG_INFO("Generating ", count, " ids, seed: ", seed);
 
+        auto start = std::chrono::steady_clock::now();
+        if(!generate_device_ids(ids_file, std::stoull(count), seed, std::thread::hardware_concurrency())) {
+            return EXIT_FAILURE;
+        }
+
+        UTL_LOG_INFO("Done in ", std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(), " ms");
         return EXIT_SUCCESS;
     } else {
         print_usage();
         return EXIT_FAILURE;
     }
 
-    net::io_context ws_states_ioc;
-    std::thread t_ws {[&]() { ws_states_ioc.run(); }};
-    t_ws.detach(); 
+    // device threads log through per-thread buffers drained by one writer thread, each grows from 16 KB
+    // up to 1 MB as its thread needs, 64 MB over all of them
+    utl::log::enable_async(std::size_t{1} << 20, log_overflow, std::size_t{64} << 20);
+
+    if(log_binary) {
+        std::cout << "Logging to " << *log_binary << ", read it with: ws-test-client logdump " << *log_binary << std::endl;
+        utl::log::add_binary_sink(*log_binary, utl::log::Verbosity::TRACE);
+    }
 
-    tcp::resolver resolver{ ws_states_ioc};
-    resolver_result_t resolver_result;
+    device_errors.start(std::chrono::seconds(error_interval));
 
-    net::io_context ioc;
-    std::thread t{ [&] { ioc.run(); } };
-    t.detach();
-
-    try {
-        resolver_result = resolver.resolve(host, port);
-        UTL_LOG_INFO("Resolver result: ", resolver_result.begin()->endpoint().address().to_string());
-    } catch(std::exception const& e) {
-        UTL_LOG_ERR("Resolver error: ", e.what());
+    // payloads go out byte for byte, catch a broken table before it reaches the server
+    if(!ws_check_payloads()) {
         return EXIT_FAILURE;
     }
 
-    std::fstream ids_file_stream(ids_file, std::ios::in);
+    UTL_LOG_INFO("I/O backend: ", io_backend_name());
 
-    if(!ids_file_stream.is_open()) {
-        UTL_LOG_ERR("Failed to open file: ", ids_file);
+    if(premasked_keys > 0) {
+        premasked_frames = std::make_unique<premasked_table_t>(ws_payload_groups(), premasked_keys);
+        UTL_LOG_INFO("Pre-masked frames: ", premasked_keys, " keys per payload, ", premasked_frames->bytes() / 1024,
+                     " KB, masking kernel: ", mask_kernel_name());
+        if(sequence_frames) {
+            UTL_LOG_WARN("--sequence=on stamps every main frame, those are masked by beast, only the other frames are pre-masked");
+        }
+    }
+
+    if(record_file) {
+        traffic_recorder = traffic_recorder_t::open(*record_file);
+        if(!traffic_recorder) {
+            return EXIT_FAILURE;
+        }
+        UTL_LOG_INFO("Recording traffic to ", *record_file, ", replay it with: ws-test-client replay ", *record_file, " ...");
+    }
+
+    // Async writes of every device, see write_queue_t
+    net::io_context ws_states_ioc;
+    auto ws_states_work = net::make_work_guard(ws_states_ioc);
+
+    net::io_context ioc;
+
+    target_pool_t target_pool(parse_targets(host, port), strategy);
+
+    if(!target_pool.resolve()) {
+        UTL_LOG_ERR("Resolver error: no target could be resolved");
         return EXIT_FAILURE;
     }
 
-    auto line_count = std::count(std::istreambuf_iterator<char>(ids_file_stream), std::istreambuf_iterator<char>(), '\n') + 1;
-    UTL_LOG_INFO("File Line count: ", line_count);
+    for(auto& endpoint : target_pool.all_endpoints()) {
+        UTL_LOG_INFO("Resolver result: ", endpoint->name);
+    }
+
+    target_pool.start(std::chrono::seconds(resolve_interval), std::chrono::seconds(stats_interval));
 
+    // started by a controller, report stats to it
+    std::optional<worker_stats_stream_t> stats_stream;
+    if(stats_socket) {
+        stats_stream.emplace(*stats_socket, worker_id, target_pool);
+        stats_stream->start(std::chrono::seconds(1));
+    }
 
-    auto devices_per_thread = line_count / thread_count;
+    std::unique_ptr<client_metrics_t> metrics;
+    if(metrics_file) {
+        metrics = client_metrics_t::open(*metrics_file, std::chrono::seconds(metrics_interval), target_pool);
+        if(!metrics) {
+            return EXIT_FAILURE;
+        }
+        metrics->start();
+        UTL_LOG_INFO("Writing metrics to ", *metrics_file, " every ", metrics_interval, " s, export them with: ws-test-client metrics-csv ",
+                     *metrics_file);
+    }
 
-    ids_file_stream.seekg(0, std::ios::beg);
+    auto loaded_ids = load_device_ids(ids_file, shard);
 
-    std::vector<std::thread> ws_threads;
-    std::vector<ws_state_t>* one_thread_ws_states = new std::vector<ws_state_t>();
+    if(!loaded_ids) {
+        UTL_LOG_ERR("Failed to open file: ", ids_file);
+        return EXIT_FAILURE;
+    }
+
+    auto& ids = loaded_ids->ids;
+    UTL_LOG_INFO("File Line count: ", loaded_ids->lines, ", shard ", shard.index, "/", shard.count
+                    , ", ids: ", ids.size(), ", invalid: ", loaded_ids->invalid, ", duplicates: ", loaded_ids->duplicates);
 
-    std::string line;
+    auto devices_per_thread = std::max<size_t>(1, ids.size() / thread_count);
 
-    long long actual_thread_count = 0;
+    std::vector<std::unique_ptr<std::vector<ws_state_t>>> device_groups;
+    device_groups.push_back(std::make_unique<std::vector<ws_state_t>>());
+
+    for(size_t i = 0; i < ids.size(); i++) {
+        auto device_id = format_device_id(ids[i]);
 
-    while(std::getline(ids_file_stream, line)) {
         ws_state_t ws_state{.ws_state_mutex = std::make_unique<std::mutex>(),
-                            .ws = websocket::stream<tcp::socket>(ws_states_ioc),
+                            .ws = websocket::stream<device_socket_t>(ws_states_ioc),
                             .buffer = beast::flat_buffer{},
-                            .device_id = line,
-                            .connected = false
+                            .device_id = device_id,
+                            .device_number = ids[i],
+                            .connected = false,
+                            .write_queue = std::make_unique<write_queue_t>(write_queue_limit, write_policy)
         };
 
-        ws_init(ws_state.ws, line, "1.0.0");
+        if(bind_range) {
+            ws_state.bind_address = bind_range->at(i);
+        }
 
-        one_thread_ws_states->push_back(std::move(ws_state));
+        ws_init(ws_state.ws, device_id, "1.0.0");
 
-        if((one_thread_ws_states->size() == devices_per_thread) && (actual_thread_count < (thread_count-1))) {
-            UTL_LOG_INFO("Starting Thread with ", one_thread_ws_states->size(), " devices");
+        if((device_groups.back()->size() == devices_per_thread) && (device_groups.size() < static_cast<size_t>(thread_count))) {
+            device_groups.push_back(std::make_unique<std::vector<ws_state_t>>());
+        }
 
-            ws_threads.emplace_back(std::thread{[&, one_thread_ws_states]() {
-                ws_manage_thread(host, path,  one_thread_ws_states, resolver_result, time_between_packets, time_reconnect, bad_payloads, send_events);
-            }});
+        device_groups.back()->push_back(std::move(ws_state));
+    }
 
-            ws_threads.back().detach();
-            actual_thread_count++;
-            one_thread_ws_states = new std::vector<ws_state_t>();
-        }
+    const auto start_time = std::chrono::steady_clock::now();
+
+    std::thread t_ws {[&]() { ws_states_ioc.run(); }};
 
+    std::vector<std::thread> ws_threads;
+    for(auto& group : device_groups) {
+        if(group->empty()) continue;
+
+        UTL_LOG_INFO("Starting Thread with ", group->size(), " devices");
+        ws_threads.emplace_back([&, &ws_states = *group]() {
+            ws_manage_thread(path, ws_states, target_pool, time_between_packets, time_reconnect, bad_payloads, send_events
+                                , std::chrono::seconds(drain_timeout));
+        });
     }
 
-    if(one_thread_ws_states->size() > 0) {
-        UTL_LOG_INFO("Starting Thread with ", one_thread_ws_states->size(), " devices");
-        ws_threads.emplace_back(std::thread{[&, one_thread_ws_states]() {
-            ws_manage_thread(host, path, one_thread_ws_states, resolver_result, time_between_packets, time_reconnect, bad_payloads, send_events);
-        }});
+    UTL_LOG_INFO("Actual Thread count: ", ws_threads.size());
+
+    // Main thread sleeps in the io_context until a signal or the end of --duration
+    net::signal_set signals(ioc, SIGINT, SIGTERM);
+    net::steady_timer duration_timer(ioc);
+
+    auto request_stop = [&](std::string_view reason) {
+        if(stop_requested.exchange(true)) return;
+        UTL_LOG_INFO("Stopping: ", reason, ", draining connections for up to ", drain_timeout, " s");
+        signals.cancel();
+        duration_timer.cancel();
+    };
+
+    signals.async_wait([&](beast::error_code ec, int signal) {
+        if(!ec) request_stop(signal == SIGINT ? "SIGINT" : "SIGTERM");
+    });
 
-        ws_threads.back().detach();
-        actual_thread_count++;
-        one_thread_ws_states = nullptr;
+    if(duration > 0) {
+        duration_timer.expires_after(std::chrono::seconds(duration));
+        duration_timer.async_wait([&](beast::error_code ec) {
+            if(!ec) request_stop("duration reached");
+        });
     }
 
-    UTL_LOG_INFO("Actual Thread count: ", actual_thread_count);
-    while(1){};
+    ioc.run();
 
     for(auto& thread : ws_threads) {
         thread.join();
     }
 
+    // the sockets are closed, writes still in flight end with an error
+    ws_states_work.reset();
+    t_ws.join();
+
+    if(stats_stream) {
+        stats_stream->stop();
+    }
+    if(metrics) {
+        metrics->stop();
+        UTL_LOG_INFO("Metrics rows written: ", metrics->rows());
+    }
+    target_pool.stop();
+    device_errors.stop();
+
+    log_final_summary(target_pool, std::chrono::steady_clock::now() - start_time);
+
+    if(traffic_recorder) {
+        traffic_recorder->close();
+        UTL_LOG_INFO("Recorded messages: ", traffic_recorder->records(), ", dropped: ", traffic_recorder->dropped());
+    }
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,268 @@
+#include "metrics_file.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+#include "utl_log.hpp"
+
+namespace bip = boost::interprocess;
+
+namespace {
+
+constexpr char        file_magic[8]     = { 'W', 'S', 'M', 'E', 'T', 'R', 'I', 'C' };
+constexpr uint32_t    file_version      = 1;
+constexpr std::size_t fixed_header_size = 64;
+constexpr std::size_t column_name_size  = metrics_writer_t::max_column_name + 1;
+constexpr std::size_t sample_size       = 24;
+
+template <class T>
+void store(uint8_t* at, T value) {
+    std::memcpy(at, &value, sizeof(T));
+}
+
+template <class T>
+T load(const uint8_t* at) {
+    T value;
+    std::memcpy(&value, at, sizeof(T));
+    return value;
+}
+
+// "2026-10-19T12:25:16.123Z"
+void write_utc(std::ostream& out, std::chrono::system_clock::time_point time) {
+    using namespace std::chrono;
+
+    const auto ms  = floor<milliseconds>(time);
+    const auto day = floor<days>(ms);
+    const year_month_day date(day);
+    const hh_mm_ss clock(ms - day);
+
+    char text[32];
+    std::snprintf(text, sizeof(text), "%04d-%02u-%02uT%02d:%02d:%02d.%03dZ", static_cast<int>(date.year()),
+                  static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()), static_cast<int>(clock.hours().count()),
+                  static_cast<int>(clock.minutes().count()), static_cast<int>(clock.seconds().count()),
+                  static_cast<int>(clock.subseconds().count()));
+    out << text;
+}
+
+}
+
+// ===============
+// --- Writer ---
+// ===============
+
+std::unique_ptr<metrics_writer_t> metrics_writer_t::open(const std::string& filename, const std::vector<std::string>& columns,
+                                                         std::chrono::milliseconds interval, std::size_t chunk_rows) {
+    for(auto& column : columns) {
+        if(column.empty() || column.size() > max_column_name) {
+            UTL_LOG_ERR("Bad metrics column name: \"", column, "\"");
+            return nullptr;
+        }
+    }
+
+    const std::size_t header_size = fixed_header_size + columns.size() * column_name_size;
+    const std::size_t chunk_size  = std::max<std::size_t>(chunk_rows, 1) * std::max<std::size_t>(columns.size(), 1) * sample_size;
+
+    {
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        if(!out) {
+            UTL_LOG_ERR("Failed to create the metrics file: ", filename);
+            return nullptr;
+        }
+
+        std::vector<uint8_t> header(header_size, 0);
+        std::memcpy(header.data(), file_magic, sizeof(file_magic));
+        store<uint32_t>(header.data() + 8, file_version);
+        store<uint32_t>(header.data() + 12, static_cast<uint32_t>(header_size));
+        store<uint32_t>(header.data() + 16, static_cast<uint32_t>(columns.size()));
+        store<uint32_t>(header.data() + 20, static_cast<uint32_t>(sample_size));
+        store<int64_t>(header.data() + 24, interval.count());
+        store<int64_t>(header.data() + 32, std::chrono::duration_cast<std::chrono::microseconds>(
+                                               std::chrono::system_clock::now().time_since_epoch()).count());
+        for(std::size_t i = 0; i < columns.size(); i++) {
+            std::memcpy(header.data() + fixed_header_size + i * column_name_size, columns[i].data(), columns[i].size());
+        }
+        out.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+    }
+
+    std::unique_ptr<metrics_writer_t> res(new metrics_writer_t(filename, header_size, chunk_size));
+    res->columns_ = columns.size();
+    try {
+        std::filesystem::resize_file(filename, header_size + chunk_size);
+        res->file_ = bip::file_mapping(filename.c_str(), bip::read_write);
+    } catch(std::exception const& e) {
+        UTL_LOG_ERR("Failed to map the metrics file: ", filename, " ", e.what());
+        return nullptr;
+    }
+    if(!res->map(0)) {
+        return nullptr;
+    }
+    return res;
+}
+
+metrics_writer_t::~metrics_writer_t() {
+    close();
+}
+
+bool metrics_writer_t::map(uint64_t chunk) {
+    const uint64_t offset = header_size_ + chunk * chunk_size_;
+    try {
+        if(std::filesystem::file_size(filename_) < offset + chunk_size_) {
+            std::filesystem::resize_file(filename_, offset + chunk_size_);
+        }
+        region_ = std::make_unique<bip::mapped_region>(file_, bip::read_write, offset, chunk_size_);
+    } catch(std::exception const& e) {
+        UTL_LOG_ERR("Failed to map chunk ", chunk, " of the metrics file: ", e.what());
+        return false;
+    }
+
+    base_  = static_cast<uint8_t*>(region_->get_address());
+    chunk_ = chunk;
+    used_  = 0;
+    return true;
+}
+
+bool metrics_writer_t::append(std::span<const double> values) {
+    if(!region_ || values.size() != columns_) return false;
+
+    // a chunk holds whole rows, a row never spans two of them
+    if(used_ == chunk_size_) {
+        region_->flush(0, 0, true);
+        region_.reset();
+        if(!map(chunk_ + 1)) return false;
+    }
+
+    const int64_t time = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::system_clock::now().time_since_epoch()).count();
+
+    for(std::size_t i = 0; i < values.size(); i++) {
+        uint8_t* at = base_ + used_;
+        store<uint32_t>(at + 4, 0);
+        store<int64_t>(at + 8, time);
+        store<double>(at + 16, values[i]);
+        std::atomic_ref<uint32_t>(*reinterpret_cast<uint32_t*>(at)).store(static_cast<uint32_t>(i + 1), std::memory_order_release);
+        used_ += sample_size;
+    }
+
+    rows_++;
+    return true;
+}
+
+void metrics_writer_t::close() {
+    if(!region_) return;
+
+    region_->flush();
+    region_.reset();
+
+    std::error_code ec;
+    std::filesystem::resize_file(filename_, header_size_ + chunk_ * chunk_size_ + used_, ec);
+}
+
+// ===============
+// --- Reader ---
+// ===============
+
+std::optional<metrics_reader_t> metrics_reader_t::open(const std::string& filename) {
+    bip::file_mapping  file;
+    bip::mapped_region region;
+    try {
+        file   = bip::file_mapping(filename.c_str(), bip::read_only);
+        region = bip::mapped_region(file, bip::read_only);
+    } catch(std::exception const& e) {
+        UTL_LOG_ERR("Failed to open the metrics file: ", filename, " ", e.what());
+        return std::nullopt;
+    }
+
+    auto data = static_cast<const uint8_t*>(region.get_address());
+    const std::size_t file_size = region.get_size();
+
+    if(file_size < fixed_header_size || std::memcmp(data, file_magic, sizeof(file_magic)) != 0
+       || load<uint32_t>(data + 8) != file_version) {
+        UTL_LOG_ERR("Not a metrics file: ", filename);
+        return std::nullopt;
+    }
+
+    const std::size_t header_size  = load<uint32_t>(data + 12);
+    const std::size_t column_count = load<uint32_t>(data + 16);
+    const std::size_t record_size  = load<uint32_t>(data + 20);
+
+    if(header_size < fixed_header_size + column_count * column_name_size || header_size > file_size || record_size < sample_size) {
+        UTL_LOG_ERR("Broken header of the metrics file: ", filename);
+        return std::nullopt;
+    }
+
+    metrics_reader_t res;
+    res.interval_   = std::chrono::milliseconds(load<int64_t>(data + 24));
+    res.start_time_ = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(load<int64_t>(data + 32))));
+
+    for(std::size_t i = 0; i < column_count; i++) {
+        auto name = reinterpret_cast<const char*>(data + fixed_header_size + i * column_name_size);
+        res.columns_.emplace_back(name, strnlen(name, column_name_size));
+    }
+
+    for(std::size_t pos = header_size; pos + record_size <= file_size; pos += record_size) {
+        const uint8_t* at     = data + pos;
+        const uint32_t column = load<uint32_t>(at);
+        if(column == 0) break;
+        if(column > column_count) {
+            UTL_LOG_WARN("Broken sample at byte ", pos, " of the metrics file, skipping the rest");
+            break;
+        }
+
+        metrics_sample_t sample;
+        sample.column = column - 1;
+        sample.time   = std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(load<int64_t>(at + 8))));
+        sample.value  = load<double>(at + 16);
+        res.samples_.push_back(sample);
+    }
+
+    return res;
+}
+
+void write_metrics_csv(const metrics_reader_t& metrics, std::ostream& out) {
+    // byte and frame rates of a large run don't fit the default 6 digits
+    const auto precision = out.precision(12);
+
+    out << "time,elapsed_s";
+    for(auto& column : metrics.columns()) {
+        out << ',' << column;
+    }
+    out << '\n';
+
+    const auto nan = std::numeric_limits<double>::quiet_NaN();
+    std::vector<double> row(metrics.columns().size(), nan);
+    std::optional<std::chrono::system_clock::time_point> row_time;
+
+    auto flush_row = [&]() {
+        if(!row_time) return;
+
+        write_utc(out, *row_time);
+        out << ',' << std::chrono::duration<double>(*row_time - metrics.start_time()).count();
+        for(auto& value : row) {
+            out << ',';
+            if(!std::isnan(value)) out << value;
+        }
+        out << '\n';
+
+        std::fill(row.begin(), row.end(), nan);
+    };
+
+    // the columns of an interval share its time stamp
+    for(auto& sample : metrics.samples()) {
+        if(sample.time != row_time) {
+            flush_row();
+            row_time = sample.time;
+        }
+        row[sample.column] = sample.value;
+    }
+    flush_row();
+
+    out.precision(precision);
+}
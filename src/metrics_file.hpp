@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// Time series of the client's counters, written with --metrics and turned into CSV by metrics-csv.
+//
+// File: a 64 byte header, the column names, 32 bytes each and zero padded, then samples of 24 bytes,
+// one per interval and column:
+//      u32 column        - 1-based index into the names, 0 - no more samples
+//      u32 reserved
+//      i64 microseconds since the Unix epoch, the same for every column of an interval
+//      f64 value         - NaN when there was nothing to measure, e.g. a percentile without samples
+// The column is stored last, so a sample cut short by a crash reads as the end of the file.
+
+// A sample of a metrics_reader_t
+struct metrics_sample_t {
+    uint32_t                              column = 0;  // 0-based
+    std::chrono::system_clock::time_point time;
+    double                                value = 0;
+};
+
+// Appends a row of samples per interval through a mapped chunk of the file. Rows come from one thread,
+// a chunk that is full is flushed in the background and the file grows by the next one.
+class metrics_writer_t {
+public:
+    static constexpr std::size_t max_column_name = 31;
+
+    // nullptr if the file can't be created or a column name is too long
+    static std::unique_ptr<metrics_writer_t> open(const std::string& filename, const std::vector<std::string>& columns,
+                                                  std::chrono::milliseconds interval, std::size_t chunk_rows = 4096);
+
+    ~metrics_writer_t();
+
+    // One value per column, stamped with the current time. false once the file can't grow
+    bool append(std::span<const double> values);
+
+    // Unmaps the chunk and cuts the file after the last sample
+    void close();
+
+    uint64_t rows() const { return rows_; }
+
+private:
+    metrics_writer_t(std::string filename, std::size_t header_size, std::size_t chunk_size)
+        : filename_(std::move(filename)), header_size_(header_size), chunk_size_(chunk_size) {}
+
+    bool map(uint64_t chunk);
+
+    std::string filename_;
+    std::size_t header_size_;
+    std::size_t chunk_size_;
+    std::size_t columns_ = 0;
+
+    boost::interprocess::file_mapping                    file_;
+    std::unique_ptr<boost::interprocess::mapped_region>  region_;
+    uint8_t*                                             base_  = nullptr;
+    uint64_t                                             chunk_ = 0;
+    std::size_t                                          used_  = 0;
+    uint64_t                                             rows_  = 0;
+};
+
+// Read side, the whole file is mapped and the samples are copied out
+class metrics_reader_t {
+public:
+    // nullopt if the file can't be opened or isn't a metrics file
+    static std::optional<metrics_reader_t> open(const std::string& filename);
+
+    const std::vector<std::string>& columns() const { return columns_; }
+    // every complete sample, in the order written
+    const std::vector<metrics_sample_t>& samples() const { return samples_; }
+
+    std::chrono::milliseconds interval() const { return interval_; }
+    std::chrono::system_clock::time_point start_time() const { return start_time_; }
+
+private:
+    std::vector<std::string>              columns_;
+    std::vector<metrics_sample_t>         samples_;
+    std::chrono::milliseconds             interval_{ 0 };
+    std::chrono::system_clock::time_point start_time_;
+};
+
+// One line per interval: "time,elapsed_s,<columns...>", time in UTC with milliseconds,
+// a NaN value is left empty
+void write_metrics_csv(const metrics_reader_t& metrics, std::ostream& out);
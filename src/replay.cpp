@@ -0,0 +1,272 @@
+#include "replay.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include "id_loader.hpp"
+#include "traffic_log.hpp"
+#include "util.hpp"
+#include "utl_log.hpp"
+
+namespace beast     = boost::beast;
+namespace http      = beast::http;
+namespace websocket = beast::websocket;
+namespace net       = boost::asio;
+
+using tcp = boost::asio::ip::tcp;
+
+namespace {
+
+// Failures are logged in any build, at most 20 a second
+constexpr utl::log::RateLimit replay_log_limit{1, 20};
+
+// What one device did in the recording
+struct replay_device_t {
+    uint64_t                              device_id = 0;
+    std::chrono::nanoseconds              first{ 0 };
+    std::chrono::nanoseconds              last{ 0 };
+    std::vector<const traffic_record_t*>  sends;
+    uint64_t                              recorded_messages = 0;
+};
+
+struct replay_stats_t {
+    std::atomic<uint64_t> connected{ 0 };
+    std::atomic<uint64_t> connect_errors{ 0 };
+    std::atomic<uint64_t> frames_sent{ 0 };
+    std::atomic<uint64_t> bytes_sent{ 0 };
+    std::atomic<uint64_t> write_errors{ 0 };
+    std::atomic<uint64_t> messages_received{ 0 };
+    std::atomic<uint64_t> read_errors{ 0 };
+};
+
+// Replay settings shared by every session
+struct replay_context_t {
+    std::string                           host;
+    std::string                           path;
+    tcp::resolver::results_type           endpoints;
+    std::chrono::steady_clock::time_point start;
+    // recorded time of the first record, the replay starts there
+    std::chrono::nanoseconds              origin{ 0 };
+    // 0 - as fast as possible
+    double                                speed = 1;
+    replay_stats_t                        stats;
+
+    std::chrono::steady_clock::time_point at(std::chrono::nanoseconds time) const {
+        if(speed <= 0) return start;
+        return start + std::chrono::duration_cast<std::chrono::steady_clock::duration>((time - origin) / speed);
+    }
+};
+
+// One device: connects at its first recorded message, writes its frames in order, each no earlier
+// than its scaled time, reads until it closes after its last recorded message
+class replay_session_t : public std::enable_shared_from_this<replay_session_t> {
+public:
+    replay_session_t(net::io_context& ioc, replay_context_t& context, const replay_device_t& device)
+        : context_(context), device_(device), ws_(net::make_strand(ioc)), timer_(ws_.get_executor()) {}
+
+    void run() {
+        wait_until(device_.first, [self = shared_from_this()] { self->connect(); });
+    }
+
+private:
+    template <class F>
+    void wait_until(std::chrono::nanoseconds time, F&& next) {
+        auto deadline = context_.at(time);
+        if(deadline <= std::chrono::steady_clock::now()) {
+            net::post(ws_.get_executor(), std::forward<F>(next));
+            return;
+        }
+        timer_.expires_at(deadline);
+        timer_.async_wait([next = std::forward<F>(next)](beast::error_code ec) {
+            if(!ec) next();
+        });
+    }
+
+    void connect() {
+        beast::get_lowest_layer(ws_).async_connect(context_.endpoints, [self = shared_from_this()](beast::error_code ec, const tcp::endpoint&) {
+            if(ec) return self->fail_connect(ec, "connect");
+            self->handshake();
+        });
+    }
+
+    void handshake() {
+        ws_.set_option(websocket::stream_base::decorator([id = format_device_id(device_.device_id)](websocket::request_type& req) {
+            req.set(http::field::user_agent, std::string(BOOST_BEAST_VERSION_STRING) + " websocket-client-replay");
+            req.set("DeviceID", id);
+            req.set("fw", "1.0.0");
+        }));
+        ws_.async_handshake(context_.host, context_.path, [self = shared_from_this()](beast::error_code ec) {
+            if(ec) return self->fail_connect(ec, "handshake");
+            self->context_.stats.connected++;
+            self->read();
+            self->send_next();
+        });
+    }
+
+    void fail_connect(beast::error_code ec, const char* what) {
+        context_.stats.connect_errors++;
+        UTL_LOG_LIMITED(WARN, replay_log_limit, "Replay ", what, " failed, ID: ", device_.device_id, " ", ec.message());
+    }
+
+    void read() {
+        ws_.async_read(buffer_, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if(ec) {
+                if(ec != websocket::error::closed && ec != net::error::operation_aborted && !self->closing_) {
+                    self->context_.stats.read_errors++;
+                    UTL_LOG_LIMITED(WARN, replay_log_limit, "Replay read failed, ID: ", self->device_.device_id, " ", ec.message());
+                }
+                return;
+            }
+            self->context_.stats.messages_received++;
+            self->buffer_.consume(self->buffer_.size());
+            self->read();
+        });
+    }
+
+    void send_next() {
+        if(next_ == device_.sends.size()) {
+            wait_until(device_.last, [self = shared_from_this()] { self->close(); });
+            return;
+        }
+        wait_until(device_.sends[next_]->time, [self = shared_from_this()] { self->write(); });
+    }
+
+    void write() {
+        auto& record = *device_.sends[next_++];
+        ws_.text(record.text);
+        ws_.async_write(net::buffer(record.data, record.size), [self = shared_from_this()](beast::error_code ec, std::size_t bytes) {
+            if(ec) {
+                self->context_.stats.write_errors++;
+                UTL_LOG_LIMITED(WARN, replay_log_limit, "Replay write failed, ID: ", self->device_.device_id, " ", ec.message());
+                return;
+            }
+            self->context_.stats.frames_sent++;
+            self->context_.stats.bytes_sent += bytes;
+            self->send_next();
+        });
+    }
+
+    void close() {
+        closing_ = true;
+        ws_.async_close(websocket::close_code::normal, [self = shared_from_this()](beast::error_code) {});
+    }
+
+    replay_context_t&                       context_;
+    const replay_device_t&                  device_;
+    websocket::stream<beast::tcp_stream>    ws_;
+    net::steady_timer                       timer_;
+    beast::flat_buffer                      buffer_;
+    std::size_t                             next_    = 0;
+    bool                                    closing_ = false;
+};
+
+}
+
+int run_replay(int argc, char** argv) {
+    if(argc < 6) {
+        std::cout << "Usage: ws-test-client replay <recording> <host> <path> <port> [--speed=<x>|max] [--threads=<n>]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto reader = traffic_reader_t::open(argv[2]);
+    if(!reader) {
+        return EXIT_FAILURE;
+    }
+
+    replay_context_t context;
+    context.host = argv[3];
+    context.path = argv[4];
+    long long threads = 1;
+
+    if(auto opt = get_option(argc, argv, 6, "speed")) {
+        context.speed = (*opt == "max") ? 0 : std::stod(std::string(*opt));
+        if(*opt != "max" && context.speed <= 0) {
+            std::cout << "Speed must be above 0 or max: " << *opt << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if(auto opt = get_option(argc, argv, 6, "threads")) {
+        threads = std::max(1ll, std::stoll(std::string(*opt)));
+    }
+
+    const auto& records = reader->records();
+    if(records.empty()) {
+        UTL_LOG_ERR("Nothing to replay in ", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    std::map<uint64_t, replay_device_t> devices;
+    uint64_t recorded_sends = 0, recorded_messages = 0;
+    for(auto& record : records) {
+        auto [it, inserted] = devices.try_emplace(record.device_id);
+        auto& device = it->second;
+        if(inserted) {
+            device.device_id = record.device_id;
+            device.first     = record.time;
+        }
+        device.last = record.time;
+        if(record.direction == traffic_direction_t::to_server) {
+            device.sends.push_back(&record);
+            recorded_sends++;
+        } else {
+            device.recorded_messages++;
+            recorded_messages++;
+        }
+    }
+
+    context.origin = records.front().time;
+    const auto span = records.back().time - records.front().time;
+
+    UTL_LOG_INFO("Replaying ", records.size(), " messages of ", devices.size(), " devices, recorded ",
+                 std::chrono::duration_cast<std::chrono::milliseconds>(span).count(), " ms, speed: ",
+                 context.speed > 0 ? std::to_string(context.speed) : std::string("max"));
+
+    std::vector<std::unique_ptr<net::io_context>> iocs;
+    for(long long i = 0; i < threads; i++) {
+        iocs.push_back(std::make_unique<net::io_context>(1));
+    }
+
+    beast::error_code ec;
+    context.endpoints = tcp::resolver(*iocs[0]).resolve(context.host, argv[5], ec);
+    if(ec) {
+        UTL_LOG_ERR("Failed to resolve ", context.host, ":", argv[5], " ", ec.message());
+        return EXIT_FAILURE;
+    }
+
+    context.start = std::chrono::steady_clock::now();
+
+    std::size_t i = 0;
+    for(auto& [id, device] : devices) {
+        std::make_shared<replay_session_t>(*iocs[i++ % iocs.size()], context, device)->run();
+    }
+
+    std::vector<std::thread> v;
+    for(auto& ioc : iocs) {
+        v.emplace_back([&ioc] { ioc->run(); });
+    }
+    for(auto& thread : v) {
+        thread.join();
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - context.start;
+    auto& stats = context.stats;
+
+    UTL_LOG_INFO("Replay done in ", std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), " ms (recorded ",
+                 std::chrono::duration_cast<std::chrono::milliseconds>(span).count(), " ms), devices connected: ", stats.connected.load(),
+                 "/", devices.size(), ", connect errors: ", stats.connect_errors.load(), ", frames sent: ", stats.frames_sent.load(),
+                 "/", recorded_sends, ", bytes: ", stats.bytes_sent.load(), ", write errors: ", stats.write_errors.load(),
+                 ", server messages: ", stats.messages_received.load(), " (recorded ", recorded_messages, "), read errors: ",
+                 stats.read_errors.load());
+
+    const bool ok = stats.connect_errors == 0 && stats.write_errors == 0 && stats.read_errors == 0
+                    && stats.frames_sent == recorded_sends;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
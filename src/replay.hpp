@@ -0,0 +1,6 @@
+#pragma once
+
+// "ws-test-client replay <recording> <host> <path> <port> [options]": connects every device of a
+// --record file and sends its frames with the recorded timing, scaled by --speed. Messages from the
+// server are counted against the recorded ones. Returns the process exit code.
+int run_replay(int argc, char** argv);
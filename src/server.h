@@ -15,96 +15,191 @@
 
 #include <algorithm>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#include <boost/beast/websocket.hpp>
 #include <boost/config.hpp>
+#include <charconv>
 #include <cstdlib>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
+#include "file_cache.hpp"
+#include "session_pool.hpp"
+#include "utl_log.hpp"
 #include "ws_client.h"
 
 #include <boost/json.hpp>
 
-namespace beast = boost::beast;         // from <boost/beast.hpp>
-namespace http  = beast::http;          // from <boost/beast/http.hpp>
-namespace net   = boost::asio;          // from <boost/asio.hpp>
-using tcp       = boost::asio::ip::tcp; // from <boost/asio/ip/tcp.hpp>
+namespace beast     = boost::beast;         // from <boost/beast.hpp>
+namespace http      = beast::http;          // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;     // from <boost/beast/websocket.hpp>
+namespace net       = boost::asio;          // from <boost/asio.hpp>
+using tcp           = boost::asio::ip::tcp; // from <boost/asio/ip/tcp.hpp>
 
-boost::json::object getWsClients(){
+// Devices upgrade on this path, as on the production backend
+constexpr std::string_view ws_device_path = "/socket-units-server/";
 
-    boost::json::object obj;
+// Commands the server sends to every device, an interval of 0 disables the command
+struct ws_schedule_t {
+    std::chrono::milliseconds main_payload_interval{ 0 };
+    std::chrono::milliseconds probes_interval{ 0 };
+};
+
+boost::json::object ws_client_json(ws_client_t const& client){
+
+    boost::json::object client_obj;
+
+    client_obj["device_id"] = client.device_id;
+    client_obj["fw"] = client.fw;
+    client_obj["remote"] = client.remote;
+    client_obj["connected"] = client.sessions > 0;
+    client_obj["connect_time"] = std::chrono::system_clock::to_time_t(client.connect_time);
+    client_obj["last_message"] = client.last_message;
+    client_obj["last_message_time"] = std::chrono::system_clock::to_time_t(client.last_message_time);
+    client_obj["frames_received"] = client.frames_received;
+    client_obj["bytes_received"] = client.bytes_received;
+    client_obj["commands_sent"] = client.commands_sent;
+    client_obj["malformed_messages"] = client.malformed_messages;
+    if(client.sequenced_frames > 0) {
+        client_obj["sequenced_frames"] = client.sequenced_frames;
+        client_obj["missing_frames"] = client.missing_frames;
+        client_obj["duplicate_frames"] = client.duplicate_frames;
+        client_obj["late_frames"] = client.late_frames;
+        client_obj["sequence_restarts"] = client.sequence_restarts;
+        client_obj["one_way_delay_avg_ms"] = static_cast<double>(client.one_way_delay_avg.count()) / 1e3;
+        client_obj["one_way_delay_max_ms"] = static_cast<double>(client.one_way_delay_max.count()) / 1e3;
+    }
+
+    return client_obj;
+}
+
+boost::json::object percentiles_json(histogram_counts_t const& histogram, double unit_us){
 
-    size_t count = 0;
-    for(auto& client : ws_clients){
-        boost::json::object client_obj;
+    boost::json::object obj;
 
-        client_obj["connect_time"] = std::chrono::system_clock::to_time_t(client.connect_time);
-        client_obj["last_message"] = client.last_message;
-        client_obj["last_message_time"] = std::chrono::system_clock::to_time_t(client.last_message_time);
-        obj[std::to_string(count++)] = client_obj;
+    obj["count"] = histogram.count();
+    for(double p : { 50.0, 90.0, 99.0 }) {
+        obj["p" + std::to_string(static_cast<int>(p))] = static_cast<double>(histogram.percentile(p).count()) / unit_us;
     }
 
     return obj;
 }
 
-// Return a reasonable mime type based on the extension of a file.
-beast::string_view mime_type(beast::string_view path) {
-    using beast::iequals;
-    auto const ext = [&path] {
-        auto const pos = path.rfind(".");
-        if(pos == beast::string_view::npos)
-            return beast::string_view{};
-        return path.substr(pos);
-    }();
-    if(iequals(ext, ".htm"))
-        return "text/html";
-    if(iequals(ext, ".html"))
-        return "text/html";
-    if(iequals(ext, ".php"))
-        return "text/html";
-    if(iequals(ext, ".css"))
-        return "text/css";
-    if(iequals(ext, ".txt"))
-        return "text/plain";
-    if(iequals(ext, ".js"))
-        return "application/javascript";
-    if(iequals(ext, ".json"))
-        return "application/json";
-    if(iequals(ext, ".xml"))
-        return "application/xml";
-    if(iequals(ext, ".swf"))
-        return "application/x-shockwave-flash";
-    if(iequals(ext, ".flv"))
-        return "video/x-flv";
-    if(iequals(ext, ".png"))
-        return "image/png";
-    if(iequals(ext, ".jpe"))
-        return "image/jpeg";
-    if(iequals(ext, ".jpeg"))
-        return "image/jpeg";
-    if(iequals(ext, ".jpg"))
-        return "image/jpeg";
-    if(iequals(ext, ".gif"))
-        return "image/gif";
-    if(iequals(ext, ".bmp"))
-        return "image/bmp";
-    if(iequals(ext, ".ico"))
-        return "image/vnd.microsoft.icon";
-    if(iequals(ext, ".tiff"))
-        return "image/tiff";
-    if(iequals(ext, ".tif"))
-        return "image/tiff";
-    if(iequals(ext, ".svg"))
-        return "image/svg+xml";
-    if(iequals(ext, ".svgz"))
-        return "image/svg+xml";
-    return "application/text";
+boost::json::object ws_server_summary_json(){
+
+    auto summary = ws_server_stats.summary();
+
+    boost::json::object obj;
+
+    obj["known_devices"] = summary.known_devices;
+    obj["connected_devices"] = summary.connected_devices;
+    obj["active_sessions"] = summary.active_sessions;
+    obj["connections"] = summary.connections;
+    obj["handshake_errors"] = summary.handshake_errors;
+    obj["frames_received"] = summary.frames_received;
+    obj["bytes_received"] = summary.bytes_received;
+    obj["commands_sent"] = summary.commands_sent;
+    obj["malformed_messages"] = summary.malformed_messages;
+    obj["frame_interval_ms"] = percentiles_json(summary.frame_interval, 1e3);
+    obj["session_duration_s"] = percentiles_json(summary.session_duration, 1e6);
+    obj["sequenced_frames"] = summary.sequenced_frames;
+    obj["missing_frames"] = summary.missing_frames;
+    obj["duplicate_frames"] = summary.duplicate_frames;
+    obj["late_frames"] = summary.late_frames;
+    obj["sequence_restarts"] = summary.sequence_restarts;
+    obj["one_way_delay_ms"] = percentiles_json(summary.one_way_delay, 1e3);
+
+    return obj;
+}
+
+// Query of "/get_clients?cursor=<n>&limit=<n>&state=all|connected|disconnected&min_idle=<s>&max_idle=<s>"
+struct clients_query_t {
+    enum class state_t { all, connected, disconnected };
+
+    uint64_t cursor = 0;
+    // 0 - every client after the cursor
+    std::size_t limit = 1000;
+    state_t state = state_t::all;
+    std::optional<std::chrono::seconds> min_idle;
+    std::optional<std::chrono::seconds> max_idle;
+
+    bool matches(ws_client_entry_t const& client, std::chrono::system_clock::time_point now) const {
+        bool connected = client.sessions.load(std::memory_order_relaxed) > 0;
+        if(state == state_t::connected && !connected) return false;
+        if(state == state_t::disconnected && connected) return false;
+        if(min_idle || max_idle) {
+            auto idle = client.idle(now);
+            if(min_idle && idle < *min_idle) return false;
+            if(max_idle && idle > *max_idle) return false;
+        }
+        return true;
+    }
+};
+
+// Value of "name=value" in the query part of a request target
+std::optional<std::string_view> query_param(std::string_view target, std::string_view name) {
+    auto question = target.find('?');
+    if(question == std::string_view::npos) return std::nullopt;
+
+    auto query = target.substr(question + 1);
+    while(!query.empty()) {
+        auto amp   = query.find('&');
+        auto param = query.substr(0, amp);
+        query      = (amp == std::string_view::npos) ? std::string_view{} : query.substr(amp + 1);
+
+        if(param.starts_with(name) && param.substr(name.size()).starts_with('=')) {
+            return param.substr(name.size() + 1);
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<clients_query_t> parse_clients_query(std::string_view target) {
+    clients_query_t query;
+
+    auto number = [&](std::string_view name, auto& value) {
+        auto param = query_param(target, name);
+        if(!param) return true;
+        uint64_t parsed = 0;
+        auto [end, ec] = std::from_chars(param->data(), param->data() + param->size(), parsed);
+        if(ec != std::errc{} || end != param->data() + param->size()) return false;
+        value = static_cast<std::remove_reference_t<decltype(value)>>(parsed);
+        return true;
+    };
+    auto seconds = [&](std::string_view name, std::optional<std::chrono::seconds>& value) {
+        uint64_t parsed = 0;
+        if(!query_param(target, name)) return true;
+        if(!number(name, parsed)) return false;
+        value = std::chrono::seconds(parsed);
+        return true;
+    };
+
+    if(!number("cursor", query.cursor) || !number("limit", query.limit) || !seconds("min_idle", query.min_idle)
+       || !seconds("max_idle", query.max_idle)) {
+        return std::nullopt;
+    }
+
+    if(auto state = query_param(target, "state")) {
+        if(*state == "connected") query.state = clients_query_t::state_t::connected;
+        else if(*state == "disconnected") query.state = clients_query_t::state_t::disconnected;
+        else if(*state != "all") return std::nullopt;
+    }
+
+    return query;
 }
 
 // Append an HTTP rel-path to a local filesystem path.
@@ -178,13 +273,13 @@ handle_request(beast::string_view doc_root, http::request<Body, http::basic_fiel
     if(req.target().empty() || req.target()[0] != '/' || req.target().find("..") != beast::string_view::npos)
         return bad_request("Illegal request-target");
 
-    if(req.target() == "/get_clients"){
+    // "/get_clients" itself is streamed by the http_session
+    if(req.target() == "/get_clients/summary"){
         http::response<http::string_body> res{ http::status::ok, req.version() };
         res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-        res.set(http::field::content_type, "text/html");
+        res.set(http::field::content_type, "application/json");
         res.keep_alive(req.keep_alive());
-        auto clients = getWsClients();
-        res.body() = boost::json::serialize(clients);
+        res.body() = boost::json::serialize(ws_server_summary_json());
         res.prepare_payload();
         return res;
     }
@@ -237,40 +332,260 @@ void fail(beast::error_code ec, char const* what) {
     std::cerr << what << ": " << ec.message() << "\n";
 }
 
+class http_session;
+class ws_session;
+
+// One io_context run by one thread, with the sessions of the connections it accepted.
+// Sessions are recycled through the pools, so connection churn doesn't go to the heap.
+struct server_shard_t {
+    server_shard_t(bool recycle_sessions, std::shared_ptr<std::string const> doc_root, ws_schedule_t schedule,
+                   std::shared_ptr<file_cache_t> file_cache)
+        : doc_root(std::move(doc_root)), schedule(schedule), file_cache(std::move(file_cache)),
+          http_sessions(recycle_sessions), ws_sessions(recycle_sessions) {}
+
+    // Frees the idle sessions. The io_context is destroyed next and frees the sessions its handlers still hold,
+    // so the pools are declared before it.
+    ~server_shard_t();
+
+    std::shared_ptr<std::string const> doc_root;
+    ws_schedule_t schedule;
+    std::shared_ptr<file_cache_t> file_cache;
+
+    session_pool_t<http_session> http_sessions;
+    session_pool_t<ws_session> ws_sessions;
+
+    net::io_context ioc{ 1 };
+};
+
+// Handles a device connection after the upgrade: counts the frames the device sends
+// and sends it the "main_payload"/"get_probes" commands on the schedule
+class ws_session : public pooled_session_t<ws_session>
+{
+    server_shard_t& shard_;
+    websocket::stream<beast::tcp_stream> ws_;
+    beast::flat_buffer buffer_;
+    net::steady_timer timer_;
+    std::string device_id_;
+    std::string fw_;
+    // registry entry, set once the upgrade is accepted
+    ws_client_ptr_t client_;
+
+    std::chrono::steady_clock::time_point next_main_payload_;
+    std::chrono::steady_clock::time_point next_probes_;
+
+    // commands due but not written yet, one write is in flight at a time
+    std::vector<std::string_view> pending_;
+    bool writing_ = false;
+
+    public:
+    explicit ws_session(server_shard_t& shard)
+        : shard_(shard), ws_(shard.ioc), timer_(shard.ioc) {
+        ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+        ws_.set_option(websocket::stream_base::decorator([](websocket::response_type& res) {
+            res.set(http::field::server, BOOST_BEAST_VERSION_STRING " ws-test-server");
+        }));
+    }
+
+    // Accept the upgrade request read by the http_session, the request only has to live through this call
+    template <class Fields>
+    void run(tcp::socket&& socket, http::request<http::string_body, Fields> const& req) {
+        beast::get_lowest_layer(ws_).socket() = std::move(socket);
+
+        device_id_.assign(req["DeviceID"]);
+        fw_.assign(req["fw"]);
+
+        ws_.async_accept(req, beast::bind_front_handler(&ws_session::on_accept, self()));
+    }
+
+    // Back to the pool, the stream, timer and buffers are kept for the next connection
+    void recycle() {
+        beast::error_code ec;
+        beast::get_lowest_layer(ws_).socket().close(ec);
+        buffer_.clear();
+        beast::get_lowest_layer(ws_).expires_never();
+        pending_.clear();
+        writing_ = false;
+        client_.reset();
+    }
+
+    private:
+    void on_accept(beast::error_code ec) {
+        if(ec) {
+            ws_server_stats.on_handshake_error();
+            return fail(ec, "ws accept");
+        }
+
+        beast::error_code remote_ec;
+        auto remote = beast::get_lowest_layer(ws_).socket().remote_endpoint(remote_ec);
+
+        client_ = ws_clients.connect(device_id_, fw_, remote_ec ? std::string("?") : remote.address().to_string() + ':' + std::to_string(remote.port()));
+
+        auto now = std::chrono::steady_clock::now();
+        next_main_payload_ = now + shard_.schedule.main_payload_interval;
+        next_probes_ = now + shard_.schedule.probes_interval;
+        schedule_timer();
+
+        do_read();
+    }
+
+    void do_read() {
+        ws_.async_read(buffer_, beast::bind_front_handler(&ws_session::on_read, self()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t bytes_transferred) {
+        boost::ignore_unused(bytes_transferred);
+
+        if(ec) {
+            // closed by the device or dropped, either way the session ends here
+            if(ec != websocket::error::closed && ec != net::error::eof && ec != net::error::operation_aborted) {
+                UTL_LOG_DWARN("Device read error: ", ec.message(), " ID: ", device_id_);
+            }
+            return do_close();
+        }
+
+        auto data = buffer_.cdata();
+        if(auto error = client_->on_message(data.data(), data.size()); error != frame_error_t::none) {
+            UTL_LOG_DWARN("Malformed device frame: ", to_string(error), ", ", data.size(), " bytes, ID: ", device_id_);
+        }
+        buffer_.consume(buffer_.size());
+
+        do_read();
+    }
+
+    void schedule_timer() {
+        const auto never = std::chrono::steady_clock::time_point::max();
+        auto const& schedule = shard_.schedule;
+        auto wake_up = std::min(schedule.main_payload_interval.count() > 0 ? next_main_payload_ : never,
+                                schedule.probes_interval.count() > 0 ? next_probes_ : never);
+        if(wake_up == never) return;
+
+        timer_.expires_at(wake_up);
+        timer_.async_wait(beast::bind_front_handler(&ws_session::on_timer, self()));
+    }
+
+    void on_timer(beast::error_code ec) {
+        if(ec || !ws_.is_open()) return;
+
+        auto const& schedule = shard_.schedule;
+        auto now = std::chrono::steady_clock::now();
+        if(schedule.main_payload_interval.count() > 0 && now >= next_main_payload_) {
+            pending_.push_back("main_payload");
+            next_main_payload_ = now + schedule.main_payload_interval;
+        }
+        if(schedule.probes_interval.count() > 0 && now >= next_probes_) {
+            pending_.push_back("get_probes");
+            next_probes_ = now + schedule.probes_interval;
+        }
+
+        if(!writing_) do_write();
+        schedule_timer();
+    }
+
+    void do_write() {
+        if(pending_.empty()) return;
+
+        writing_ = true;
+        ws_.text(true);
+        ws_.async_write(net::buffer(pending_.front().data(), pending_.front().size()),
+                        beast::bind_front_handler(&ws_session::on_write, self()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t bytes_transferred) {
+        boost::ignore_unused(bytes_transferred);
+
+        writing_ = false;
+        if(ec) return;
+
+        client_->commands_sent.fetch_add(1, std::memory_order_relaxed);
+        ws_server_stats.on_command();
+        pending_.erase(pending_.begin());
+        do_write();
+    }
+
+    void do_close() {
+        timer_.cancel();
+        if(client_) {
+            ws_clients.disconnect(client_);
+            client_.reset();
+        }
+    }
+};
+
 // Handles an HTTP server connection
-class http_session : public std::enable_shared_from_this<http_session>
+class http_session : public pooled_session_t<http_session>
 {
+    server_shard_t& shard_;
     beast::tcp_stream stream_;
     beast::flat_buffer buffer_;
-    std::shared_ptr<std::string const> doc_root_;
-    http::request<http::string_body> req_;
+
+    // header fields of the request are allocated from the arena
+    using request_t = http::request<http::string_body, http::basic_fields<arena_allocator_t<char>>>;
+    request_arena_t arena_;
+    request_t req_;
+
+    // file being served from the cache, keeps its pre-serialized responses alive during the write
+    cached_file_ptr_t file_;
+#if defined(__linux__)
+    int file_fd_ = -1;
+    off_t file_offset_ = 0;
+#endif
+
+    // "/get_clients" goes out as a chunked response, a few pages of clients per chunk,
+    // so the whole list never sits in memory at once
+    http::response<http::empty_body> clients_res_;
+    std::optional<http::response_serializer<http::empty_body>> clients_sr_;
+    clients_query_t clients_query_;
+    std::size_t clients_written_ = 0;
+    bool clients_done_ = false;
+    std::string chunk_;
 
     public:
-    // Take ownership of the stream
-    http_session(tcp::socket&& socket, std::shared_ptr<std::string const> const& doc_root)
-        : stream_(std::move(socket)), doc_root_(doc_root) {}
+    explicit http_session(server_shard_t& shard)
+        : shard_(shard), stream_(shard.ioc) {}
 
-    // Start the asynchronous operation
-    void run() {
-        // We need to be executing within a strand to perform async operations
-        // on the I/O objects in this session. Although not strictly necessary
-        // for single-threaded contexts, this example code is written to be
-        // thread-safe by default.
-        net::dispatch(stream_.get_executor(),
-                      beast::bind_front_handler(&http_session::do_read, shared_from_this()));
+#if defined(__linux__)
+    ~http_session() {
+        if(file_fd_ >= 0)
+            ::close(file_fd_);
+    }
+#endif
+
+    // Start the asynchronous operation, called on the thread of the shard
+    void run(tcp::socket&& socket) {
+        // Take ownership of the socket
+        stream_.socket() = std::move(socket);
+        do_read();
+    }
+
+    // Back to the pool, the stream and buffers are kept for the next connection
+    void recycle() {
+#if defined(__linux__)
+        if(file_fd_ >= 0) {
+            ::close(file_fd_);
+            file_fd_ = -1;
+        }
+#endif
+        file_.reset();
+        clients_sr_.reset();
+        chunk_.clear();
+
+        beast::error_code ec;
+        stream_.socket().close(ec);
+        stream_.expires_never();
+        buffer_.clear();
     }
 
     void do_read() {
         // Make the request empty before reading,
         // otherwise the operation behavior is undefined.
-        req_ = {};
+        req_ = request_t(std::piecewise_construct, std::make_tuple(), std::make_tuple(arena_allocator_t<char>(arena_)));
 
         // Set the timeout.
         stream_.expires_after(std::chrono::seconds(30));
 
         // Read a request
         http::async_read(stream_, buffer_, req_,
-                         beast::bind_front_handler(&http_session::on_read, shared_from_this()));
+                         beast::bind_front_handler(&http_session::on_read, self()));
     }
 
     void on_read(beast::error_code ec, std::size_t bytes_transferred) {
@@ -283,8 +598,38 @@ class http_session : public std::enable_shared_from_this<http_session>
         if(ec)
             return fail(ec, "read");
 
+        // Devices upgrade to a websocket, the session takes over the socket
+        if(websocket::is_upgrade(req_) && std::string_view(req_.target()).starts_with(ws_device_path)) {
+            stream_.expires_never();
+            auto session = shard_.ws_sessions.acquire([this] { return std::make_unique<ws_session>(shard_); });
+            session->run(stream_.release_socket(), req_);
+            return;
+        }
+
+        auto target = std::string_view(req_.target());
+        if(req_.method() == http::verb::get && target.substr(0, target.find('?')) == "/get_clients")
+            return start_clients_stream();
+
+        // Static files go out pre-serialized from the cache, anything it can't serve takes the generic path
+        if((req_.method() == http::verb::get || req_.method() == http::verb::head) && req_.version() == 11
+           && target.starts_with('/') && target.find("..") == std::string_view::npos
+           && target.find('?') == std::string_view::npos) {
+            std::string path = path_cat(*shard_.doc_root, req_.target());
+            if(target.back() == '/')
+                path.append("index.html");
+
+            auto file = shard_.file_cache->get(path);
+#if !defined(__linux__)
+            // no sendfile, large files are streamed by file_body
+            if(file && !file->in_memory)
+                file = nullptr;
+#endif
+            if(file)
+                return send_cached_file(std::move(file));
+        }
+
         // Send the response
-        send_response(handle_request(*doc_root_, std::move(req_)));
+        send_response(handle_request(*shard_.doc_root, std::move(req_)));
     }
 
     void send_response(http::message_generator&& msg) {
@@ -292,7 +637,7 @@ class http_session : public std::enable_shared_from_this<http_session>
 
         // Write the response
         beast::async_write(stream_, std::move(msg),
-                           beast::bind_front_handler(&http_session::on_write, shared_from_this(), keep_alive));
+                           beast::bind_front_handler(&http_session::on_write, self(), keep_alive));
     }
 
     void on_write(bool keep_alive, beast::error_code ec, std::size_t bytes_transferred) {
@@ -311,6 +656,161 @@ class http_session : public std::enable_shared_from_this<http_session>
         do_read();
     }
 
+    void send_cached_file(cached_file_ptr_t file) {
+        const bool keep_alive = req_.keep_alive();
+        const bool not_modified = file->matches(std::string_view(req_[http::field::if_none_match]));
+        const bool head = req_.method() == http::verb::head;
+
+        auto& response = not_modified ? file->not_modified[keep_alive] : file->ok[keep_alive];
+        const std::size_t size = (!not_modified && head) ? file->header_size[keep_alive] : response.size();
+        const bool body_from_file = !not_modified && !head && !file->in_memory;
+
+        file_ = std::move(file);
+
+        // small files are one write of header and body
+        net::async_write(stream_, net::buffer(response.data(), size),
+                         beast::bind_front_handler(&http_session::on_cached_file, self(), keep_alive, body_from_file));
+    }
+
+    void on_cached_file(bool keep_alive, bool body_from_file, beast::error_code ec, std::size_t bytes_transferred) {
+        if(ec || !body_from_file) {
+            file_.reset();
+            return on_write(keep_alive, ec, bytes_transferred);
+        }
+
+#if defined(__linux__)
+        file_fd_ = ::open(file_->path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(file_fd_ < 0) {
+            // the header promised a body, the connection can't be reused
+            fail(beast::error_code(errno, beast::system_category()), "open");
+            file_.reset();
+            return do_close();
+        }
+        file_offset_ = 0;
+        stream_.socket().native_non_blocking(true);
+        do_sendfile(keep_alive);
+#endif
+    }
+
+#if defined(__linux__)
+    // Large files go from the page cache to the socket with sendfile, without passing through user space
+    void do_sendfile(bool keep_alive) {
+        const auto size = static_cast<off_t>(file_->size);
+        while(file_offset_ < size) {
+            auto sent = ::sendfile(stream_.socket().native_handle(), file_fd_, &file_offset_, size - file_offset_);
+            if(sent > 0 || (sent < 0 && errno == EINTR))
+                continue;
+
+            if(sent < 0 && errno == EAGAIN) {
+                stream_.socket().async_wait(tcp::socket::wait_write,
+                                            beast::bind_front_handler(&http_session::on_sendfile_ready, self(), keep_alive));
+                return;
+            }
+
+            // error, or the file got shorter than the Content-Length sent
+            fail(beast::error_code(sent < 0 ? errno : EIO, beast::system_category()), "sendfile");
+            finish_sendfile();
+            return do_close();
+        }
+
+        finish_sendfile();
+        on_write(keep_alive, {}, static_cast<std::size_t>(size));
+    }
+
+    void on_sendfile_ready(bool keep_alive, beast::error_code ec) {
+        if(ec) {
+            finish_sendfile();
+            return fail(ec, "sendfile");
+        }
+        do_sendfile(keep_alive);
+    }
+
+    void finish_sendfile() {
+        ::close(file_fd_);
+        file_fd_ = -1;
+        file_.reset();
+    }
+#endif
+
+    void start_clients_stream() {
+        auto query = parse_clients_query(req_.target());
+        if(!query) {
+            http::response<http::string_body> res{ http::status::bad_request, req_.version() };
+            res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+            res.set(http::field::content_type, "text/html");
+            res.keep_alive(req_.keep_alive());
+            res.body() = "Bad query, expected cursor, limit, state=all|connected|disconnected, min_idle, max_idle";
+            res.prepare_payload();
+            return send_response(std::move(res));
+        }
+
+        clients_query_ = *query;
+        clients_written_ = 0;
+        clients_done_ = false;
+
+        clients_res_ = { http::status::ok, req_.version() };
+        clients_res_.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        clients_res_.set(http::field::content_type, "application/json");
+        clients_res_.keep_alive(req_.keep_alive());
+        clients_res_.chunked(true);
+        clients_sr_.emplace(clients_res_);
+
+        http::async_write_header(stream_, *clients_sr_,
+                                 beast::bind_front_handler(&http_session::on_clients_header, self()));
+    }
+
+    void on_clients_header(beast::error_code ec, std::size_t bytes_transferred) {
+        boost::ignore_unused(bytes_transferred);
+
+        if(ec)
+            return fail(ec, "write");
+
+        chunk_ = "{\"clients\":[";
+        write_clients_chunk();
+    }
+
+    void write_clients_chunk() {
+        constexpr std::size_t chunk_size = 16 * 1024;
+        constexpr std::size_t page_size = 256;
+
+        const auto now = std::chrono::system_clock::now();
+        auto filter = [&](ws_client_entry_t const& client) { return clients_query_.matches(client, now); };
+
+        while(!clients_done_ && chunk_.size() < chunk_size) {
+            auto left = clients_query_.limit > 0 ? clients_query_.limit - clients_written_ : page_size;
+            for(auto& client : ws_clients.page(clients_query_.cursor, std::min(left, page_size), filter)) {
+                if(clients_written_++ > 0) chunk_ += ',';
+                chunk_ += boost::json::serialize(ws_client_json(client->snapshot()));
+            }
+
+            bool at_end = clients_query_.cursor >= ws_clients.size();
+            if(at_end || (clients_query_.limit > 0 && clients_written_ >= clients_query_.limit)) {
+                chunk_ += "],\"next_cursor\":";
+                chunk_ += at_end ? std::string("null") : std::to_string(clients_query_.cursor);
+                chunk_ += '}';
+                clients_done_ = true;
+            }
+        }
+
+        stream_.expires_after(std::chrono::seconds(30));
+        net::async_write(stream_, http::make_chunk(net::buffer(chunk_)),
+                         beast::bind_front_handler(&http_session::on_clients_chunk, self()));
+    }
+
+    void on_clients_chunk(beast::error_code ec, std::size_t bytes_transferred) {
+        boost::ignore_unused(bytes_transferred);
+
+        if(ec)
+            return fail(ec, "write");
+
+        chunk_.clear();
+        if(!clients_done_)
+            return write_clients_chunk();
+
+        net::async_write(stream_, http::make_chunk_last(),
+                         beast::bind_front_handler(&http_session::on_write, self(), clients_res_.keep_alive()));
+    }
+
     void do_close() {
         // Send a TCP shutdown
         beast::error_code ec;
@@ -322,99 +822,125 @@ class http_session : public std::enable_shared_from_this<http_session>
 
 //------------------------------------------------------------------------------
 
-// Accepts incoming connections and launches the sessions
+#if defined(SO_REUSEPORT)
+// Every shard binds its own acceptor to the port, the kernel spreads new connections over them
+using reuse_port = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+inline server_shard_t::~server_shard_t() {
+    http_sessions.shutdown();
+    ws_sessions.shutdown();
+}
+
+// Start an HTTP session for a socket accepted on the io_context of the shard, on the thread of the shard
+inline void start_http_session(server_shard_t& shard, tcp::socket&& socket) {
+    auto session = shard.http_sessions.acquire([&shard] { return std::make_unique<http_session>(shard); });
+    session->run(std::move(socket));
+}
+
+// Accepts incoming connections and launches the sessions.
+// Sessions run on one of the shards, round-robin, and stay there. With an SO_REUSEPORT
+// listener per shard that is just the listener's own shard.
 class http_listener : public std::enable_shared_from_this<http_listener>
 {
     net::io_context& ioc_;
     tcp::acceptor acceptor_;
-    std::shared_ptr<std::string const> doc_root_;
+    std::vector<server_shard_t*> shards_;
+    std::size_t next_shard_ = 0;
 
     public:
-    http_listener(net::io_context& ioc, tcp::endpoint endpoint, std::shared_ptr<std::string const> const& doc_root)
-        : ioc_(ioc), acceptor_(net::make_strand(ioc)), doc_root_(doc_root) {
+    http_listener(net::io_context& ioc, tcp::endpoint endpoint, bool reuse_port_enabled,
+                  std::vector<server_shard_t*> shards)
+        : ioc_(ioc), acceptor_(ioc), shards_(std::move(shards)) {
         beast::error_code ec;
 
         // Open the acceptor
         acceptor_.open(endpoint.protocol(), ec);
         if(ec) {
-            fail(ec, "open");
+            fail_setup(ec, "open");
             return;
         }
 
         // Allow address reuse
         acceptor_.set_option(net::socket_base::reuse_address(true), ec);
         if(ec) {
-            fail(ec, "set_option");
+            fail_setup(ec, "set_option");
             return;
         }
 
+#if defined(SO_REUSEPORT)
+        if(reuse_port_enabled) {
+            acceptor_.set_option(reuse_port(true), ec);
+            if(ec) {
+                fail_setup(ec, "set_option SO_REUSEPORT");
+                return;
+            }
+        }
+#else
+        boost::ignore_unused(reuse_port_enabled);
+#endif
+
         // Bind to the server address
         acceptor_.bind(endpoint, ec);
         if(ec) {
-            fail(ec, "bind");
+            fail_setup(ec, "bind");
             return;
         }
 
         // Start listening for connections
         acceptor_.listen(net::socket_base::max_listen_connections, ec);
         if(ec) {
-            fail(ec, "listen");
+            fail_setup(ec, "listen");
             return;
         }
     }
 
+    // false when any setup step failed, the acceptor is closed then
+    bool is_open() const {
+        return acceptor_.is_open();
+    }
+
     // Start accepting incoming connections
     void run() {
         do_accept();
     }
 
     private:
+    void fail_setup(beast::error_code ec, char const* what) {
+        fail(ec, what);
+        beast::error_code ignored;
+        acceptor_.close(ignored);
+    }
+
     void do_accept() {
-        // The new connection gets its own strand
-        acceptor_.async_accept(net::make_strand(ioc_),
-                               beast::bind_front_handler(&http_listener::on_accept, shared_from_this()));
+        // Each io_context is run by a single thread, sessions need no strand
+        auto& shard = *shards_[next_shard_++ % shards_.size()];
+        acceptor_.async_accept(shard.ioc, beast::bind_front_handler(&http_listener::on_accept, shared_from_this(), std::ref(shard)));
     }
 
-    void on_accept(beast::error_code ec, tcp::socket socket) {
+    void on_accept(server_shard_t& shard, beast::error_code ec, tcp::socket socket) {
         if(ec) {
+            if(ec == net::error::operation_aborted || !acceptor_.is_open())
+                return; // To avoid infinite loop
+            // the acceptor is unusable, re-arming would fail again at once
+            if(ec == net::error::invalid_argument || ec == net::error::bad_descriptor) {
+                fail(ec, "accept");
+                return;
+            }
+            // out of descriptors or a connection reset before the accept, keep listening
             fail(ec, "accept");
-            return; // To avoid infinite loop
         } else {
-            // Create the session and run it
-            std::make_shared<http_session>(std::move(socket), doc_root_)->run();
+            // The pools of a shard are only touched by its own thread
+            if(&shard.ioc == &ioc_) {
+                start_http_session(shard, std::move(socket));
+            } else {
+                net::post(shard.ioc, [&shard, socket = std::move(socket)]() mutable {
+                    start_http_session(shard, std::move(socket));
+                });
+            }
         }
 
         // Accept another connection
         do_accept();
     }
 };
-
-//------------------------------------------------------------------------------
-
-// int main(int argc, char* argv[]) {
-//     // Check command line arguments.
-//     if(argc != 5) {
-//         std::cerr << "Usage: http-server-async <address> <port> <doc_root> <threads>\n"
-//                   << "Example:\n"
-//                   << "    http-server-async 0.0.0.0 8080 . 1\n";
-//         return EXIT_FAILURE;
-//     }
-//     auto const address  = net::ip::make_address(argv[1]);
-//     auto const port     = static_cast<unsigned short>(std::atoi(argv[2]));
-//     auto const doc_root = std::make_shared<std::string>(argv[3]);
-//     auto const threads  = std::max<int>(1, std::atoi(argv[4]));
-
-//     // The io_context is required for all I/O
-//     net::io_context ioc{ threads };
-
-//     // Create and launch a listening port
-//     std::make_shared<http_listener>(ioc, tcp::endpoint{ address, port }, doc_root)->run();
-
-//     // Run the I/O service on the requested number of threads
-//     std::vector<std::thread> v;
-//     v.reserve(threads - 1);
-//     for(auto i = threads - 1; i > 0; --i) v.emplace_back([&ioc] { ioc.run(); });
-//     ioc.run();
-
-//     return EXIT_SUCCESS;
-// }
\ No newline at end of file
@@ -0,0 +1,270 @@
+//------------------------------------------------------------------------------
+//
+// Local stand-in for the device server: accepts device websockets on
+// /socket-units-server/, sends them commands on a schedule and counts
+// what they send, so the client can be measured without the backend.
+//
+//------------------------------------------------------------------------------
+
+#include <boost/asio/signal_set.hpp>
+#include <cstring>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "server.h"
+#include "util.hpp"
+
+namespace {
+
+void print_usage() {
+    std::cout << "Usage: ws-test-server <address> <port> <doc-root> <threads> [options]\n"
+              << "      threads - I/O threads, each with its own io_context and acceptor, 0 - one per core\n"
+              << "Options:\n"
+              << "      --main-interval=<s>         send \"main_payload\" to every device every <s> seconds, 0 - never (default 30)\n"
+              << "      --probes-interval=<s>       send \"get_probes\" to every device every <s> seconds, 0 - never (default 0)\n"
+              << "      --stats-interval=<s>        log connection and frame counters every <s> seconds, 0 - never (default 10)\n"
+              << "      --duration=<s>              stop after <s> seconds, 0 - run until SIGINT/SIGTERM (default 0)\n"
+              << "      --pin-threads=on|off        pin I/O thread k to CPU k (Linux, default off)\n"
+              << "      --session-pool=on|off       reuse session objects of closed connections, off - allocate per connection (default on)\n"
+              << "Example:\n"
+              << "      ws-test-server 0.0.0.0 81 . 0 --main-interval=30 --probes-interval=60\n"
+              << "      ws-test-client 127.0.0.1 /socket-units-server/ 81 30 10 4 no-bad events ids.txt"
+              << std::endl;
+}
+
+void log_counters(ws_server_summary_t& last, std::chrono::steady_clock::duration elapsed) {
+    auto now = ws_server_stats.summary();
+
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    auto rate    = [&](uint64_t total, uint64_t before) {
+        return seconds > 0 ? static_cast<uint64_t>((total - before) / seconds) : 0;
+    };
+
+    UTL_LOG_INFO("Devices connected: ", now.connected_devices, ", known: ", now.known_devices, ", connections: ", now.connections,
+                 ", handshake errors: ", now.handshake_errors, ", frames: ", now.frames_received,
+                 " (", rate(now.frames_received, last.frames_received), "/s), bytes: ", now.bytes_received, " (",
+                 rate(now.bytes_received, last.bytes_received), " B/s), commands sent: ", now.commands_sent,
+                 ", malformed: ", now.malformed_messages, ", frame interval p50/p99: ", now.frame_interval.percentile(50).count() / 1000, "/",
+                 now.frame_interval.percentile(99).count() / 1000, " ms");
+
+    if(now.sequenced_frames > 0) {
+        UTL_LOG_INFO("Sequenced frames: ", now.sequenced_frames, ", missing: ", now.missing_frames, ", duplicates: ", now.duplicate_frames,
+                     ", late: ", now.late_frames, ", restarts: ", now.sequence_restarts, ", one-way delay p50/p99: ",
+                     now.one_way_delay.percentile(50).count() / 1000.0, "/", now.one_way_delay.percentile(99).count() / 1000.0, " ms");
+    }
+
+    last = std::move(now);
+}
+
+// Devices whose sequence numbers showed lost, repeated or reordered frames, the worst ones by name
+void log_sequence_report(std::size_t limit) {
+    std::vector<ws_client_t> affected;
+    for(auto& client : ws_clients.snapshot()) {
+        if(client.missing_frames + client.duplicate_frames + client.late_frames > 0) {
+            affected.push_back(std::move(client));
+        }
+    }
+    if(affected.empty()) return;
+
+    std::sort(affected.begin(), affected.end(), [](const ws_client_t& a, const ws_client_t& b) {
+        return a.missing_frames + a.duplicate_frames + a.late_frames > b.missing_frames + b.duplicate_frames + b.late_frames;
+    });
+
+    UTL_LOG_WARN("Devices with missing, duplicate or late frames: ", affected.size());
+    for(std::size_t i = 0; i < std::min(limit, affected.size()); i++) {
+        auto& client = affected[i];
+        UTL_LOG_WARN("  ", client.device_id, ": sequenced ", client.sequenced_frames, ", missing ", client.missing_frames,
+                     ", duplicates ", client.duplicate_frames, ", late ", client.late_frames, ", restarts ", client.sequence_restarts,
+                     ", one-way delay avg/max ", client.one_way_delay_avg.count() / 1000.0, "/",
+                     client.one_way_delay_max.count() / 1000.0, " ms");
+    }
+}
+
+void pin_to_cpu(std::thread& thread, unsigned cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(int err = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set); err != 0) {
+        UTL_LOG_WARN("Failed to pin an I/O thread to CPU ", cpu, ": ", std::strerror(err));
+    }
+#else
+    boost::ignore_unused(thread, cpu);
+#endif
+}
+}
+
+int main(int argc, char** argv) {
+    if(argc < 5) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    long long main_interval   = 30;
+    long long probes_interval = 0;
+    long long stats_interval  = 10;
+    long long duration        = 0;
+    bool      pin_threads     = false;
+    bool      session_pool    = true;
+
+    beast::error_code ec;
+    auto const address = net::ip::make_address(argv[1], ec);
+    if(ec) {
+        std::cout << "Bad address: " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    auto const port     = static_cast<unsigned short>(std::atoi(argv[2]));
+    auto const doc_root = std::make_shared<std::string>(argv[3]);
+    auto const cores    = std::max(1u, std::thread::hardware_concurrency());
+    auto const threads  = std::atoi(argv[4]) > 0 ? static_cast<unsigned>(std::atoi(argv[4])) : cores;
+
+    if(auto opt = get_option(argc, argv, 5, "main-interval")) {
+        main_interval = std::stoll(std::string(*opt));
+    }
+    if(auto opt = get_option(argc, argv, 5, "probes-interval")) {
+        probes_interval = std::stoll(std::string(*opt));
+    }
+    if(auto opt = get_option(argc, argv, 5, "stats-interval")) {
+        stats_interval = std::stoll(std::string(*opt));
+    }
+    if(auto opt = get_option(argc, argv, 5, "duration")) {
+        duration = std::stoll(std::string(*opt));
+    }
+    if(auto opt = get_option(argc, argv, 5, "pin-threads")) {
+        if(*opt != "on" && *opt != "off") {
+            std::cout << "Pin threads must be on or off: " << *opt << std::endl;
+            return EXIT_FAILURE;
+        }
+        pin_threads = *opt == "on";
+    }
+    if(auto opt = get_option(argc, argv, 5, "session-pool")) {
+        if(*opt != "on" && *opt != "off") {
+            std::cout << "Session pool must be on or off: " << *opt << std::endl;
+            return EXIT_FAILURE;
+        }
+        session_pool = *opt == "on";
+    }
+
+    ws_schedule_t schedule{ .main_payload_interval = std::chrono::seconds(main_interval),
+                            .probes_interval       = std::chrono::seconds(probes_interval) };
+
+    auto file_cache = std::make_shared<file_cache_t>();
+
+    // One io_context per I/O thread, a connection lives on the shard that accepted it.
+    // Concurrency hint 1 lets asio drop the locking it needs for a shared io_context.
+    std::vector<std::unique_ptr<server_shard_t>> shards;
+    for(unsigned i = 0; i < threads; i++) {
+        shards.push_back(std::make_unique<server_shard_t>(session_pool, doc_root, schedule, file_cache));
+    }
+
+    const tcp::endpoint endpoint{ address, port };
+
+#if defined(SO_REUSEPORT)
+    // An acceptor per shard on the same port, no thread hands connections to another
+    for(auto& shard : shards) {
+        auto listener = std::make_shared<http_listener>(shard->ioc, endpoint, true, std::vector<server_shard_t*>{ shard.get() });
+        if(!listener->is_open()) return EXIT_FAILURE;
+        listener->run();
+    }
+#else
+    // One acceptor, connections are spread over the shards round-robin
+    std::vector<server_shard_t*> session_shards;
+    for(auto& shard : shards) {
+        session_shards.push_back(shard.get());
+    }
+    auto listener = std::make_shared<http_listener>(shards[0]->ioc, endpoint, false, session_shards);
+    if(!listener->is_open()) return EXIT_FAILURE;
+    listener->run();
+#endif
+
+    // Shards without an acceptor of their own only get work posted by the listener,
+    // keep their run() from returning before the first connection
+    std::vector<net::executor_work_guard<net::io_context::executor_type>> shard_work;
+    for(auto& shard : shards) {
+        shard_work.push_back(net::make_work_guard(shard->ioc));
+    }
+
+    UTL_LOG_INFO("Listening on ", address.to_string(), ':', port, ", devices on ", ws_device_path, ", I/O threads: ", threads);
+
+    const auto start_time = std::chrono::steady_clock::now();
+
+    // Signals, timers and reports run on the main thread, away from the shards
+    net::io_context ioc{ 1 };
+
+    net::signal_set signals(ioc, SIGINT, SIGTERM);
+    net::steady_timer duration_timer(ioc);
+    net::steady_timer stats_timer(ioc);
+
+    auto request_stop = [&](std::string_view reason) {
+        UTL_LOG_INFO("Stopping: ", reason);
+        for(auto& guard : shard_work) {
+            guard.reset();
+        }
+        for(auto& shard : shards) {
+            shard->ioc.stop();
+        }
+        ioc.stop();
+    };
+
+    signals.async_wait([&](beast::error_code ec, int signal) {
+        if(!ec) request_stop(signal == SIGINT ? "SIGINT" : "SIGTERM");
+    });
+
+    if(duration > 0) {
+        duration_timer.expires_after(std::chrono::seconds(duration));
+        duration_timer.async_wait([&](beast::error_code ec) {
+            if(!ec) request_stop("duration reached");
+        });
+    }
+
+    ws_server_summary_t last_counters;
+    auto last_report = start_time;
+
+    std::function<void(beast::error_code)> on_stats_timer = [&](beast::error_code ec) {
+        if(ec) return;
+
+        auto now = std::chrono::steady_clock::now();
+        log_counters(last_counters, now - last_report);
+        last_report = now;
+
+        stats_timer.expires_after(std::chrono::seconds(stats_interval));
+        stats_timer.async_wait(on_stats_timer);
+    };
+
+    if(stats_interval > 0) {
+        stats_timer.expires_after(std::chrono::seconds(stats_interval));
+        stats_timer.async_wait(on_stats_timer);
+    }
+
+    // Run every shard on its own thread
+    std::vector<std::thread> v;
+    v.reserve(threads);
+    for(unsigned i = 0; i < threads; i++) {
+        v.emplace_back([&shard = *shards[i]] { shard.ioc.run(); });
+        if(pin_threads) {
+            pin_to_cpu(v.back(), i % cores);
+        }
+    }
+    ioc.run();
+
+    for(auto& thread : v) {
+        thread.join();
+    }
+
+    // totals over the whole run
+    ws_server_summary_t totals;
+    log_counters(totals, std::chrono::steady_clock::now() - start_time);
+    log_sequence_report(20);
+
+    std::size_t http_sessions = 0, ws_sessions = 0;
+    for(auto& shard : shards) {
+        http_sessions += shard->http_sessions.created();
+        ws_sessions += shard->ws_sessions.created();
+    }
+    UTL_LOG_INFO("Session objects created, http: ", http_sessions, ", websocket: ", ws_sessions);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Per-shard pools of connection sessions. A shard is one io_context run by one thread, so the pool,
+// its sessions and every reference to them stay on that thread: reference counts are plain integers
+// and a closed session goes back to the free list with its streams, timers and buffers intact.
+
+template <class T>
+class session_pool_t;
+
+template <class T>
+class session_ref_t;
+
+// Base of a pooled session, T must also provide recycle() to drop the state of the last connection
+template <class T>
+class pooled_session_t {
+    friend class session_pool_t<T>;
+    friend class session_ref_t<T>;
+
+    std::size_t        refs_ = 0;
+    session_pool_t<T>* pool_ = nullptr;
+
+    protected:
+    // what shared_from_this() was for, a new reference to this session
+    session_ref_t<T> self() { return session_ref_t<T>(static_cast<T*>(this)); }
+};
+
+// Intrusive reference, the last one returns the session to its pool
+template <class T>
+class session_ref_t {
+    T* p_ = nullptr;
+
+    public:
+    session_ref_t() = default;
+    explicit session_ref_t(T* p) : p_(p) {
+        if(p_) p_->refs_++;
+    }
+    session_ref_t(session_ref_t const& other) : session_ref_t(other.p_) {}
+    session_ref_t(session_ref_t&& other) noexcept : p_(std::exchange(other.p_, nullptr)) {}
+    session_ref_t& operator=(session_ref_t other) noexcept {
+        std::swap(p_, other.p_);
+        return *this;
+    }
+    ~session_ref_t() {
+        if(p_ && --p_->refs_ == 0) p_->pool_->release(p_);
+    }
+
+    T* operator->() const { return p_; }
+    T& operator*() const { return *p_; }
+    explicit operator bool() const { return p_ != nullptr; }
+};
+
+template <class T>
+class session_pool_t {
+    friend class session_ref_t<T>;
+
+    public:
+    // recycle == false allocates every session and frees it on close, for comparison
+    explicit session_pool_t(bool recycle) : recycle_(recycle) {}
+
+    session_pool_t(session_pool_t const&) = delete;
+    session_pool_t& operator=(session_pool_t const&) = delete;
+
+    ~session_pool_t() { shutdown(); }
+
+    // make is called with no arguments when the free list is empty
+    template <class Make>
+    session_ref_t<T> acquire(Make&& make) {
+        T* session;
+        if(free_.empty()) {
+            session        = make().release();
+            session->pool_ = this;
+            created_++;
+        } else {
+            session = free_.back();
+            free_.pop_back();
+        }
+        return session_ref_t<T>(session);
+    }
+
+    // Frees the idle sessions, sessions released later are freed right away.
+    // Call before the io_context of the sessions is destroyed.
+    void shutdown() {
+        recycle_ = false;
+        for(auto session : free_) delete session;
+        free_.clear();
+    }
+
+    std::size_t created() const { return created_; }
+    std::size_t idle() const { return free_.size(); }
+
+    private:
+    void release(T* session) {
+        session->recycle();
+        if(recycle_) {
+            free_.push_back(session);
+        } else {
+            delete session;
+        }
+    }
+
+    bool            recycle_;
+    std::vector<T*> free_;
+    std::size_t     created_ = 0;
+};
+
+// Bump allocator for the headers of one request. Beast allocates every header field separately,
+// with this they land in a buffer inside the session; it rewinds once the request has freed them all.
+class request_arena_t {
+    public:
+    void* allocate(std::size_t size, std::size_t align) {
+        std::size_t offset = (used_ + align - 1) & ~(align - 1);
+        if(offset + size > sizeof(buffer_)) {
+            // unusually large headers, the rest goes to the heap
+            return ::operator new(size);
+        }
+        used_ = offset + size;
+        live_++;
+        return buffer_ + offset;
+    }
+
+    void deallocate(void* p, std::size_t size) {
+        auto bytes = static_cast<unsigned char*>(p);
+        if(bytes < buffer_ || bytes >= buffer_ + sizeof(buffer_)) {
+            ::operator delete(p, size);
+            return;
+        }
+        if(--live_ == 0) used_ = 0;
+    }
+
+    private:
+    alignas(std::max_align_t) unsigned char buffer_[8192];
+    std::size_t used_ = 0;
+    std::size_t live_ = 0;
+};
+
+template <class T>
+struct arena_allocator_t {
+    using value_type = T;
+
+    request_arena_t* arena = nullptr;
+
+    arena_allocator_t() = default;
+    explicit arena_allocator_t(request_arena_t& a) : arena(&a) {}
+    template <class U>
+    arena_allocator_t(arena_allocator_t<U> const& other) : arena(other.arena) {}
+
+    T* allocate(std::size_t n) {
+        // a default constructed allocator (a moved-from message) falls back to the heap
+        if(!arena) return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* p, std::size_t n) {
+        if(!arena) return ::operator delete(p, n * sizeof(T));
+        arena->deallocate(p, n * sizeof(T));
+    }
+
+    // messages move their fields along with the allocator
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap            = std::true_type;
+
+    template <class U>
+    bool operator==(arena_allocator_t<U> const& other) const { return arena == other.arena; }
+    template <class U>
+    bool operator!=(arena_allocator_t<U> const& other) const { return arena != other.arena; }
+};
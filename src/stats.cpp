@@ -0,0 +1,159 @@
+#include "stats.hpp"
+
+#include <bit>
+
+#include "utl_log.hpp"
+
+size_t histogram_layout_t::bucket_index(uint64_t value) {
+    if(value < sub_bucket_count) {
+        return static_cast<size_t>(value);
+    }
+
+    const size_t msb   = 63 - std::countl_zero(value);
+    const size_t shift = msb - sub_bucket_bits;
+
+    return (shift + 1) * sub_bucket_count + static_cast<size_t>((value >> shift) - sub_bucket_count);
+}
+
+uint64_t histogram_layout_t::bucket_upper_bound(size_t index) {
+    if(index < sub_bucket_count) {
+        return index;
+    }
+
+    const size_t   shift    = index / sub_bucket_count - 1;
+    const uint64_t mantissa = index % sub_bucket_count + sub_bucket_count;
+
+    return (mantissa << shift) + ((uint64_t{1} << shift) - 1);
+}
+
+void histogram_counts_t::merge(const histogram_counts_t& other) {
+    for(size_t i = 0; i < bucket_count; i++) {
+        buckets[i] += other.buckets[i];
+    }
+}
+
+histogram_counts_t histogram_counts_t::since(const histogram_counts_t& earlier) const {
+    histogram_counts_t res;
+    for(size_t i = 0; i < bucket_count; i++) {
+        res.buckets[i] = buckets[i] - earlier.buckets[i];
+    }
+    return res;
+}
+
+uint64_t histogram_counts_t::count() const {
+    uint64_t total = 0;
+    for(auto b : buckets) {
+        total += b;
+    }
+    return total;
+}
+
+std::chrono::microseconds histogram_counts_t::percentile(double p) const {
+    const uint64_t total = count();
+    if(total == 0) {
+        return std::chrono::microseconds{0};
+    }
+
+    // rank of the sample we are looking for, 1-based
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(total) + 0.5);
+    if(rank < 1) rank = 1;
+    if(rank > total) rank = total;
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < bucket_count; i++) {
+        seen += buckets[i];
+        if(seen >= rank) {
+            return std::chrono::microseconds{bucket_upper_bound(i)};
+        }
+    }
+
+    return std::chrono::microseconds{bucket_upper_bound(bucket_count - 1)};
+}
+
+void latency_histogram_t::record(std::chrono::microseconds value) {
+    const uint64_t us = value.count() > 0 ? static_cast<uint64_t>(value.count()) : 0;
+    buckets_[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+}
+
+histogram_counts_t latency_histogram_t::snapshot() const {
+    histogram_counts_t res;
+    for(size_t i = 0; i < bucket_count; i++) {
+        res.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+void target_stats_snapshot_t::merge(const target_stats_snapshot_t& other) {
+    connect_attempts += other.connect_attempts;
+    connect_errors += other.connect_errors;
+    handshake_errors += other.handshake_errors;
+    active_connections += other.active_connections;
+    frames_sent += other.frames_sent;
+    bytes_sent += other.bytes_sent;
+    write_errors += other.write_errors;
+    frames_received += other.frames_received;
+    write_queue_depth += other.write_queue_depth;
+    write_queue_dropped += other.write_queue_dropped;
+    write_queue_coalesced += other.write_queue_coalesced;
+    backpressure_us += other.backpressure_us;
+    connect_latency.merge(other.connect_latency);
+    reply_latency.merge(other.reply_latency);
+}
+
+target_stats_snapshot_t target_stats_t::snapshot() const {
+    target_stats_snapshot_t res;
+    res.connect_attempts   = connect_attempts.load();
+    res.connect_errors     = connect_errors.load();
+    res.handshake_errors   = handshake_errors.load();
+    res.active_connections = active_connections.load();
+    res.frames_sent        = frames_sent.load();
+    res.bytes_sent         = bytes_sent.load();
+    res.write_errors       = write_errors.load();
+    res.frames_received    = frames_received.load();
+    res.write_queue_depth     = write_queue_depth.load();
+    res.write_queue_dropped   = write_queue_dropped.load();
+    res.write_queue_coalesced = write_queue_coalesced.load();
+    res.backpressure_us       = backpressure_us.load();
+    res.connect_latency    = connect_latency.snapshot();
+    res.reply_latency      = reply_latency.snapshot();
+    return res;
+}
+
+namespace {
+
+// "12.3ms" with one decimal, without going through iostreams
+void append_ms(std::string& buffer, std::chrono::microseconds value) {
+    const auto tenths = value.count() / 100;
+    utl::log::append_stringified(buffer, tenths / 10, '.', tenths % 10, "ms");
+}
+
+}
+
+std::string format_target_stats(const target_stats_snapshot_t& stats) {
+    std::string res;
+
+    utl::log::append_stringified(res
+        , "active=", stats.active_connections
+        , " connects=", stats.connect_attempts
+        , " connect_err=", stats.connect_errors
+        , " handshake_err=", stats.handshake_errors
+        , " sent=", stats.frames_sent, " (", stats.bytes_sent, "B)"
+        , " write_err=", stats.write_errors
+        , " recv=", stats.frames_received
+        , " queued=", stats.write_queue_depth
+        , " queue_drop=", stats.write_queue_dropped
+        , " coalesced=", stats.write_queue_coalesced
+        , " backpressure=", stats.backpressure_us / 1000, "ms"
+        , " connect p50/p99="
+    );
+
+    append_ms(res, stats.connect_latency.percentile(50));
+    res += '/';
+    append_ms(res, stats.connect_latency.percentile(99));
+    res += " reply p50/p99=";
+    append_ms(res, stats.reply_latency.percentile(50));
+    res += '/';
+    append_ms(res, stats.reply_latency.percentile(99));
+
+    return res;
+}
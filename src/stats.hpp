@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Bucket layout of the latency histograms: log-linear buckets of microseconds.
+// Every power of two is split into sub_bucket_count linear buckets, so the relative error
+// of a reported percentile is bounded by 1 / sub_bucket_count (12.5%) over the whole range.
+struct histogram_layout_t {
+    static constexpr size_t sub_bucket_bits  = 3;
+    static constexpr size_t sub_bucket_count = size_t{1} << sub_bucket_bits;
+    static constexpr size_t bucket_count     = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_upper_bound(size_t index);
+};
+
+// Plain copy of a histogram, used to merge histograms of several targets or processes
+struct histogram_counts_t : histogram_layout_t {
+    std::array<uint64_t, bucket_count> buckets{};
+
+    void merge(const histogram_counts_t& other);
+
+    // what was recorded after earlier, an older snapshot of the same histogram
+    histogram_counts_t since(const histogram_counts_t& earlier) const;
+
+    uint64_t count() const;
+
+    // p in [0, 100], returns the upper bound of the bucket holding the p-th percentile
+    std::chrono::microseconds percentile(double p) const;
+};
+
+// Recording is a single relaxed atomic increment and can be done from any thread
+class latency_histogram_t : public histogram_layout_t {
+public:
+    void record(std::chrono::microseconds value);
+    void record(std::chrono::steady_clock::duration value) {
+        record(std::chrono::duration_cast<std::chrono::microseconds>(value));
+    }
+
+    histogram_counts_t snapshot() const;
+
+    uint64_t count() const { return snapshot().count(); }
+    std::chrono::microseconds percentile(double p) const { return snapshot().percentile(p); }
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> buckets_{};
+};
+
+// Plain copy of target_stats_t
+struct target_stats_snapshot_t {
+    uint64_t connect_attempts   = 0;
+    uint64_t connect_errors     = 0;
+    uint64_t handshake_errors   = 0;
+    int64_t  active_connections = 0;
+    uint64_t frames_sent        = 0;
+    uint64_t bytes_sent         = 0;
+    uint64_t write_errors       = 0;
+    uint64_t frames_received    = 0;
+
+    int64_t  write_queue_depth     = 0;
+    uint64_t write_queue_dropped   = 0;
+    uint64_t write_queue_coalesced = 0;
+    uint64_t backpressure_us       = 0;
+
+    histogram_counts_t connect_latency;
+    histogram_counts_t reply_latency;
+
+    void merge(const target_stats_snapshot_t& other);
+};
+
+// Counters of one connection target, updated lock-free by the device threads
+struct target_stats_t {
+    std::atomic<uint64_t> connect_attempts{0};
+    std::atomic<uint64_t> connect_errors{0};
+    std::atomic<uint64_t> handshake_errors{0};
+    std::atomic<int64_t>  active_connections{0};
+    std::atomic<uint64_t> frames_sent{0};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> write_errors{0};
+    std::atomic<uint64_t> frames_received{0};
+
+    // frames in the write queues of the devices, see write_queue_t
+    std::atomic<int64_t>  write_queue_depth{0};
+    // dropped by the write policy or with a lost connection
+    std::atomic<uint64_t> write_queue_dropped{0};
+    // replaced by a newer frame of the same kind
+    std::atomic<uint64_t> write_queue_coalesced{0};
+    // time devices spent with a full write queue, summed over devices
+    std::atomic<uint64_t> backpressure_us{0};
+
+    latency_histogram_t connect_latency;
+    // from a server command read to the last frame of the device's reply written
+    latency_histogram_t reply_latency;
+
+    target_stats_snapshot_t snapshot() const;
+};
+
+// one line summary, e.g.
+// "active=10 connects=12 connect_err=2 handshake_err=0 sent=480 (65280B) write_err=0 recv=24 queued=3 queue_drop=0
+//  coalesced=0 backpressure=0ms connect p50/p99=1.2ms/8.0ms reply p50/p99=0.3ms/1.1ms"
+std::string format_target_stats(const target_stats_snapshot_t& stats);
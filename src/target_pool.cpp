@@ -0,0 +1,218 @@
+#include "target_pool.hpp"
+
+#include <algorithm>
+#include <functional>
+
+#include "utl_log.hpp"
+
+namespace net = boost::asio;
+using tcp     = boost::asio::ip::tcp;
+
+std::optional<assign_strategy_t> parse_assign_strategy(std::string_view text) {
+    if(text == "rr" || text == "round-robin") return assign_strategy_t::round_robin;
+    if(text == "hash") return assign_strategy_t::hash;
+    if(text == "least" || text == "least-connections") return assign_strategy_t::least_connections;
+    return std::nullopt;
+}
+
+std::vector<target_t> parse_targets(std::string_view list, std::string_view default_port) {
+    std::vector<target_t> res;
+
+    while(!list.empty()) {
+        auto comma = list.find(',');
+        auto entry = list.substr(0, comma);
+        list       = (comma == std::string_view::npos) ? std::string_view{} : list.substr(comma + 1);
+
+        if(entry.empty()) continue;
+
+        // a single ':' separates the port, more than one means a bare IPv6 address
+        auto colon = entry.rfind(':');
+        if(colon != std::string_view::npos && entry.find(':') == colon) {
+            res.push_back({std::string(entry.substr(0, colon)), std::string(entry.substr(colon + 1))});
+        } else {
+            res.push_back({std::string(entry), std::string(default_port)});
+        }
+    }
+
+    return res;
+}
+
+namespace {
+
+uint64_t mix(uint64_t x) {
+    // splitmix64 finalizer
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+}
+
+target_pool_t::target_pool_t(std::vector<target_t> targets, assign_strategy_t strategy)
+    : targets_(std::move(targets)), strategy_(strategy) {}
+
+target_pool_t::~target_pool_t() {
+    stop();
+}
+
+bool target_pool_t::resolve() {
+    std::lock_guard resolve_lock(resolve_mutex_);
+
+    std::vector<target_endpoint_ptr_t> resolved;
+
+    auto current = [&]() {
+        std::lock_guard lock(endpoints_mutex_);
+        return all_endpoints_;
+    }();
+
+    for(auto& target : targets_) {
+        try {
+            auto results = resolver_.resolve(target.host, target.port);
+
+            for(auto& entry : results) {
+                auto name = target.host + '/' + entry.endpoint().address().to_string() + ':'
+                            + std::to_string(entry.endpoint().port());
+
+                auto same_name = [&](const target_endpoint_ptr_t& e) { return e->name == name; };
+
+                if(std::any_of(resolved.begin(), resolved.end(), same_name)) continue;
+
+                auto it = std::find_if(current.begin(), current.end(), same_name);
+                if(it != current.end()) {
+                    resolved.push_back(*it);
+                } else {
+                    auto endpoint      = std::make_shared<target_endpoint_t>();
+                    endpoint->host     = target.host;
+                    endpoint->endpoint = entry.endpoint();
+                    endpoint->name     = std::move(name);
+                    UTL_LOG_INFO("New target endpoint: ", endpoint->name);
+                    resolved.push_back(std::move(endpoint));
+                }
+            }
+        } catch(std::exception const& e) {
+            UTL_LOG_ERR("Resolver error: ", target.host, ':', target.port, ' ', e.what());
+        }
+    }
+
+    if(resolved.empty()) {
+        return false;
+    }
+
+    std::lock_guard lock(endpoints_mutex_);
+
+    for(auto& endpoint : all_endpoints_) {
+        bool still_resolved = std::find(resolved.begin(), resolved.end(), endpoint) != resolved.end();
+        if(endpoint->active && !still_resolved) {
+            UTL_LOG_WARN("Target endpoint no longer resolved: ", endpoint->name);
+        }
+        endpoint->active = still_resolved;
+    }
+
+    for(auto& endpoint : resolved) {
+        if(std::find(all_endpoints_.begin(), all_endpoints_.end(), endpoint) == all_endpoints_.end()) {
+            all_endpoints_.push_back(endpoint);
+        }
+    }
+
+    endpoints_ = std::move(resolved);
+
+    return true;
+}
+
+void target_pool_t::start(std::chrono::seconds resolve_interval, std::chrono::seconds report_interval) {
+    background_thread_ = std::thread([this, resolve_interval, report_interval]() {
+        background_loop(resolve_interval, report_interval);
+    });
+}
+
+void target_pool_t::stop() {
+    {
+        std::lock_guard lock(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+
+    if(background_thread_.joinable()) {
+        background_thread_.join();
+    }
+}
+
+void target_pool_t::background_loop(std::chrono::seconds resolve_interval, std::chrono::seconds report_interval) {
+    using clock = std::chrono::steady_clock;
+
+    // an interval of 0 disables the task
+    const auto never  = clock::now() + std::chrono::hours(24 * 365);
+    auto next_resolve = resolve_interval.count() > 0 ? clock::now() + resolve_interval : never;
+    auto next_report  = report_interval.count() > 0 ? clock::now() + report_interval : never;
+
+    std::unique_lock lock(stop_mutex_);
+
+    while(!stopping_) {
+        auto wake_up = std::min(next_resolve, next_report);
+        if(stop_cv_.wait_until(lock, wake_up, [this]() { return stopping_; })) break;
+
+        lock.unlock();
+
+        auto now = clock::now();
+        if(resolve_interval.count() > 0 && now >= next_resolve) {
+            resolve();
+            next_resolve = now + resolve_interval;
+        }
+        if(report_interval.count() > 0 && now >= next_report) {
+            log_stats();
+            next_report = now + report_interval;
+        }
+
+        lock.lock();
+    }
+}
+
+target_endpoint_ptr_t target_pool_t::pick(std::string_view device_id) {
+    std::lock_guard lock(endpoints_mutex_);
+
+    if(endpoints_.empty()) {
+        return nullptr;
+    }
+
+    switch(strategy_) {
+    case assign_strategy_t::round_robin:
+        return endpoints_[next_.fetch_add(1, std::memory_order_relaxed) % endpoints_.size()];
+
+    case assign_strategy_t::hash: {
+        // Rendezvous hashing: a device only moves when its endpoint goes away
+        const uint64_t device_hash = std::hash<std::string_view>{}(device_id);
+
+        target_endpoint_ptr_t best;
+        uint64_t              best_score = 0;
+        for(auto& endpoint : endpoints_) {
+            uint64_t score = mix(device_hash ^ std::hash<std::string>{}(endpoint->name));
+            if(!best || score > best_score) {
+                best       = endpoint;
+                best_score = score;
+            }
+        }
+        return best;
+    }
+
+    case assign_strategy_t::least_connections: {
+        return *std::min_element(endpoints_.begin(), endpoints_.end(), [](auto& l, auto& r) {
+            return l->stats.active_connections.load(std::memory_order_relaxed)
+                   < r->stats.active_connections.load(std::memory_order_relaxed);
+        });
+    }
+    }
+
+    return nullptr;
+}
+
+std::vector<target_endpoint_ptr_t> target_pool_t::all_endpoints() const {
+    std::lock_guard lock(endpoints_mutex_);
+    return all_endpoints_;
+}
+
+void target_pool_t::log_stats() const {
+    for(auto& endpoint : all_endpoints()) {
+        UTL_LOG_INFO("Target ", endpoint->name, endpoint->active ? " " : " (gone) ", format_target_stats(endpoint->stats.snapshot()));
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include "stats.hpp"
+
+// How a device is assigned to one of the resolved endpoints on (re)connect
+enum class assign_strategy_t {
+    round_robin,        // next endpoint in turn
+    hash,               // rendezvous hash of the device id, stable across re-resolution
+    least_connections   // endpoint with the fewest active connections
+};
+
+std::optional<assign_strategy_t> parse_assign_strategy(std::string_view text);
+
+// host and port as given on the command line
+struct target_t {
+    std::string host;
+    std::string port;
+};
+
+// "host1[:port1],host2[:port2],..." - entries without a port get default_port
+std::vector<target_t> parse_targets(std::string_view list, std::string_view default_port);
+
+// One resolved address of a target. Devices keep a shared_ptr to the endpoint they are
+// connected to, so the stats survive the endpoint disappearing from DNS.
+struct target_endpoint_t {
+    std::string                    host;     // original host name, used for the Host header
+    boost::asio::ip::tcp::endpoint endpoint;
+    std::string                    name;     // "host/address:port", used in reports
+
+    std::atomic<bool> active{true};          // false once re-resolution no longer returns it
+    target_stats_t    stats;
+};
+
+using target_endpoint_ptr_t = std::shared_ptr<target_endpoint_t>;
+
+class target_pool_t {
+public:
+    target_pool_t(std::vector<target_t> targets, assign_strategy_t strategy);
+    ~target_pool_t();
+
+    target_pool_t(const target_pool_t&)            = delete;
+    target_pool_t& operator=(const target_pool_t&) = delete;
+
+    // Resolve all targets and replace the endpoint list.
+    // Endpoints that are still returned keep their identity (and stats).
+    // Returns false if no target could be resolved, the previous list is kept in that case.
+    bool resolve();
+
+    // Re-resolve every resolve_interval and log per-target stats every report_interval
+    void start(std::chrono::seconds resolve_interval, std::chrono::seconds report_interval);
+    void stop();
+
+    // Endpoint for a device about to connect, nullptr if nothing is resolved
+    target_endpoint_ptr_t pick(std::string_view device_id);
+
+    // Every endpoint seen so far, including the ones no longer resolved
+    std::vector<target_endpoint_ptr_t> all_endpoints() const;
+
+    void log_stats() const;
+
+private:
+    void background_loop(std::chrono::seconds resolve_interval, std::chrono::seconds report_interval);
+
+    std::vector<target_t> targets_;
+    assign_strategy_t     strategy_;
+
+    boost::asio::io_context        resolver_ioc_;
+    boost::asio::ip::tcp::resolver resolver_{resolver_ioc_};
+    std::mutex                     resolve_mutex_;
+
+    mutable std::mutex                 endpoints_mutex_;
+    std::vector<target_endpoint_ptr_t> endpoints_;      // currently resolved, candidates for pick()
+    std::vector<target_endpoint_ptr_t> all_endpoints_;  // everything ever resolved, for reports
+    std::atomic<size_t>                next_{0};
+
+    std::mutex              stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool                    stopping_ = false;
+    std::thread             background_thread_;
+};
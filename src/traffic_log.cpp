@@ -0,0 +1,266 @@
+#include "traffic_log.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "utl_log.hpp"
+
+namespace bip = boost::interprocess;
+
+namespace {
+
+constexpr char        file_magic[8]     = { 'W', 'S', 'T', 'R', 'A', 'F', 'F', 'C' };
+constexpr uint32_t    file_version      = 1;
+constexpr std::size_t file_header_size  = 64;
+constexpr std::size_t record_header_size = 32;
+
+constexpr std::size_t align8(std::size_t size) {
+    return (size + 7) & ~std::size_t{7};
+}
+
+template <class T>
+void store(uint8_t* at, T value) {
+    std::memcpy(at, &value, sizeof(T));
+}
+
+template <class T>
+T load(const uint8_t* at) {
+    T value;
+    std::memcpy(&value, at, sizeof(T));
+    return value;
+}
+
+}
+
+// ===============
+// --- Writer ---
+// ===============
+
+traffic_recorder_t::traffic_recorder_t(std::string filename, std::size_t segment_size)
+    : filename_(std::move(filename)), segment_size_(segment_size), start_(std::chrono::steady_clock::now()) {}
+
+std::unique_ptr<traffic_recorder_t> traffic_recorder_t::open(const std::string& filename, std::size_t segment_size) {
+    segment_size = align8(std::max(segment_size, std::size_t{64} << 10));
+
+    {
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        if(!out) {
+            UTL_LOG_ERR("Failed to create the recording: ", filename);
+            return nullptr;
+        }
+
+        uint8_t header[file_header_size] = {};
+        std::memcpy(header, file_magic, sizeof(file_magic));
+        store<uint32_t>(header + 8, file_version);
+        store<uint32_t>(header + 12, static_cast<uint32_t>(file_header_size));
+        store<uint64_t>(header + 16, segment_size);
+        store<int64_t>(header + 24, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::system_clock::now().time_since_epoch()).count());
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    std::unique_ptr<traffic_recorder_t> res(new traffic_recorder_t(filename, segment_size));
+    try {
+        std::filesystem::resize_file(filename, file_header_size + segment_size);
+        res->file_ = bip::file_mapping(filename.c_str(), bip::read_write);
+    } catch(std::exception const& e) {
+        UTL_LOG_ERR("Failed to map the recording: ", filename, " ", e.what());
+        return nullptr;
+    }
+    if(!res->map(res->ring_[0], 0)) {
+        return nullptr;
+    }
+    return res;
+}
+
+traffic_recorder_t::~traffic_recorder_t() {
+    close();
+}
+
+bool traffic_recorder_t::map(segment_t& segment, uint64_t sequence) {
+    const uint64_t offset = file_header_size + sequence * segment_size_;
+    try {
+        if(std::filesystem::file_size(filename_) < offset + segment_size_) {
+            std::filesystem::resize_file(filename_, offset + segment_size_);
+        }
+        segment.region = std::make_unique<bip::mapped_region>(file_, bip::read_write, offset, segment_size_);
+    } catch(std::exception const& e) {
+        UTL_LOG_ERR("Failed to map segment ", sequence, " of the recording: ", e.what());
+        return false;
+    }
+
+    segment.base = static_cast<uint8_t*>(segment.region->get_address());
+    segment.used.store(0, std::memory_order_relaxed);
+    segment.sequence.store(sequence, std::memory_order_release);
+    return true;
+}
+
+void traffic_recorder_t::record(traffic_direction_t direction, bool text, uint64_t device_id, const void* data, std::size_t size) {
+    const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+
+    const std::size_t total = align8(record_header_size + size);
+    if(total > segment_size_) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    for(;;) {
+        const uint64_t sequence = current_.load(std::memory_order_acquire);
+        if(sequence == unmapped) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto& segment = ring_[sequence % ring_size];
+        // seq_cst with the unmapping side: either it sees this writer or this writer sees the slot change
+        segment.writers.fetch_add(1);
+        // the slot may have moved on to a later segment since current_ was read
+        if(segment.sequence.load() != sequence) {
+            segment.writers.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+
+        const uint64_t offset = segment.used.fetch_add(total, std::memory_order_relaxed);
+        if(offset + total <= segment_size_) {
+            uint8_t* at = segment.base + offset;
+            store<uint32_t>(at + 4, static_cast<uint32_t>(size));
+            at[8]  = static_cast<uint8_t>(direction);
+            at[9]  = text ? 1 : 0;
+            store<uint16_t>(at + 10, 0);
+            store<uint32_t>(at + 12, 0);
+            store<uint64_t>(at + 16, device_id);
+            store<int64_t>(at + 24, time);
+            std::memcpy(at + record_header_size, data, size);
+
+            std::atomic_ref<uint32_t>(*reinterpret_cast<uint32_t*>(at)).store(static_cast<uint32_t>(total), std::memory_order_release);
+
+            segment.writers.fetch_sub(1, std::memory_order_release);
+            records_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // the segment is full, the rest of it stays zero and reads as its end
+        segment.writers.fetch_sub(1, std::memory_order_release);
+        advance(sequence);
+    }
+}
+
+void traffic_recorder_t::advance(uint64_t full) {
+    std::lock_guard lock(advance_mutex_);
+    if(closed_ || current_.load(std::memory_order_acquire) != full) return;
+
+    // the slot still holds the segment a full ring back, wait out a writer that got in late
+    auto& next = ring_[(full + 1) % ring_size];
+    next.sequence.store(unmapped);
+    while(next.writers.load() != 0) {
+        std::this_thread::yield();
+    }
+    if(next.region) {
+        next.region->flush(0, 0, true);
+        next.region.reset();
+    }
+
+    if(!map(next, full + 1)) {
+        current_.store(unmapped, std::memory_order_release);
+        return;
+    }
+
+    // written out in the background, the mapping stays until the ring comes back to it
+    ring_[full % ring_size].region->flush(0, 0, true);
+    current_.store(full + 1, std::memory_order_release);
+}
+
+void traffic_recorder_t::close() {
+    std::lock_guard lock(advance_mutex_);
+    if(closed_) return;
+    closed_ = true;
+
+    const uint64_t last = current_.exchange(unmapped, std::memory_order_acq_rel);
+
+    uint64_t size = file_header_size;
+    for(auto& segment : ring_) {
+        const uint64_t sequence = segment.sequence.exchange(unmapped);
+        while(segment.writers.load() != 0) {
+            std::this_thread::yield();
+        }
+        if(segment.region) {
+            segment.region->flush();
+            segment.region.reset();
+        }
+        if(sequence != unmapped && sequence == last) {
+            size = file_header_size + sequence * segment_size_ + std::min<uint64_t>(segment.used.load(), segment_size_);
+        }
+    }
+
+    if(last != unmapped) {
+        std::error_code ec;
+        std::filesystem::resize_file(filename_, size, ec);
+    }
+}
+
+// ===============
+// --- Reader ---
+// ===============
+
+std::optional<traffic_reader_t> traffic_reader_t::open(const std::string& filename) {
+    traffic_reader_t res;
+    try {
+        res.file_   = std::make_shared<bip::file_mapping>(filename.c_str(), bip::read_only);
+        res.region_ = std::make_shared<bip::mapped_region>(*res.file_, bip::read_only);
+    } catch(std::exception const& e) {
+        UTL_LOG_ERR("Failed to open the recording: ", filename, " ", e.what());
+        return std::nullopt;
+    }
+
+    auto data = static_cast<const uint8_t*>(res.region_->get_address());
+    const std::size_t file_size = res.region_->get_size();
+
+    if(file_size < file_header_size || std::memcmp(data, file_magic, sizeof(file_magic)) != 0
+       || load<uint32_t>(data + 8) != file_version) {
+        UTL_LOG_ERR("Not a recording: ", filename);
+        return std::nullopt;
+    }
+
+    const std::size_t header_size  = load<uint32_t>(data + 12);
+    const uint64_t    segment_size = load<uint64_t>(data + 16);
+    res.start_time_ = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(load<int64_t>(data + 24))));
+
+    if(header_size < file_header_size || segment_size == 0) {
+        UTL_LOG_ERR("Broken header of the recording: ", filename);
+        return std::nullopt;
+    }
+
+    for(uint64_t segment = header_size; segment < file_size; segment += segment_size) {
+        const uint64_t end = std::min<uint64_t>(segment + segment_size, file_size);
+        for(uint64_t pos = segment; pos + record_header_size <= end;) {
+            const uint8_t* at    = data + pos;
+            const uint32_t size  = load<uint32_t>(at);
+            const uint32_t bytes = load<uint32_t>(at + 4);
+            if(size == 0) break;
+            if(size < record_header_size + bytes || pos + size > end) {
+                UTL_LOG_WARN("Broken record at byte ", pos, " of the recording, skipping the rest of its segment");
+                break;
+            }
+
+            traffic_record_t record;
+            record.direction = static_cast<traffic_direction_t>(at[8]);
+            record.text      = at[9] != 0;
+            record.device_id = load<uint64_t>(at + 16);
+            record.time      = std::chrono::nanoseconds(load<int64_t>(at + 24));
+            record.data      = at + record_header_size;
+            record.size      = bytes;
+            res.records_.push_back(record);
+
+            pos += size;
+        }
+    }
+
+    // threads reserve space in about the order they take their timestamps, close enough to sort cheaply
+    std::stable_sort(res.records_.begin(), res.records_.end(),
+                     [](const traffic_record_t& a, const traffic_record_t& b) { return a.time < b.time; });
+    return res;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// Recording of the messages between the devices and the server, written with --record and read back
+// by the replay mode.
+//
+// File: a 64 byte header, then segments of segment_size bytes filled with records. A record is
+// 8-byte aligned:
+//      u32 size          - the whole record with padding, 0 - no more records in this segment
+//      u32 payload size
+//      u8  direction     - traffic_direction_t
+//      u8  text          - 1 for a text message
+//      u16, u32          - reserved
+//      u64 device id
+//      u64 nanoseconds since the start of the recording
+//      payload, padded
+// The size is stored last, so a record cut short by a crash reads as the end of its segment.
+
+enum class traffic_direction_t : uint8_t {
+    to_device = 0,
+    to_server = 1,
+};
+
+// A record of a traffic_reader_t, the payload points into the mapped file
+struct traffic_record_t {
+    traffic_direction_t      direction = traffic_direction_t::to_device;
+    bool                     text      = false;
+    uint64_t                 device_id = 0;
+    std::chrono::nanoseconds time{ 0 };
+    const uint8_t*           data = nullptr;
+    std::size_t              size = 0;
+};
+
+// Appends records from any thread. The file is written through a ring of mapped segments: a writer
+// reserves its bytes in the current segment with one atomic add and copies the record into the mapping,
+// only moving on to the next segment takes a lock. The segment after the current one is mapped
+// ahead, the one a full ring back is unmapped once its last writer is done.
+class traffic_recorder_t {
+public:
+    // nullptr if the file can't be created
+    static std::unique_ptr<traffic_recorder_t> open(const std::string& filename, std::size_t segment_size = std::size_t{16} << 20);
+
+    ~traffic_recorder_t();
+
+    void record(traffic_direction_t direction, bool text, uint64_t device_id, const void* data, std::size_t size);
+
+    // Unmaps the segments and cuts the file after the last record, records after it are dropped
+    void close();
+
+    uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+    // larger than a segment, or after close() or a failed mapping
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr std::size_t ring_size = 4;
+    static constexpr uint64_t    unmapped  = ~uint64_t{0};
+
+    struct segment_t {
+        std::unique_ptr<boost::interprocess::mapped_region> region;
+        uint8_t*              base = nullptr;
+        // which segment of the file is mapped here
+        std::atomic<uint64_t> sequence{unmapped};
+        std::atomic<uint64_t> used{0};
+        std::atomic<int>      writers{0};
+    };
+
+    traffic_recorder_t(std::string filename, std::size_t segment_size);
+
+    bool map(segment_t& segment, uint64_t sequence);
+    void advance(uint64_t full);
+
+    std::string filename_;
+    std::size_t segment_size_;
+    std::chrono::steady_clock::time_point start_;
+
+    boost::interprocess::file_mapping file_;
+    std::array<segment_t, ring_size>  ring_;
+    std::atomic<uint64_t>             current_{0};
+    std::mutex                        advance_mutex_;
+    bool                              closed_ = false;
+
+    std::atomic<uint64_t> records_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+// Read side, the whole file is mapped and records point into it
+class traffic_reader_t {
+public:
+    // nullopt if the file can't be opened or isn't a recording
+    static std::optional<traffic_reader_t> open(const std::string& filename);
+
+    // every complete record, by time
+    const std::vector<traffic_record_t>& records() const { return records_; }
+
+    // system_clock time of the start of the recording
+    std::chrono::system_clock::time_point start_time() const { return start_time_; }
+
+private:
+    std::shared_ptr<boost::interprocess::file_mapping>  file_;
+    std::shared_ptr<boost::interprocess::mapped_region> region_;
+    std::vector<traffic_record_t>                       records_;
+    std::chrono::system_clock::time_point               start_time_;
+};
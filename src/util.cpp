@@ -1,29 +1,60 @@
 #include "util.hpp"
 
+#include <condition_variable>
+
 bool run_with_timeout(std::function<void()> f, std::chrono::milliseconds timeout, std::string_view text) {
-    auto deadline = std::chrono::steady_clock::now() + timeout;
-    bool done = false;
+    // shared with the worker thread, which outlives this call on timeout
+    struct state_t {
+        std::mutex              mutex;
+        std::condition_variable cv;
+        bool                    done = false;
+    };
+    auto state = std::make_shared<state_t>();
 
-    auto wrapper = [&done, f]() {
+    auto wrapper = [state, f = std::move(f)]() {
         try {
             f();
         } catch(std::exception const& e) {
             UTL_LOG_DERR("Exception in timeout handler: ", e.what());
         }
-        done = true;
+        {
+            std::lock_guard lock(state->mutex);
+            state->done = true;
+        }
+        state->cv.notify_one();
     };
 
-    auto t = new std::thread(wrapper);
-    t->detach();
+    std::thread(wrapper).detach();
 
-    while(!done) {
-        if(std::chrono::steady_clock::now() > deadline) {
-            UTL_LOG_DWARN("Timeout: ", text);
-            break;
-        }
+    std::unique_lock lock(state->mutex);
+    if(!state->cv.wait_for(lock, timeout, [&]() { return state->done; })) {
+        UTL_LOG_DWARN("Timeout: ", text);
+        return false;
     }
 
-    delete t;
+    return true;
+}
+
+std::optional<std::string_view> get_option(int argc, char** argv, int first, std::string_view name) {
+    for(int i = first; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if(arg.starts_with("--") && arg.substr(2).starts_with(name) && arg.substr(2 + name.size()).starts_with('=')) {
+            return arg.substr(2 + name.size() + 1);
+        }
+    }
+    return std::nullopt;
+}
 
-    return done;
-}
\ No newline at end of file
+std::string_view io_backend_name() {
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+    return "io_uring";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+    return "epoll";
+#elif defined(BOOST_ASIO_HAS_KQUEUE)
+    return "kqueue";
+#elif defined(BOOST_ASIO_HAS_IOCP)
+    return "iocp";
+#else
+    return "select";
+#endif
+}
@@ -6,6 +6,8 @@
 #include <thread>
 #include <mutex>
 #include <memory>
+#include <future>
+#include <optional>
 
 #include <boost/beast/websocket.hpp>
 #include <boost/beast.hpp>
@@ -13,27 +15,64 @@
 #include <boost/asio.hpp>
 
 #include "utl_log.hpp"
+#include "write_queue.hpp"
+#include "device_socket.hpp"
 
 using resolver_result_t = boost::asio::ip::basic_resolver_results<boost::asio::ip::tcp>;
-using payload_t = std::vector<uint8_t>;
 
 #define LOCK_GUARD(__mutex) std::lock_guard<std::mutex> guard(__mutex)
 
 constexpr long long time_between_devices_ms = 20;
 
+struct target_endpoint_t;
+
+// Connection of a device, changed on the executor of its stream, guarded by ws_state_mutex
+enum class ws_status_t {
+    closed,     // nothing pending on the stream, the manage thread may connect
+    connecting,
+    open,
+    closing,    // failed or being closed, waits for the handlers still pending on the stream
+};
+
 struct ws_state_t {
 
     std::unique_ptr<std::mutex> ws_state_mutex;
 
-    boost::beast::websocket::stream<boost::asio::ip::tcp::socket> ws;
+    boost::beast::websocket::stream<device_socket_t> ws;
     boost::beast::flat_buffer buffer;
 
     std::string device_id;
+    // device_id as a number, what the traffic recording stores
+    uint64_t device_number = 0;
     bool connected = false;
 
-    std::optional<std::vector<payload_t>> extra_payload;
+    // reply to a server command that a full write queue held back, sent by the manage thread,
+    // guarded by ws_state_mutex
+    const std::vector<payload_t>* extra_payload = nullptr;
+    std::chrono::steady_clock::time_point extra_payload_received;
+
+    // frames waiting for the async writer, see --write-queue
+    std::unique_ptr<write_queue_t> write_queue;
+
+    // next sequence number and the stamped frame being written, only the writer touches them, see --sequence
+    uint32_t  sequence = 0;
+    payload_t stamped;
 
     std::chrono::steady_clock::time_point last_run_time;
+
+    // endpoint of the current connection, guarded by ws_state_mutex
+    std::shared_ptr<target_endpoint_t> endpoint;
+
+    // source address to bind before connecting, see --bind
+    std::optional<boost::asio::ip::address_v4> bind_address;
+
+    ws_status_t status = ws_status_t::closed;
+    // operations in progress on the stream, only its executor touches it
+    int io_pending = 0;
+    // called on the executor once the connection is closed, see ws_drain
+    std::function<void()> on_closed;
+    // called on the executor when the writer runs out of frames, see ws_drain
+    std::function<void()> on_drained;
 };
 
 struct ws_conn_res_t {
@@ -42,6 +81,13 @@ struct ws_conn_res_t {
 
 bool run_with_timeout(std::function<void()> f, std::chrono::milliseconds timeout, std::string_view text);
 
+// Value of an optional "--name=value" argument given after the positional ones
+std::optional<std::string_view> get_option(int argc, char** argv, int first, std::string_view name);
+
+// Reactor asio runs the io_contexts of this build on: "io_uring" with WS_IO_URING, else "epoll",
+// "kqueue", "iocp" or "select" as the platform has them. Fixed at compile time.
+std::string_view io_backend_name();
+
 // std::string time_and_date() {
 //     auto current_time = std::time(0);
 //     auto res = boost::lexical_cast<std::string>(std::put_time(std::gmtime(& current_time), "%Y-%m-%d %X"));
@@ -14,29 +14,37 @@
 // #define _DEBUG
 // _______________________ INCLUDES _______________________
 
-#include <array>         // array<>
-#include <charconv>      // to_chars()
-#include <chrono>        // steady_clock
-#include <cstddef>       // size_t
-#include <exception>     // exception
-#include <fstream>       // ofstream
-#include <iostream>      // cout
-#include <iterator>      // next()
-#include <limits>        // numeric_limits<>
-#include <list>          // list<>
-#include <mutex>         // lock_guard<>, mutex
-#include <ostream>       // ostream
-#include <sstream>       // std::ostringstream
-#include <stdexcept>     // std::runtime_error
-#include <string>        // string
-#include <string_view>   // string_view
-#include <system_error>  // errc()
-#include <thread>        // this_thread::get_id()
-#include <tuple>         // tuple_size<>
-#include <type_traits>   // is_integral_v<>, is_floating_point_v<>, is_same_v<>, is_convertible_to_v<>
-#include <unordered_map> // unordered_map<>
-#include <utility>       // forward<>()
-#include <variant>       // variant<>
+#include <algorithm>          // find(), remove_if()
+#include <array>              // array<>
+#include <atomic>             // atomic<>
+#include <charconv>           // to_chars()
+#include <chrono>             // steady_clock
+#include <condition_variable> // condition_variable
+#include <cstddef>            // size_t
+#include <cstdint>            // uint32_t, uint64_t
+#include <cstring>            // memcpy()
+#include <ctime>              // time(), strftime(), clock_gettime()
+#include <exception>          // exception
+#include <fstream>            // ofstream
+#include <iostream>           // cout
+#include <iterator>           // next()
+#include <limits>             // numeric_limits<>
+#include <list>               // list<>
+#include <memory>             // shared_ptr<>
+#include <mutex>              // lock_guard<>, mutex
+#include <ostream>            // ostream
+#include <sstream>            // std::ostringstream
+#include <stdexcept>          // std::runtime_error
+#include <string>             // string
+#include <string_view>        // string_view
+#include <system_error>       // errc()
+#include <thread>             // this_thread::get_id()
+#include <tuple>              // tuple_size<>
+#include <type_traits>        // is_integral_v<>, is_floating_point_v<>, is_same_v<>, is_convertible_to_v<>
+#include <unordered_map>      // unordered_map<>
+#include <utility>            // forward<>()
+#include <variant>            // variant<>
+#include <vector>             // vector<>
 
 // ____________________ DEVELOPER DOCS ____________________
 
@@ -59,8 +67,15 @@
 //             for flushing the buffer, it generally improves performance by ~30%, however I decided it
 //             is not worth the added complexity & cpu usage for that little gain
 //
+//       Note: 'enable_async()' adds this as an opt-in. Messages are still formatted by the calling thread,
+//             then pushed to a per-thread SPSC ring that one writer thread drains into the sinks, so logging
+//             threads no longer contend on the ostream lock and stdout gets flushed once per batch.
+//
 //    3. Platform-specific methods to query stuff like time & thread id with less overhead
 //
+//       Note: thread index is now cached per thread, datetime text is cached per thread and second, and text
+//             columns read coarse clocks (see '_coarse_now()'), so no lock is taken for per-record metadata.
+//
 //    4. A centralized formatting & info querying facility so multiple sinks don't have to repeat
 //       formatting & querying logic.
 //
@@ -106,6 +121,12 @@ inline std::size_t _get_thread_index(const std::thread::id id) {
     // this map effectively "demangles" platform-specific IDs into human-readable IDs (0, 1, 2, ...)
 }
 
+inline std::size_t _this_thread_index() {
+    thread_local const std::size_t index = _get_thread_index(std::this_thread::get_id());
+    return index;
+    // cached per thread, the map above is only hit on the first message of a thread
+}
+
 template <class IntType, std::enable_if_t<std::is_integral<IntType>::value, bool> = true>
 unsigned int _integer_digit_count(IntType value) {
     unsigned int digits = (value <= 0) ? 1 : 0;
@@ -123,6 +144,31 @@ using clock = std::chrono::steady_clock;
 
 inline const clock::time_point _program_entry_time_point = clock::now();
 
+// Coarse clocks for the text columns, which only show milliseconds and seconds. On Linux these read
+// the tick-granular vDSO time (~1-4 ms resolution) without touching the TSC, elsewhere they fall back
+// to the regular clocks.
+inline clock::time_point _coarse_now() {
+#if defined(__linux__) && defined(CLOCK_MONOTONIC_COARSE)
+    // 'steady_clock' is CLOCK_MONOTONIC on Linux, the coarse variant counts from the same epoch
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return clock::time_point(std::chrono::duration_cast<clock::duration>(std::chrono::seconds(ts.tv_sec) +
+                                                                         std::chrono::nanoseconds(ts.tv_nsec)));
+#else
+    return clock::now();
+#endif
+}
+
+inline std::time_t _coarse_time() {
+#if defined(__linux__) && defined(CLOCK_REALTIME_COARSE)
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return ts.tv_sec;
+#else
+    return std::time(nullptr);
+#endif
+}
+
 // ===================
 // --- Stringifier ---
 // ===================
@@ -538,6 +584,7 @@ struct Columns {
 struct Callsite {
     std::string_view file;
     int              line;
+    std::uint32_t    id = 0; // index in the callsite registry, binary logs refer to callsites by it
 };
 
 struct MessageMetadata {
@@ -634,6 +681,269 @@ constexpr std::string_view _color_info  = color::white;
 constexpr std::string_view _color_warn  = color::yellow;
 constexpr std::string_view _color_err   = color::bold_red;
 
+// =========================
+// --- Async log backend ---
+// =========================
+
+// What a logging thread does when its ring is full
+enum class Overflow { BLOCK, DROP };
+
+class Sink;
+
+// Single producer / single consumer byte ring, one per logging thread.
+// Records are '[Sink*][uint32_t size][message]' and may wrap around the end of the buffer.
+class _AsyncRing {
+public:
+    static constexpr std::size_t header_size = sizeof(Sink*) + sizeof(std::uint32_t);
+
+    std::atomic<std::uint64_t> dropped{0};
+    std::atomic<bool>          abandoned{false}; // owner thread exited
+
+    // not zero-filled, pages the ring never reaches are never committed
+    explicit _AsyncRing(std::size_t capacity) : buffer(new char[capacity]), buffer_size(capacity), mask(capacity - 1) {}
+
+    std::size_t capacity() const { return this->buffer_size; }
+
+    bool empty() const {
+        return this->read_pos.load(std::memory_order_acquire) == this->write_pos.load(std::memory_order_acquire);
+    }
+
+    bool try_push(Sink* sink, std::string_view message) {
+        const std::uint64_t write = this->write_pos.load(std::memory_order_relaxed);
+
+        // the consumer position is only re-read when the ring looks full, saves a cache miss per message
+        const std::size_t record_size = header_size + message.size();
+        if (this->capacity() - (write - this->cached_read_pos) < record_size) {
+            this->cached_read_pos = this->read_pos.load(std::memory_order_acquire);
+            if (this->capacity() - (write - this->cached_read_pos) < record_size) return false;
+        }
+
+        const auto size = static_cast<std::uint32_t>(message.size());
+        this->copy_in(write, &sink, sizeof(sink));
+        this->copy_in(write + sizeof(sink), &size, sizeof(size));
+        this->copy_in(write + header_size, message.data(), message.size());
+
+        this->write_pos.store(write + record_size, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side, whether the ring is more than half full
+    bool over_half() {
+        const std::uint64_t write = this->write_pos.load(std::memory_order_relaxed);
+        if (write - this->cached_read_pos <= this->capacity() / 2) return false;
+
+        this->cached_read_pos = this->read_pos.load(std::memory_order_acquire);
+        return write - this->cached_read_pos > this->capacity() / 2;
+    }
+
+    // Calls 'func(sink, message)' for every queued record, returns the number of records.
+    // Messages that wrap around are copied to 'scratch', the rest are passed straight from the ring.
+    template <class Func>
+    std::size_t consume(std::string& scratch, Func&& func) {
+        const std::uint64_t write = this->write_pos.load(std::memory_order_acquire);
+        std::uint64_t       read  = this->read_pos.load(std::memory_order_relaxed);
+        std::size_t         count = 0;
+
+        while (read != write) {
+            Sink*         sink;
+            std::uint32_t size;
+            this->copy_out(read, &sink, sizeof(sink));
+            this->copy_out(read + sizeof(sink), &size, sizeof(size));
+
+            const std::size_t begin = (read + header_size) & this->mask;
+            if (begin + size <= this->capacity()) {
+                func(sink, std::string_view(this->buffer.get() + begin, size));
+            } else {
+                scratch.resize(size);
+                this->copy_out(read + header_size, scratch.data(), size);
+                func(sink, std::string_view(scratch));
+            }
+
+            read += header_size + size;
+            ++count;
+        }
+
+        this->read_pos.store(read, std::memory_order_release);
+        return count;
+    }
+
+private:
+    void copy_in(std::uint64_t pos, const void* src, std::size_t size) {
+        const std::size_t begin = pos & this->mask;
+        const std::size_t first = std::min(size, this->capacity() - begin);
+        std::memcpy(this->buffer.get() + begin, src, first);
+        std::memcpy(this->buffer.get(), static_cast<const char*>(src) + first, size - first);
+    }
+
+    void copy_out(std::uint64_t pos, void* dst, std::size_t size) const {
+        const std::size_t begin = pos & this->mask;
+        const std::size_t first = std::min(size, this->capacity() - begin);
+        std::memcpy(dst, this->buffer.get() + begin, first);
+        std::memcpy(static_cast<char*>(dst) + first, this->buffer.get(), size - first);
+    }
+
+    std::unique_ptr<char[]> buffer;
+    std::size_t             buffer_size;
+    std::size_t             mask;
+
+    // producer and consumer positions live on separate cache lines
+    alignas(64) std::atomic<std::uint64_t> write_pos{0};
+    std::uint64_t                          cached_read_pos = 0; // producer's last view of 'read_pos'
+    alignas(64) std::atomic<std::uint64_t> read_pos{0};
+};
+
+class _AsyncBackend {
+public:
+    // rings start at this size and double when full
+    static constexpr std::size_t initial_ring_capacity = std::size_t{16} << 10;
+
+    _AsyncBackend(std::size_t ring_capacity, std::size_t total_capacity, Overflow overflow);
+    ~_AsyncBackend();
+
+    _AsyncBackend(const _AsyncBackend&) = delete;
+    _AsyncBackend& operator=(const _AsyncBackend&) = delete;
+
+    void push(Sink& sink, std::string_view message);
+
+    // Blocks until everything pushed so far has been written
+    void flush();
+
+private:
+    std::shared_ptr<_AsyncRing>& local_ring();
+    bool                         grow_ring(std::shared_ptr<_AsyncRing>& ring);
+    void                         add_ring(std::shared_ptr<_AsyncRing> ring);
+    void                         wake_writer();
+    void                         writer_loop();
+
+    std::size_t ring_capacity;  // limit of one ring
+    std::size_t total_capacity; // limit of all rings together, only growing checks it
+    Overflow    overflow;
+
+    std::atomic<std::size_t> ring_bytes{0};
+
+    std::mutex                               rings_mutex;
+    std::vector<std::shared_ptr<_AsyncRing>> rings;
+    std::atomic<std::uint64_t>               rings_version{0};
+
+    std::mutex              wake_mutex;
+    std::condition_variable wake_cv;
+    std::atomic<bool>       writer_sleeping{false};
+    bool                    stopping = false;
+
+    std::thread writer;
+};
+
+inline std::atomic<_AsyncBackend*> _async_backend{nullptr};
+
+// =========================
+// --- Binary log format ---
+// =========================
+
+// Binary sinks skip formatting on the logging thread, messages are stored as raw values and formatted
+// later by 'decode_binary_log()'. Values are in the native byte order, logs are decoded on the same platform.
+//
+// File:     [_BinaryFileHeader][record]...
+// Record:   [uint32_t body size][_BinaryKind][body]
+// Callsite: [uint32_t id][int32_t line][uint16_t file size][file]
+// Message:  [uint32_t callsite id][uint32_t thread][int64_t steady ns][uint8_t verbosity][uint8_t arg count][args]
+// Argument: [_BinaryTag][value], strings are stored as [uint32_t size][bytes]
+//
+// Callsite definitions may come after the messages that use them (they go through the ring of the thread that
+// registered the callsite), the decoder reads all definitions first.
+
+constexpr std::uint32_t _binary_magic   = 0x424c5455; // "UTLB"
+constexpr std::uint32_t _binary_version = 1;
+
+constexpr std::uint32_t _binary_max_callsites = 1u << 20; // decoder rejects larger ids as corrupt
+
+struct _BinaryFileHeader {
+    std::uint32_t magic   = _binary_magic;
+    std::uint32_t version = _binary_version;
+    std::int64_t  system_ns; // system and steady clock at the time the sink was opened, to restore the datetime
+    std::int64_t  steady_ns;
+    std::int64_t  entry_steady_ns; // program entry, to restore the uptime
+};
+
+enum class _BinaryKind : std::uint8_t { CALLSITE = 0, MESSAGE = 1 };
+
+enum class _BinaryTag : std::uint8_t { INT = 0, UINT = 1, FLOAT = 2, DOUBLE = 3, BOOL = 4, CHAR = 5, STRING = 6 };
+
+template <class T>
+void _binary_put(std::string& buffer, const T& value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void _binary_put_string(std::string& buffer, std::string_view value) {
+    _binary_put(buffer, static_cast<std::uint32_t>(value.size()));
+    buffer += value;
+}
+
+// Same type priorities as 'StringifierBase::append()', so the decoded text matches the synchronous sinks
+template <class T>
+void _encode_binary_arg(std::string& buffer, const T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+        _binary_put(buffer, _BinaryTag::BOOL);
+        _binary_put(buffer, static_cast<std::uint8_t>(value));
+    } else if constexpr (std::is_same_v<T, char>) {
+        _binary_put(buffer, _BinaryTag::CHAR);
+        _binary_put(buffer, value);
+    } else if constexpr (std::is_convertible_v<T, std::string_view>) {
+        _binary_put(buffer, _BinaryTag::STRING);
+        _binary_put_string(buffer, std::string_view(value));
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        _binary_put(buffer, _BinaryTag::INT);
+        _binary_put(buffer, static_cast<std::int64_t>(value));
+    } else if constexpr (std::is_integral_v<T>) {
+        _binary_put(buffer, _BinaryTag::UINT);
+        _binary_put(buffer, static_cast<std::uint64_t>(value));
+    } else if constexpr (std::is_same_v<T, float>) {
+        _binary_put(buffer, _BinaryTag::FLOAT);
+        _binary_put(buffer, value);
+    } else if constexpr (std::is_floating_point_v<T>) {
+        _binary_put(buffer, _BinaryTag::DOUBLE);
+        _binary_put(buffer, static_cast<double>(value));
+    } else {
+        // everything else (enums, containers, printables, ...) is stringified right away
+        thread_local std::string temp;
+        temp.clear();
+        append_stringified(temp, value);
+        _binary_put(buffer, _BinaryTag::STRING);
+        _binary_put_string(buffer, temp);
+    }
+}
+
+template <class... Args>
+void _encode_binary_message(std::string& buffer, const Callsite& callsite, Verbosity verbosity, clock::time_point now,
+                            const Args&... args) {
+    static_assert(sizeof...(Args) <= std::numeric_limits<std::uint8_t>::max(), "Too many arguments for a binary log.");
+
+    const auto timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+
+    buffer.resize(sizeof(std::uint32_t)); // body size, filled in at the end
+    _binary_put(buffer, _BinaryKind::MESSAGE);
+    _binary_put(buffer, callsite.id);
+    _binary_put(buffer, static_cast<std::uint32_t>(_this_thread_index()));
+    _binary_put(buffer, static_cast<std::int64_t>(timestamp));
+    _binary_put(buffer, static_cast<std::uint8_t>(verbosity));
+    _binary_put(buffer, static_cast<std::uint8_t>(sizeof...(Args)));
+    (_encode_binary_arg(buffer, args), ...);
+
+    const auto body_size = static_cast<std::uint32_t>(buffer.size() - sizeof(std::uint32_t));
+    std::memcpy(buffer.data(), &body_size, sizeof(body_size));
+}
+
+inline void _encode_binary_callsite(std::string& buffer, const Callsite& callsite) {
+    buffer.resize(sizeof(std::uint32_t));
+    _binary_put(buffer, _BinaryKind::CALLSITE);
+    _binary_put(buffer, callsite.id);
+    _binary_put(buffer, static_cast<std::int32_t>(callsite.line));
+    _binary_put(buffer, static_cast<std::uint16_t>(callsite.file.size()));
+    buffer += callsite.file;
+
+    const auto body_size = static_cast<std::uint32_t>(buffer.size() - sizeof(std::uint32_t));
+    std::memcpy(buffer.data(), &body_size, sizeof(body_size));
+}
+
 // ==================
 // --- Sink class ---
 // ==================
@@ -648,10 +958,13 @@ private:
     clock::duration                             flush_interval;
     Columns                                     columns;
     clock::time_point                           last_flushed;
-    bool                                        print_header = true;
+    std::atomic<bool>                           print_header = true;
+    bool                                        binary       = false;
     mutable std::mutex                          ostream_mutex;
 
     friend struct _logger;
+    friend class _AsyncBackend;
+    friend struct _BinaryLog;
 
     std::ostream& ostream_ref() {
         if (const auto ref_wrapper_ptr = std::get_if<os_ref_wrapper>(&this->os_variant)) return ref_wrapper_ptr->get();
@@ -689,7 +1002,7 @@ public:
         return *this;
     }
     Sink& skip_header(bool skip = true) {
-        this->print_header = !skip;
+        this->print_header.store(!skip);
         return *this;
     }
 
@@ -700,7 +1013,15 @@ private:
 
         thread_local std::string buffer;
 
-        const clock::time_point now = clock::now();
+        // Binary sinks store the raw values, formatting happens later in 'decode_binary_log()'
+        if (this->binary) {
+            const clock::time_point now = clock::now(); // precise, the decoder has no other way to order records
+            _encode_binary_message(buffer, callsite, meta.verbosity, now, args...);
+            this->emit(buffer, now);
+            return;
+        }
+
+        const clock::time_point now = _coarse_now();
 
         // To minimize logging overhead we use string buffer, append characters to it and then write the whole buffer
         // to `std::ostream`. This avoids the inherent overhead of ostream formatting (caused largely by
@@ -714,20 +1035,23 @@ private:
 
         buffer.clear();
 
-        // Print log header on the first call
-        {
-            static std::mutex     header_mutex;
-            const std::lock_guard lock(header_mutex);
-            if (this->print_header) {
-                this->print_header = false;
-                this->format_header(buffer);
-            }
-            // no need to lock the buffer, other threads can't reach buffer
-            // output code while they're stuck waiting for the header to print
+        // Print log header on the first call, only one thread wins the exchange
+        if (this->print_header.load(std::memory_order_relaxed) && this->print_header.exchange(false)) {
+            this->format_header(buffer);
         }
 
-        // Format columns one-by-one
-        if (this->colors == Colors::ENABLE) switch (meta.verbosity) {
+        this->format_columns(buffer, _coarse_time(), now - _program_entry_time_point, _this_thread_index(), callsite,
+                             meta.verbosity,
+                             [&] { append_stringified(buffer, args...); });
+
+        this->emit(buffer, now);
+    }
+
+    // Format columns one-by-one, 'append_message' appends the message itself
+    template <class AppendMessage>
+    void format_columns(std::string& buffer, std::time_t datetime, clock::duration uptime, std::size_t thread,
+                        const Callsite& callsite, Verbosity verbosity, AppendMessage&& append_message) {
+        if (this->colors == Colors::ENABLE) switch (verbosity) {
             case Verbosity::ERR: buffer += _color_err; break;
             case Verbosity::WARN: buffer += _color_warn; break;
             case Verbosity::NOTE: buffer += _color_note; break;
@@ -736,20 +1060,39 @@ private:
             case Verbosity::TRACE: buffer += _color_trace; break;
             }
 
-        if (this->columns.datetime) this->format_column_datetime(buffer);
-        if (this->columns.uptime) this->format_column_uptime(buffer, now);
-        if (this->columns.thread) this->format_column_thread(buffer);
+        if (this->columns.datetime) this->format_column_datetime(buffer, datetime);
+        if (this->columns.uptime) this->format_column_uptime(buffer, uptime);
+        if (this->columns.thread) this->format_column_thread(buffer, thread);
         if (this->columns.callsite) this->format_column_callsite(buffer, callsite);
-        if (this->columns.level) this->format_column_level(buffer, meta.verbosity);
-        if (this->columns.message) this->format_column_message(buffer, args...);
+        if (this->columns.level) this->format_column_level(buffer, verbosity);
+        if (this->columns.message) {
+            buffer += _col_ld_message;
+            append_message();
+            buffer += _col_rd_message;
+        }
 
         if (this->colors == Colors::ENABLE) buffer += _color_reset;
+    }
+
+    void emit(std::string_view record, clock::time_point now) {
+        // Hand the record to the writer thread when async logging is enabled
+        if (const auto backend = _async_backend.load(std::memory_order_acquire)) {
+            backend->push(*this, record);
+            return;
+        }
+
+        this->write(record, now, false);
+    }
 
+    void write(std::string_view message, clock::time_point now, bool defer_flush) {
         // 'std::ostream' isn't guaranteed to be thread-safe, even through many implementations seem to have
         // some thread-safety built into `std::cout` the same cannot be said about a generic 'std::ostream'
         const std::lock_guard ostream_lock(this->ostream_mutex);
 
-        this->ostream_ref().write(buffer.data(), buffer.size());
+        this->ostream_ref().write(message.data(), message.size());
+
+        // async writer flushes once per batch instead, see 'flush_if_due()'
+        if (defer_flush) return;
 
         // flush every message immediately
         if (this->flush_interval.count() == 0) {
@@ -762,6 +1105,15 @@ private:
         }
     }
 
+    void flush_if_due(clock::time_point now, bool force) {
+        const std::lock_guard ostream_lock(this->ostream_mutex);
+
+        if (force || this->flush_interval.count() == 0 || now - this->last_flushed > this->flush_interval) {
+            this->last_flushed = now;
+            this->ostream_ref().flush();
+        }
+    }
+
     void format_header(std::string& buffer) {
         if (this->colors == Colors::ENABLE) buffer += _color_heading;
         if (this->columns.datetime)
@@ -779,25 +1131,31 @@ private:
         if (this->colors == Colors::ENABLE) buffer += _color_reset;
     }
 
-    void format_column_datetime(std::string& buffer) {
-        std::time_t timer = std::time(nullptr);
-        std::tm     time_moment{};
-
-        _available_localtime_impl(&time_moment, &timer);
-
-        // Format time straight into the buffer
-        std::array<char, _col_w_datetime + 1>
-            strftime_buffer; // size includes the null terminator added by 'strftime()'
-        std::strftime(strftime_buffer.data(), strftime_buffer.size(), "%Y-%m-%d %H:%M:%S", &time_moment);
+    void format_column_datetime(std::string& buffer, std::time_t timer) {
+        // 'localtime()' + 'strftime()' only run when the second changes, the text is cached per thread
+        // so threads don't share (and bounce) the cache line
+        struct cache_t {
+            std::time_t                           timer = -1;
+            std::array<char, _col_w_datetime + 1> text; // size includes the null terminator added by 'strftime()'
+        };
+        thread_local cache_t cache;
+
+        if (cache.timer != timer) {
+            std::tm time_moment{};
+            _available_localtime_impl(&time_moment, &timer);
+
+            std::strftime(cache.text.data(), cache.text.size(), "%Y-%m-%d %H:%M:%S", &time_moment);
+            cache.timer = timer;
+        }
 
-        // strftime_buffer.back() = ' '; // replace null-terminator added by 'strftime()' with a space
         buffer += _col_ld_datetime;
-        buffer.append(strftime_buffer.data(), _col_w_datetime);
+        buffer.append(cache.text.data(), _col_w_datetime);
         buffer += _col_rd_datetime;
     }
 
-    void format_column_uptime(std::string& buffer, clock::time_point now) {
-        const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - _program_entry_time_point);
+    void format_column_uptime(std::string& buffer, clock::duration uptime) {
+        // the coarse clock may trail the precise program entry time by one tick right after startup
+        const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::max(uptime, clock::duration{}));
         const auto sec        = (elapsed_ms / 1000).count();
         const auto ms         = (elapsed_ms % 1000).count(); // is 'elapsed_ms - 1000 * full_seconds; faster?
 
@@ -819,8 +1177,7 @@ private:
         buffer += _col_rd_uptime;
     }
 
-    void format_column_thread(std::string& buffer) {
-        const auto thread_id       = _get_thread_index(std::this_thread::get_id());
+    void format_column_thread(std::string& buffer, std::size_t thread_id) {
         const auto thread_id_width = _integer_digit_count(thread_id);
 
         buffer += _col_ld_thread;
@@ -858,13 +1215,6 @@ private:
         }
         buffer += _col_rd_level;
     }
-
-    template <class... Args>
-    void format_column_message(std::string& buffer, const Args&... args) {
-        buffer += _col_ld_message;
-        append_stringified(buffer, args...);
-        buffer += _col_rd_message;
-    }
 };
 
 // ====================
@@ -896,6 +1246,488 @@ struct _logger {
     }
 };
 
+// ==========================
+// --- Async backend impl ---
+// ==========================
+
+inline _AsyncBackend::_AsyncBackend(std::size_t ring_capacity, std::size_t total_capacity, Overflow overflow)
+    : ring_capacity(ring_capacity), total_capacity(total_capacity), overflow(overflow) {
+    this->writer = std::thread([this] { this->writer_loop(); });
+}
+
+inline _AsyncBackend::~_AsyncBackend() {
+    // new messages go through the synchronous path from here on, the writer drains what is queued
+    _async_backend.store(nullptr);
+    {
+        const std::lock_guard lock(this->wake_mutex);
+        this->stopping = true;
+    }
+    this->wake_cv.notify_all();
+    if (this->writer.joinable()) this->writer.join();
+}
+
+inline std::shared_ptr<_AsyncRing>& _AsyncBackend::local_ring() {
+    struct holder_t {
+        std::shared_ptr<_AsyncRing> ring;
+        ~holder_t() {
+            if (this->ring) this->ring->abandoned.store(true);
+        }
+    };
+    thread_local holder_t holder;
+
+    if (!holder.ring) {
+        holder.ring = std::make_shared<_AsyncRing>(std::min(initial_ring_capacity, this->ring_capacity));
+        this->ring_bytes.fetch_add(holder.ring->capacity());
+        this->add_ring(holder.ring);
+    }
+
+    return holder.ring;
+}
+
+// Swaps the ring of this thread for one twice the size, false at the limit of a ring or of all of them.
+// The old ring is abandoned, the writer drains it before the new one, which comes after it in 'rings'.
+inline bool _AsyncBackend::grow_ring(std::shared_ptr<_AsyncRing>& ring) {
+    const std::size_t capacity = ring->capacity() * 2;
+    if (capacity > this->ring_capacity) return false;
+
+    std::size_t bytes = this->ring_bytes.load();
+    do {
+        if (bytes + capacity > this->total_capacity) return false;
+    } while (!this->ring_bytes.compare_exchange_weak(bytes, bytes + capacity));
+
+    auto bigger = std::make_shared<_AsyncRing>(capacity);
+    ring->abandoned.store(true);
+    ring = std::move(bigger);
+    this->add_ring(ring);
+    return true;
+}
+
+inline void _AsyncBackend::add_ring(std::shared_ptr<_AsyncRing> ring) {
+    const std::lock_guard lock(this->rings_mutex);
+    this->rings.push_back(std::move(ring));
+    this->rings_version.fetch_add(1);
+}
+
+inline void _AsyncBackend::wake_writer() {
+    {
+        const std::lock_guard lock(this->wake_mutex);
+        this->writer_sleeping.store(false);
+    }
+    this->wake_cv.notify_one();
+}
+
+inline void _AsyncBackend::push(Sink& sink, std::string_view message) {
+    std::shared_ptr<_AsyncRing>& ring = this->local_ring();
+
+    // a message that can never fit would block forever, write it synchronously
+    const std::size_t record_size = _AsyncRing::header_size + message.size();
+    if (record_size > this->ring_capacity / 2) {
+        sink.write(message, clock::now(), false);
+        return;
+    }
+
+    while (!ring->try_push(&sink, message)) {
+        if (this->grow_ring(ring)) continue;
+
+        // the ring can't grow any more and the message would never fit it
+        if (record_size > ring->capacity() / 2) {
+            sink.write(message, clock::now(), false);
+            return;
+        }
+        if (this->overflow == Overflow::DROP) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        this->wake_writer();
+        std::this_thread::yield();
+    }
+
+    // the writer polls on its own, producers only wake it up early when their ring is filling up
+    if (ring->over_half() && this->writer_sleeping.load(std::memory_order_relaxed)) this->wake_writer();
+}
+
+inline void _AsyncBackend::flush() {
+    while (true) {
+        bool empty = true;
+        {
+            const std::lock_guard lock(this->rings_mutex);
+            for (const auto& ring : this->rings) empty = empty && ring->empty();
+        }
+        if (empty) break;
+
+        this->wake_writer();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+inline void _AsyncBackend::writer_loop() {
+    std::vector<std::shared_ptr<_AsyncRing>> local_rings;
+    std::uint64_t                            local_version = 0;
+
+    std::vector<Sink*> touched_sinks; // written to since the last flush
+    std::vector<Sink*> known_sinks;   // receive the dropped messages notice
+    std::string        scratch;
+
+    while (true) {
+        if (this->rings_version.load() != local_version) {
+            const std::lock_guard lock(this->rings_mutex);
+            local_rings   = this->rings;
+            local_version = this->rings_version.load();
+        }
+
+        const clock::time_point now       = clock::now();
+        std::size_t             count     = 0;
+        std::uint64_t           dropped   = 0;
+        bool                    abandoned = false;
+
+        for (const auto& ring : local_rings) {
+            count += ring->consume(scratch, [&](Sink* sink, std::string_view message) {
+                sink->write(message, now, true);
+                if (std::find(touched_sinks.begin(), touched_sinks.end(), sink) == touched_sinks.end()) {
+                    touched_sinks.push_back(sink);
+                    if (std::find(known_sinks.begin(), known_sinks.end(), sink) == known_sinks.end())
+                        known_sinks.push_back(sink);
+                }
+            });
+            dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+            abandoned = abandoned || ring->abandoned.load();
+        }
+
+        if (dropped) {
+            std::string notice;
+            append_stringified(notice, "[utl::log] ", dropped, " messages dropped, async log buffer is full\n");
+            for (auto sink : known_sinks) {
+                if (sink->binary) continue; // plain text would corrupt the record stream
+                sink->write(notice, now, true);
+                if (std::find(touched_sinks.begin(), touched_sinks.end(), sink) == touched_sinks.end())
+                    touched_sinks.push_back(sink);
+            }
+        }
+
+        // one flush per batch instead of one per message
+        for (auto sink : touched_sinks) sink->flush_if_due(now, count == 0);
+        if (count == 0) touched_sinks.clear();
+
+        if (count != 0) continue;
+
+        // forget rings of exited threads and rings replaced by a bigger one once they are drained
+        if (abandoned) {
+            const std::lock_guard lock(this->rings_mutex);
+            this->rings.erase(std::remove_if(this->rings.begin(), this->rings.end(),
+                                             [this](const auto& ring) {
+                                                 if (!ring->abandoned.load() || !ring->empty()) return false;
+                                                 this->ring_bytes.fetch_sub(ring->capacity());
+                                                 return true;
+                                             }),
+                              this->rings.end());
+            this->rings_version.fetch_add(1);
+        }
+
+        std::unique_lock lock(this->wake_mutex);
+        if (this->stopping) break;
+
+        // poll every 10 ms, producers wake us up early when a ring is getting full
+        this->writer_sleeping.store(true);
+        this->wake_cv.wait_for(lock, std::chrono::milliseconds(10),
+                               [this] { return this->stopping || !this->writer_sleeping.load(); });
+        this->writer_sleeping.store(false);
+    }
+}
+
+// Moves sink output to a background writer thread. Each logging thread gets a 16 KB ring that doubles when it
+// fills, up to 'ring_capacity' bytes (rounded up to a power of 2) and while all rings together stay within
+// 'total_capacity'. A full ring that can't grow either blocks the logging thread or drops the message.
+// Only the first call has an effect, the backend lives until static destruction.
+inline void enable_async(std::size_t ring_capacity = std::size_t{1} << 20, Overflow overflow = Overflow::BLOCK,
+                         std::size_t total_capacity = std::size_t{64} << 20) {
+    std::size_t capacity = 1024;
+    while (capacity < ring_capacity) capacity *= 2;
+
+    static _AsyncBackend backend(capacity, total_capacity, overflow);
+    _async_backend.store(&backend, std::memory_order_release);
+}
+
+// Blocks until queued async messages are written, no-op for synchronous logging
+inline void flush() {
+    if (const auto backend = _async_backend.load(std::memory_order_acquire)) backend->flush();
+}
+
+// ==================
+// --- Binary log ---
+// ==================
+
+struct _BinaryLog {
+    std::mutex            mutex;
+    std::vector<Callsite> callsites;
+    std::vector<Sink*>    sinks;
+
+    static _BinaryLog& instance() {
+        static _BinaryLog binary_log;
+        return binary_log;
+    }
+
+    Callsite register_callsite(std::string_view file, int line) {
+        const std::lock_guard lock(this->mutex);
+
+        const Callsite callsite{file, line, static_cast<std::uint32_t>(this->callsites.size())};
+        this->callsites.push_back(callsite);
+
+        std::string record;
+        _encode_binary_callsite(record, callsite);
+        for (auto sink : this->sinks) sink->emit(record, clock::now());
+
+        return callsite;
+    }
+
+    void init_sink(Sink& sink) {
+        const auto to_ns = [](auto time_point) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(time_point.time_since_epoch()).count();
+        };
+
+        _BinaryFileHeader header;
+        header.system_ns       = to_ns(std::chrono::system_clock::now());
+        header.steady_ns       = to_ns(clock::now());
+        header.entry_steady_ns = to_ns(_program_entry_time_point);
+
+        sink.binary = true;
+        sink.print_header.store(false);
+        sink.write(std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)), clock::now(), true);
+
+        const std::lock_guard lock(this->mutex);
+
+        // callsites that were hit before the sink existed
+        std::string record;
+        for (const auto& callsite : this->callsites) {
+            _encode_binary_callsite(record, callsite);
+            sink.write(record, clock::now(), true);
+        }
+
+        this->sinks.push_back(&sink);
+    }
+
+    static bool decode(std::istream& is, std::ostream& os, Colors colors, const Columns& columns);
+};
+
+// Called once per logging macro, see 'utl_log_callsite()'
+inline Callsite _register_callsite(std::string_view file, int line) {
+    return _BinaryLog::instance().register_callsite(file, line);
+}
+
+inline bool _BinaryLog::decode(std::istream& is, std::ostream& os, Colors colors, const Columns& columns) {
+    _BinaryFileHeader header{};
+    if (!is.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (header.magic != _binary_magic || header.version != _binary_version) return false;
+
+    const auto records_begin = is.tellg();
+    is.seekg(0, std::ios::end);
+    const auto records_end = is.tellg();
+    if (records_begin < 0 || records_end < records_begin) return false;
+
+    // Calls 'func(kind, body)' for every complete record, a record cut short at the end of the file
+    // (process killed while writing) just ends the log
+    std::string body;
+    const auto  for_each_record = [&](auto&& func) {
+        is.clear();
+        is.seekg(records_begin);
+
+        std::uint32_t body_size;
+        while (is.read(reinterpret_cast<char*>(&body_size), sizeof(body_size))) {
+            // a size past the end of the file is either a cut record or garbage, don't allocate it
+            if (body_size > records_end - is.tellg()) break;
+            body.resize(body_size);
+            if (!is.read(body.data(), body_size) || body.empty()) break;
+            if (!func(static_cast<_BinaryKind>(body[0]), std::string_view(body).substr(1))) return false;
+        }
+        return true;
+    };
+
+    const auto get = [](std::string_view& in, auto& value) {
+        if (in.size() < sizeof(value)) return false;
+        std::memcpy(&value, in.data(), sizeof(value));
+        in.remove_prefix(sizeof(value));
+        return true;
+    };
+
+    // Pass 1: callsite definitions, they may come after the first messages that use them
+    std::vector<std::string> files;
+    std::vector<Callsite>    callsites;
+
+    const bool defs_ok = for_each_record([&](_BinaryKind kind, std::string_view in) {
+        if (kind != _BinaryKind::CALLSITE) return true;
+
+        std::uint32_t id;
+        std::int32_t  line;
+        std::uint16_t file_size;
+        if (!get(in, id) || !get(in, line) || !get(in, file_size) || in.size() < file_size) return false;
+        if (id >= _binary_max_callsites) return false;
+
+        if (callsites.size() <= id) {
+            callsites.resize(id + 1);
+            files.resize(id + 1);
+        }
+        files[id]     = std::string(in.substr(0, file_size));
+        callsites[id] = Callsite{{}, line, id};
+        return true;
+    });
+    if (!defs_ok) return false;
+
+    for (std::size_t i = 0; i < callsites.size(); ++i) {
+        if (files[i].empty()) callsites[i].file = "?";
+        else callsites[i].file = files[i];
+    }
+
+    // Pass 2: messages
+    Sink        sink(std::ref(os), Verbosity::TRACE, colors, std::chrono::milliseconds{0}, columns);
+    std::string buffer;
+
+    sink.format_header(buffer);
+    os.write(buffer.data(), buffer.size());
+
+    const Callsite unknown_callsite{"?", 0};
+
+    return for_each_record([&](_BinaryKind kind, std::string_view in) {
+        if (kind == _BinaryKind::CALLSITE) return true;
+        if (kind != _BinaryKind::MESSAGE) return false;
+
+        std::uint32_t callsite_id, thread;
+        std::int64_t  timestamp;
+        std::uint8_t  verbosity, arg_count;
+        if (!get(in, callsite_id) || !get(in, thread) || !get(in, timestamp) || !get(in, verbosity) ||
+            !get(in, arg_count))
+            return false;
+
+        const auto system_ns = header.system_ns + (timestamp - header.steady_ns);
+        const auto datetime  = static_cast<std::time_t>(system_ns / 1'000'000'000);
+        const auto uptime    = std::chrono::duration_cast<clock::duration>(
+            std::chrono::nanoseconds(timestamp - header.entry_steady_ns));
+
+        const Callsite& callsite = (callsite_id < callsites.size()) ? callsites[callsite_id] : unknown_callsite;
+
+        bool args_ok = true;
+        buffer.clear();
+        sink.format_columns(buffer, datetime, uptime, thread, callsite, static_cast<Verbosity>(verbosity), [&] {
+            for (std::uint8_t i = 0; i < arg_count && args_ok; ++i) {
+                _BinaryTag tag;
+                args_ok = get(in, tag);
+                if (!args_ok) break;
+
+                switch (tag) {
+                case _BinaryTag::INT: {
+                    std::int64_t value;
+                    if ((args_ok = get(in, value))) append_stringified(buffer, value);
+                } break;
+                case _BinaryTag::UINT: {
+                    std::uint64_t value;
+                    if ((args_ok = get(in, value))) append_stringified(buffer, value);
+                } break;
+                case _BinaryTag::FLOAT: {
+                    float value;
+                    if ((args_ok = get(in, value))) append_stringified(buffer, value);
+                } break;
+                case _BinaryTag::DOUBLE: {
+                    double value;
+                    if ((args_ok = get(in, value))) append_stringified(buffer, value);
+                } break;
+                case _BinaryTag::BOOL: {
+                    std::uint8_t value;
+                    if ((args_ok = get(in, value))) append_stringified(buffer, value != 0);
+                } break;
+                case _BinaryTag::CHAR: {
+                    char value;
+                    if ((args_ok = get(in, value))) buffer += value;
+                } break;
+                case _BinaryTag::STRING: {
+                    std::uint32_t size;
+                    if ((args_ok = get(in, size) && in.size() >= size)) {
+                        buffer += in.substr(0, size);
+                        in.remove_prefix(size);
+                    }
+                } break;
+                default: args_ok = false;
+                }
+            }
+        });
+        if (!args_ok) return false;
+
+        os.write(buffer.data(), buffer.size());
+        return true;
+    });
+}
+
+// Binary sink, messages cost a few memcpy's on the logging thread and are formatted by 'decode_binary_log()'.
+// Pairs well with 'enable_async()', otherwise records are still written under the sink lock.
+inline Sink& add_binary_sink(const std::string& filename,                                   //
+                             Verbosity          verbosity      = Verbosity::TRACE,          //
+                             clock::duration    flush_interval = std::chrono::milliseconds{15} //
+) {
+    auto& sink = _logger::instance().sinks.emplace_back(std::ofstream(filename, std::ios::out | std::ios::binary),
+                                                        verbosity, Colors::DISABLE, flush_interval, Columns{});
+    _BinaryLog::instance().init_sink(sink);
+    return sink;
+}
+
+// Writes a binary log as text, same layout as the text sinks. Returns 'false' on a malformed log.
+inline bool decode_binary_log(std::istream& is, std::ostream& os, Colors colors = Colors::DISABLE,
+                              const Columns& columns = Columns{}) {
+    return _BinaryLog::decode(is, os, colors, columns);
+}
+
+// =====================
+// --- Rate limiting ---
+// =====================
+
+// Per-callsite limit for 'UTL_LOG_LIMITED()': lets through 1 in 'every' messages,
+// and of those at most 'per_second' in any one second (0 - no per second limit)
+struct RateLimit {
+    std::uint32_t every      = 1;
+    std::uint32_t per_second = 0;
+};
+
+struct _LimiterPass {
+    bool          allowed    = false;
+    std::uint64_t suppressed = 0; // messages dropped at this callsite since the last one that passed
+
+    explicit operator bool() const { return this->allowed; }
+
+    std::string note() const { return this->suppressed ? stringify(" (+", this->suppressed, " suppressed)") : ""; }
+};
+
+class _CallsiteLimiter {
+public:
+    explicit _CallsiteLimiter(RateLimit limit) : limit(limit) {
+        if (this->limit.every == 0) this->limit.every = 1;
+    }
+
+    _LimiterPass pass() {
+        bool allowed = this->count.fetch_add(1, std::memory_order_relaxed) % this->limit.every == 0;
+
+        if (allowed && this->limit.per_second) {
+            const std::int64_t second =
+                std::chrono::duration_cast<std::chrono::seconds>(_coarse_now().time_since_epoch()).count();
+
+            // first caller in a new second resets the window, late callers of the old second count towards it
+            std::int64_t window = this->window.load(std::memory_order_relaxed);
+            if (window != second && this->window.compare_exchange_strong(window, second))
+                this->window_count.store(0, std::memory_order_relaxed);
+
+            allowed = this->window_count.fetch_add(1, std::memory_order_relaxed) < this->limit.per_second;
+        }
+
+        if (!allowed) {
+            this->suppressed.fetch_add(1, std::memory_order_relaxed);
+            return {};
+        }
+        return {true, this->suppressed.exchange(0, std::memory_order_relaxed)};
+    }
+
+private:
+    RateLimit                  limit;
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::int64_t>  window{0};
+    std::atomic<std::uint32_t> window_count{0};
+    std::atomic<std::uint64_t> suppressed{0};
+};
+
 // =======================
 // --- Sink public API ---
 // =======================
@@ -925,25 +1757,44 @@ inline Sink& add_file_sink(const std::string& filename,
 // --- Logging macros ---
 // ======================
 
+// Registers the callsite on the first pass, the static lives in a lambda so the macros stay expressions
+#define utl_log_callsite()                                                                                             \
+    []() -> const utl::log::Callsite& {                                                                                \
+        static const utl::log::Callsite callsite = utl::log::_register_callsite(__FILE__, __LINE__);                   \
+        return callsite;                                                                                               \
+    }()
+
 #define UTL_LOG_ERR(...)                                                                                               \
-    utl::log::_logger::instance().push_message({__FILE__, __LINE__}, {utl::log::Verbosity::ERR}, __VA_ARGS__)
+    utl::log::_logger::instance().push_message(utl_log_callsite(), {utl::log::Verbosity::ERR}, __VA_ARGS__)
 
 #define UTL_LOG_WARN(...)                                                                                              \
-    utl::log::_logger::instance().push_message({__FILE__, __LINE__}, {utl::log::Verbosity::WARN}, __VA_ARGS__)
+    utl::log::_logger::instance().push_message(utl_log_callsite(), {utl::log::Verbosity::WARN}, __VA_ARGS__)
 
 #define UTL_LOG_NOTE(...)                                                                                              \
-    utl::log::_logger::instance().push_message({__FILE__, __LINE__}, {utl::log::Verbosity::NOTE}, __VA_ARGS__)
+    utl::log::_logger::instance().push_message(utl_log_callsite(), {utl::log::Verbosity::NOTE}, __VA_ARGS__)
 
 #define UTL_LOG_INFO(...)                                                                                              \
-    utl::log::_logger::instance().push_message({__FILE__, __LINE__}, {utl::log::Verbosity::INFO}, __VA_ARGS__)
+    utl::log::_logger::instance().push_message(utl_log_callsite(), {utl::log::Verbosity::INFO}, __VA_ARGS__)
 
 #define UTL_LOG_DEBUG(...)                                                                                             \
-    utl::log::_logger::instance().push_message({__FILE__, __LINE__}, {utl::log::Verbosity::DEBUG}, __VA_ARGS__)
+    utl::log::_logger::instance().push_message(utl_log_callsite(), {utl::log::Verbosity::DEBUG}, __VA_ARGS__)
 
 #define UTL_LOG_TRACE(...)                                                                                             \
-    utl::log::_logger::instance().push_message({__FILE__, __LINE__}, {utl::log::Verbosity::TRACE}, __VA_ARGS__)
+    utl::log::_logger::instance().push_message(utl_log_callsite(), {utl::log::Verbosity::TRACE}, __VA_ARGS__)
+
+// Rate limited logging for hot paths, 'level_' is one of ERR/WARN/NOTE/INFO/DEBUG/TRACE and 'limit_' is a 'RateLimit'.
+// The next message that passes mentions how many were suppressed in between.
+// Note: a braced 'RateLimit{a, b}' has to be parenthesized, the comma splits macro arguments otherwise.
+#define UTL_LOG_LIMITED(level_, limit_, ...)                                                                           \
+    do {                                                                                                               \
+        static utl::log::_CallsiteLimiter utl_log_limiter(limit_);                                                     \
+        if (const auto utl_log_pass = utl_log_limiter.pass())                                                          \
+            utl::log::_logger::instance().push_message(utl_log_callsite(), {utl::log::Verbosity::level_}, __VA_ARGS__, \
+                                                       utl_log_pass.note());                                           \
+    } while (false)
 
 #ifdef _DEBUG
+#define UTL_LOG_DLIMITED(...) UTL_LOG_LIMITED(__VA_ARGS__)
 #define UTL_LOG_DERR(...) UTL_LOG_ERR(__VA_ARGS__)
 #define UTL_LOG_DWARN(...) UTL_LOG_WARN(__VA_ARGS__)
 #define UTL_LOG_DNOTE(...) UTL_LOG_NOTE(__VA_ARGS__)
@@ -951,6 +1802,7 @@ inline Sink& add_file_sink(const std::string& filename,
 #define UTL_LOG_DDEBUG(...) UTL_LOG_DEBUG(__VA_ARGS__)
 #define UTL_LOG_DTRACE(...) UTL_LOG_TRACE(__VA_ARGS__)
 #else
+#define UTL_LOG_DLIMITED(...)
 #define UTL_LOG_DERR(...)
 #define UTL_LOG_DWARN(...)
 #define UTL_LOG_DNOTE(...)
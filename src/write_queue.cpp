@@ -0,0 +1,165 @@
+#include "write_queue.hpp"
+
+#include <algorithm>
+
+std::optional<write_policy_t> parse_write_policy(std::string_view text) {
+    if(text == "drop") return write_policy_t::drop;
+    if(text == "coalesce") return write_policy_t::coalesce;
+    if(text == "block") return write_policy_t::block;
+    return std::nullopt;
+}
+
+void write_queue_t::gauge(int64_t delta) {
+    if(endpoint_) {
+        endpoint_->stats.write_queue_depth += delta;
+    }
+}
+
+void write_queue_t::note_full() {
+    // counted as it goes, so a device that stays stuck shows up in the periodic stats
+    const auto now = std::chrono::steady_clock::now();
+    if(full_since_ && endpoint_) {
+        endpoint_->stats.backpressure_us += std::chrono::duration_cast<std::chrono::microseconds>(now - *full_since_).count();
+    }
+    full_since_ = now;
+}
+
+void write_queue_t::count_backpressure() {
+    if(!full_since_) return;
+    if(endpoint_) {
+        endpoint_->stats.backpressure_us += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - *full_since_).count();
+    }
+    full_since_ = std::nullopt;
+}
+
+void write_queue_t::attach(target_endpoint_ptr_t endpoint) {
+    std::lock_guard lock(mutex_);
+    // whatever was left from the last connection is not counted anywhere
+    clear_locked();
+    endpoint_ = std::move(endpoint);
+}
+
+void write_queue_t::clear() {
+    std::lock_guard lock(mutex_);
+    clear_locked();
+}
+
+void write_queue_t::clear_locked() {
+    if(endpoint_) {
+        endpoint_->stats.write_queue_dropped += queue_.size();
+    }
+    count_backpressure();
+    gauge(-static_cast<int64_t>(size_));
+
+    queue_.clear();
+    size_            = 0;
+    writing_counted_ = false;
+    endpoint_        = nullptr;
+
+    if(!writer_active_) {
+        idle_cv_.notify_all();
+    }
+}
+
+bool write_queue_t::has_room(std::size_t n) const {
+    std::lock_guard lock(mutex_);
+    return fits(n);
+}
+
+void write_queue_t::hold() {
+    std::lock_guard lock(mutex_);
+    note_full();
+}
+
+write_queue_t::push_res_t write_queue_t::push(const std::vector<payload_t>& frames, frame_tag_t tag, bool& start_writing,
+                                              std::optional<std::chrono::steady_clock::time_point> received) {
+    start_writing = false;
+    if(frames.empty()) return push_res_t::queued;
+
+    std::lock_guard lock(mutex_);
+    auto res = push_res_t::queued;
+
+    if(!fits(frames.size())) {
+        note_full();
+
+        if(policy_ == write_policy_t::block) {
+            return push_res_t::held;
+        }
+
+        if(policy_ == write_policy_t::coalesce) {
+            auto stale = std::remove_if(queue_.begin(), queue_.end(), [tag](const queued_frame_t& e) { return e.tag == tag; });
+            const auto removed = static_cast<std::size_t>(std::distance(stale, queue_.end()));
+            queue_.erase(stale, queue_.end());
+            size_ -= removed;
+            gauge(-static_cast<int64_t>(removed));
+            if(endpoint_) {
+                endpoint_->stats.write_queue_coalesced += removed;
+            }
+            res = push_res_t::coalesced;
+        }
+
+        if(!fits(frames.size())) {
+            if(endpoint_) {
+                endpoint_->stats.write_queue_dropped += frames.size();
+            }
+            return push_res_t::dropped;
+        }
+    }
+
+    for(auto& frame : frames) {
+        queue_.push_back({ &frame, tag, std::nullopt });
+    }
+    queue_.back().received = received;
+    size_ += frames.size();
+    gauge(static_cast<int64_t>(frames.size()));
+
+    if(!writer_active_) {
+        writer_active_ = true;
+        start_writing  = true;
+    }
+    return res;
+}
+
+const queued_frame_t* write_queue_t::next() {
+    std::lock_guard lock(mutex_);
+    if(queue_.empty()) {
+        writer_active_ = false;
+        idle_cv_.notify_all();
+        return nullptr;
+    }
+
+    writing_ = queue_.front();
+    queue_.pop_front();
+    writing_counted_ = true;
+    return &writing_;
+}
+
+bool write_queue_t::done() {
+    std::lock_guard lock(mutex_);
+    if(writing_counted_) {
+        writing_counted_ = false;
+        size_--;
+        gauge(-1);
+        if(size_ < limit_) {
+            count_backpressure();
+        }
+    }
+
+    if(queue_.empty()) {
+        writer_active_ = false;
+        idle_cv_.notify_all();
+        return false;
+    }
+    return true;
+}
+
+bool write_queue_t::idle() const {
+    std::lock_guard lock(mutex_);
+    return !writer_active_ && queue_.empty();
+}
+
+bool write_queue_t::wait_idle(std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock lock(mutex_);
+    return idle_cv_.wait_until(lock, deadline, [&] { return !writer_active_ && queue_.empty(); });
+}
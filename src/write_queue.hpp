@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "target_pool.hpp"
+
+using payload_t = std::vector<uint8_t>;
+
+// What a device does when its write queue has no room for new frames
+enum class write_policy_t {
+    drop,       // the new frames are dropped
+    coalesce,   // queued frames of the same kind are replaced by the new ones, dropped if that isn't enough
+    block,      // the device holds its frames back until there is room, other devices go on
+};
+
+std::optional<write_policy_t> parse_write_policy(std::string_view text);
+
+// Kind of a queued frame, coalescing only replaces frames of the same kind
+enum class frame_tag_t : uint8_t {
+    reply,
+    event,
+    main,
+};
+
+struct queued_frame_t {
+    // a frame of the static payload tables of device_payloads, which outlive every queue
+    const payload_t* data = nullptr;
+    frame_tag_t      tag = frame_tag_t::main;
+    // set on the last frame of a reply, when the command it answers was read
+    std::optional<std::chrono::steady_clock::time_point> received;
+};
+
+// Bounded queue of the frames of one device, drained by a chain of async writes on the stream's
+// executor. Frames are pushed by the device's manage thread and written by the I/O thread, the
+// queue keeps the frame being written alive until its write completes, also across clear().
+//
+// Depth, drops, coalesced frames and time spent without room are counted in the stats of the
+// endpoint the queue is attached to.
+class write_queue_t {
+public:
+    enum class push_res_t {
+        queued,
+        coalesced,  // queued, after dropping older frames of the same kind
+        dropped,
+        held,       // block policy, the frames stay with the caller
+    };
+
+    write_queue_t(std::size_t limit, write_policy_t policy) : limit_(std::max<std::size_t>(limit, 1)), policy_(policy) {}
+
+    write_policy_t policy() const { return policy_; }
+
+    // Frames of a new connection are counted towards this endpoint
+    void attach(target_endpoint_ptr_t endpoint);
+
+    // Drops the queued frames of a connection that is gone, a write in flight finishes into the void
+    void clear();
+
+    // The frames are queued all or none, by address, they have to stay alive until written.
+    // start_writing is set when the writer is idle and the caller has to start it. Safe to call
+    // from any thread.
+    push_res_t push(const std::vector<payload_t>& frames, frame_tag_t tag, bool& start_writing,
+                    std::optional<std::chrono::steady_clock::time_point> received = std::nullopt);
+
+    // True if n more frames fit
+    bool has_room(std::size_t n) const;
+
+    // Starts counting backpressure time, for a caller that holds its frames back itself
+    void hold();
+
+    // --- Writer side ---
+
+    // Next frame to write, nullptr when the queue is empty, which stops the writer
+    const queued_frame_t* next();
+
+    // The frame from next() is written or failed, returns false when the writer stops
+    bool done();
+
+    // True if nothing is queued or being written
+    bool idle() const;
+
+    // Waits until nothing is queued or being written, false on deadline
+    bool wait_idle(std::chrono::steady_clock::time_point deadline);
+
+private:
+    bool fits(std::size_t n) const { return size_ == 0 || size_ + n <= limit_; }
+    void clear_locked();
+    void gauge(int64_t delta);
+    void note_full();
+    void count_backpressure();
+
+    const std::size_t    limit_;
+    const write_policy_t policy_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable idle_cv_;
+
+    std::deque<queued_frame_t> queue_;
+    // frames queued plus the one being written, if it still belongs to the current connection
+    std::size_t size_ = 0;
+
+    queued_frame_t writing_;
+    bool      writer_active_    = false;
+    bool      writing_counted_  = false;
+
+    target_endpoint_ptr_t endpoint_;
+    std::optional<std::chrono::steady_clock::time_point> full_since_;
+};
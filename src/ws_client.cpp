@@ -1 +1,300 @@
 #include "ws_client.h"
+
+#include <algorithm>
+#include <cstring>
+
+ws_client_registry_t ws_clients;
+ws_server_stats_t    ws_server_stats;
+
+namespace {
+
+int64_t now_ticks() {
+    return std::chrono::system_clock::now().time_since_epoch().count();
+}
+
+std::chrono::system_clock::time_point from_ticks(int64_t ticks) {
+    return std::chrono::system_clock::time_point(std::chrono::system_clock::duration(ticks));
+}
+
+std::string hex_preview(const uint8_t* bytes, std::size_t count, bool truncated) {
+    static constexpr char digits[] = "0123456789abcdef";
+
+    std::string res;
+    res.reserve(count * 2 + 3);
+    for(std::size_t i = 0; i < count; i++) {
+        res += digits[bytes[i] >> 4];
+        res += digits[bytes[i] & 0xf];
+    }
+    if(truncated) {
+        res += "...";
+    }
+    return res;
+}
+
+}
+
+frame_error_t ws_client_entry_t::on_message(const void* data, std::size_t size) {
+    const auto res   = validate_frame(static_cast<const uint8_t*>(data), size);
+    const auto error = res.error;
+    if(error != frame_error_t::none) {
+        malformed_messages.fetch_add(1, std::memory_order_relaxed);
+        ws_server_stats.on_malformed_message();
+    }
+
+    frames_received.fetch_add(1, std::memory_order_relaxed);
+    bytes_received.fetch_add(size, std::memory_order_relaxed);
+
+    // frames before the connect belong to an earlier session
+    const auto now      = now_ticks();
+    const auto previous = std::max(last_message_time.exchange(now, std::memory_order_relaxed),
+                                   connect_time.load(std::memory_order_relaxed));
+    ws_server_stats.on_frame(size, std::chrono::system_clock::duration(previous < now ? now - previous : 0));
+
+    const auto stamp = res ? find_stamp(res.frame) : std::nullopt;
+    const auto read_time_us = stamp ? sequence_clock_us() : 0;
+
+    std::lock_guard lock(mutex_);
+    // the full size is kept to show that the preview was cut
+    last_message_size_ = size;
+    std::memcpy(last_message_.data(), data, std::min(size, last_message_preview));
+
+    if(stamp) {
+        // a wrapping difference, a clock running behind the client's reads as no delay
+        const auto delay_us = static_cast<uint64_t>(std::max<int32_t>(0, static_cast<int32_t>(read_time_us - stamp->send_time_us)));
+        const auto result   = sequence_.on_frame(stamp->sequence);
+
+        // the totals take a late frame back only where the device count did, e.g. not after a restart
+        bool was_missing = false;
+
+        sequenced_frames_++;
+        switch(result.kind) {
+            case sequence_tracker_t::kind_t::gap: missing_frames_ += result.missing; break;
+            case sequence_tracker_t::kind_t::late:
+                late_frames_++;
+                was_missing = missing_frames_ > 0;
+                if(was_missing) missing_frames_--;
+                break;
+            case sequence_tracker_t::kind_t::duplicate: duplicate_frames_++; break;
+            case sequence_tracker_t::kind_t::restart: sequence_restarts_++; break;
+            default: break;
+        }
+        delay_sum_us_ += delay_us;
+        delay_max_us_ = std::max(delay_max_us_, delay_us);
+
+        ws_server_stats.on_sequenced_frame(result, was_missing, std::chrono::microseconds(delay_us));
+    }
+    return error;
+}
+
+ws_client_t ws_client_entry_t::snapshot() const {
+    ws_client_t res;
+    res.device_id         = device_id;
+    res.connect_time      = from_ticks(connect_time.load(std::memory_order_relaxed));
+    res.last_message_time = from_ticks(last_message_time.load(std::memory_order_relaxed));
+    res.frames_received   = frames_received.load(std::memory_order_relaxed);
+    res.bytes_received    = bytes_received.load(std::memory_order_relaxed);
+    res.commands_sent     = commands_sent.load(std::memory_order_relaxed);
+    res.malformed_messages = malformed_messages.load(std::memory_order_relaxed);
+    res.sessions          = sessions.load(std::memory_order_relaxed);
+
+    std::lock_guard lock(mutex_);
+    res.fw           = fw_;
+    res.remote       = remote_;
+
+    res.sequenced_frames  = sequenced_frames_;
+    res.missing_frames    = missing_frames_;
+    res.duplicate_frames  = duplicate_frames_;
+    res.late_frames       = late_frames_;
+    res.sequence_restarts = sequence_restarts_;
+    if(sequenced_frames_ > 0) {
+        res.one_way_delay_avg = std::chrono::microseconds(delay_sum_us_ / sequenced_frames_);
+        res.one_way_delay_max = std::chrono::microseconds(delay_max_us_);
+    }
+    res.last_message = hex_preview(last_message_.data(), std::min(last_message_size_, last_message_preview),
+                                   last_message_size_ > last_message_preview);
+    return res;
+}
+
+std::chrono::system_clock::duration ws_client_entry_t::idle(std::chrono::system_clock::time_point now) const {
+    const auto since = std::max(last_message_time.load(std::memory_order_relaxed), connect_time.load(std::memory_order_relaxed));
+    return now - from_ticks(since);
+}
+
+ws_client_registry_t::shard_t& ws_client_registry_t::shard(std::string_view device_id) {
+    // top bits of a multiplicative hash, the map inside the shard uses the low ones
+    auto hash = static_cast<uint64_t>(std::hash<std::string_view>{}(device_id)) * 0x9e3779b97f4a7c15ULL;
+    return shards_[(hash >> 32) % shard_count];
+}
+
+const ws_client_registry_t::shard_t& ws_client_registry_t::shard(std::string_view device_id) const {
+    return const_cast<ws_client_registry_t*>(this)->shard(device_id);
+}
+
+ws_client_ptr_t ws_client_registry_t::connect(const std::string& device_id, std::string_view fw, std::string_view remote) {
+    ws_client_ptr_t client;
+    {
+        auto& s = shard(device_id);
+        std::lock_guard lock(s.mutex);
+        auto& entry = s.clients[device_id];
+        if(!entry) {
+            // the index is taken under the shard lock, so one device never gets two
+            std::lock_guard order_lock(order_mutex_);
+            entry = std::make_shared<ws_client_entry_t>(device_id, order_.size());
+            order_.push_back(entry);
+            ws_server_stats.on_new_device();
+        }
+        client = entry;
+    }
+
+    client->connect_time.store(now_ticks(), std::memory_order_relaxed);
+    ws_server_stats.on_connect(client->sessions.fetch_add(1, std::memory_order_relaxed) == 0);
+
+    std::lock_guard lock(client->mutex_);
+    client->fw_     = fw;
+    client->remote_ = remote;
+
+    return client;
+}
+
+void ws_client_registry_t::disconnect(const ws_client_ptr_t& client) {
+    const auto connected = from_ticks(client->connect_time.load(std::memory_order_relaxed));
+    ws_server_stats.on_disconnect(client->sessions.fetch_sub(1, std::memory_order_relaxed) == 1,
+                                  std::chrono::system_clock::now() - connected);
+}
+
+ws_client_ptr_t ws_client_registry_t::find(std::string_view device_id) const {
+    auto& s = shard(device_id);
+    std::shared_lock lock(s.mutex);
+    auto it = s.clients.find(device_id);
+    return it != s.clients.end() ? it->second : nullptr;
+}
+
+std::vector<ws_client_ptr_t> ws_client_registry_t::entries() const {
+    // always in shard order, so two snapshots can't deadlock with each other
+    std::array<std::shared_lock<std::shared_mutex>, shard_count> locks;
+    std::size_t size = 0;
+    for(std::size_t i = 0; i < shard_count; i++) {
+        locks[i] = std::shared_lock(shards_[i].mutex);
+        size += shards_[i].clients.size();
+    }
+
+    std::vector<ws_client_ptr_t> res;
+    res.reserve(size);
+    for(auto& s : shards_) {
+        for(auto& [device_id, client] : s.clients) {
+            res.push_back(client);
+        }
+    }
+    return res;
+}
+
+std::vector<ws_client_t> ws_client_registry_t::snapshot() const {
+    auto clients = entries();
+
+    std::vector<ws_client_t> res;
+    res.reserve(clients.size());
+    for(auto& client : clients) {
+        res.push_back(client->snapshot());
+    }
+    return res;
+}
+
+std::vector<ws_client_ptr_t> ws_client_registry_t::page(uint64_t& cursor, std::size_t limit, const filter_t& filter,
+                                                       std::size_t max_scan) const {
+    std::vector<ws_client_ptr_t> res;
+
+    std::shared_lock lock(order_mutex_);
+    const uint64_t end = std::min<uint64_t>(order_.size(), cursor + max_scan);
+    while(cursor < end && res.size() < limit) {
+        auto& client = order_[cursor++];
+        if(!filter || filter(*client)) {
+            res.push_back(client);
+        }
+    }
+    return res;
+}
+
+uint64_t ws_client_registry_t::size() const {
+    std::shared_lock lock(order_mutex_);
+    return order_.size();
+}
+
+ws_server_stats_t::stripe_t& ws_server_stats_t::local_stripe() {
+    static std::atomic<std::size_t> next_stripe{0};
+    thread_local const std::size_t stripe = next_stripe.fetch_add(1, std::memory_order_relaxed) % stripe_count;
+    return stripes_[stripe];
+}
+
+void ws_server_stats_t::on_connect(bool first_session) {
+    connections_.fetch_add(1, std::memory_order_relaxed);
+    active_sessions_.fetch_add(1, std::memory_order_relaxed);
+    if(first_session) {
+        connected_devices_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ws_server_stats_t::on_disconnect(bool last_session, std::chrono::system_clock::duration session_duration) {
+    active_sessions_.fetch_sub(1, std::memory_order_relaxed);
+    if(last_session) {
+        connected_devices_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    local_stripe().session_duration.record(std::chrono::duration_cast<std::chrono::microseconds>(session_duration));
+}
+
+void ws_server_stats_t::on_frame(std::size_t size, std::chrono::system_clock::duration interval) {
+    auto& stripe = local_stripe();
+    stripe.frames_received.fetch_add(1, std::memory_order_relaxed);
+    stripe.bytes_received.fetch_add(size, std::memory_order_relaxed);
+    if(interval.count() > 0) {
+        stripe.frame_interval.record(std::chrono::duration_cast<std::chrono::microseconds>(interval));
+    }
+}
+
+void ws_server_stats_t::on_command() {
+    local_stripe().commands_sent.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ws_server_stats_t::on_malformed_message() {
+    local_stripe().malformed_messages.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ws_server_stats_t::on_sequenced_frame(sequence_tracker_t::result_t result, bool was_missing, std::chrono::microseconds delay) {
+    auto& stripe = local_stripe();
+    stripe.sequenced_frames.fetch_add(1, std::memory_order_relaxed);
+    switch(result.kind) {
+        case sequence_tracker_t::kind_t::gap: stripe.missing_frames.fetch_add(result.missing, std::memory_order_relaxed); break;
+        case sequence_tracker_t::kind_t::late:
+            stripe.late_frames.fetch_add(1, std::memory_order_relaxed);
+            if(was_missing) stripe.missing_frames.fetch_sub(1, std::memory_order_relaxed);
+            break;
+        case sequence_tracker_t::kind_t::duplicate: stripe.duplicate_frames.fetch_add(1, std::memory_order_relaxed); break;
+        case sequence_tracker_t::kind_t::restart: stripe.sequence_restarts.fetch_add(1, std::memory_order_relaxed); break;
+        default: break;
+    }
+    stripe.one_way_delay.record(delay);
+}
+
+ws_server_summary_t ws_server_stats_t::summary() const {
+    ws_server_summary_t res;
+    res.known_devices     = known_devices_.load(std::memory_order_relaxed);
+    res.connected_devices = connected_devices_.load(std::memory_order_relaxed);
+    res.active_sessions   = active_sessions_.load(std::memory_order_relaxed);
+    res.connections       = connections_.load(std::memory_order_relaxed);
+    res.handshake_errors  = handshake_errors_.load(std::memory_order_relaxed);
+
+    for(auto& stripe : stripes_) {
+        res.frames_received += stripe.frames_received.load(std::memory_order_relaxed);
+        res.bytes_received += stripe.bytes_received.load(std::memory_order_relaxed);
+        res.commands_sent += stripe.commands_sent.load(std::memory_order_relaxed);
+        res.malformed_messages += stripe.malformed_messages.load(std::memory_order_relaxed);
+        res.sequenced_frames += stripe.sequenced_frames.load(std::memory_order_relaxed);
+        res.missing_frames += stripe.missing_frames.load(std::memory_order_relaxed);
+        res.duplicate_frames += stripe.duplicate_frames.load(std::memory_order_relaxed);
+        res.late_frames += stripe.late_frames.load(std::memory_order_relaxed);
+        res.sequence_restarts += stripe.sequence_restarts.load(std::memory_order_relaxed);
+        res.frame_interval.merge(stripe.frame_interval.snapshot());
+        res.session_duration.merge(stripe.session_duration.snapshot());
+        res.one_way_delay.merge(stripe.one_way_delay.snapshot());
+    }
+    return res;
+}
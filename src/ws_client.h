@@ -1,11 +1,220 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <vector>
 #include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
+#include "frame_parser.hpp"
+#include "frame_sequence.hpp"
+#include "stats.hpp"
+
+// Device as seen by the server stand-in, a copy taken for reporting
 struct ws_client_t{
+    std::string device_id;
+    std::string fw;
+    std::string remote;
     std::chrono::system_clock::time_point last_message_time;
     std::chrono::system_clock::time_point connect_time;
     std::string last_message;
+    uint64_t frames_received = 0;
+    uint64_t bytes_received = 0;
+    uint64_t commands_sent = 0;
+    // messages that weren't exactly one valid device frame
+    uint64_t malformed_messages = 0;
+    // open sessions with this id, a reconnect may overlap the old session for a moment
+    int sessions = 0;
+
+    // frames with a sequence number, see frame_sequence.hpp
+    uint64_t sequenced_frames  = 0;
+    uint64_t missing_frames    = 0;
+    uint64_t duplicate_frames  = 0;
+    uint64_t late_frames       = 0;
+    uint64_t sequence_restarts = 0;
+    // from the send time in the frame to its read here
+    std::chrono::microseconds one_way_delay_avg{ 0 };
+    std::chrono::microseconds one_way_delay_max{ 0 };
 };
+
+// Live registry entry. The session that owns the device holds a pointer to it and updates it
+// without touching the registry, so per-frame updates only contend with a reader taking a snapshot.
+struct ws_client_entry_t {
+    ws_client_entry_t(std::string id, uint64_t index) : device_id(std::move(id)), index(index) {}
+
+    const std::string device_id;
+    // position in first-connect order, the /get_clients cursor
+    const uint64_t    index;
+
+    std::atomic<uint64_t> frames_received{0};
+    std::atomic<uint64_t> bytes_received{0};
+    std::atomic<uint64_t> commands_sent{0};
+    std::atomic<uint64_t> malformed_messages{0};
+    std::atomic<int>      sessions{0};
+
+    // system_clock ticks
+    std::atomic<int64_t> connect_time{0};
+    std::atomic<int64_t> last_message_time{0};
+
+    // validates the message as one device frame, a malformed one is counted and its error returned
+    frame_error_t on_message(const void* data, std::size_t size);
+    ws_client_t snapshot() const;
+
+    // time since the last frame, or since the connect if there was none after it
+    std::chrono::system_clock::duration idle(std::chrono::system_clock::time_point now) const;
+
+    // frames are binary, the first bytes of the last one are kept for a hex preview
+    static constexpr std::size_t last_message_preview = 32;
+
+private:
+    friend class ws_client_registry_t;
+
+    // guards the fields below, only the owning session and a snapshot ever take it
+    mutable std::mutex mutex_;
+    std::string        fw_;
+    std::string        remote_;
+    std::array<uint8_t, last_message_preview> last_message_{};
+    std::size_t        last_message_size_ = 0;
+
+    sequence_tracker_t sequence_;
+    uint64_t           sequenced_frames_  = 0;
+    uint64_t           missing_frames_    = 0;
+    uint64_t           duplicate_frames_  = 0;
+    uint64_t           late_frames_       = 0;
+    uint64_t           sequence_restarts_ = 0;
+    uint64_t           delay_sum_us_      = 0;
+    uint64_t           delay_max_us_      = 0;
+};
+
+using ws_client_ptr_t = std::shared_ptr<ws_client_entry_t>;
+
+// Clients keyed by device id, split into shards by the id hash so that connects and lookups
+// on different I/O threads rarely meet on the same lock. Entries stay after a disconnect.
+class ws_client_registry_t {
+public:
+    // returns the entry of the device, created on its first connect
+    ws_client_ptr_t connect(const std::string& device_id, std::string_view fw, std::string_view remote);
+    void disconnect(const ws_client_ptr_t& client);
+
+    ws_client_ptr_t find(std::string_view device_id) const;
+
+    // all entries at one point in time, every shard is locked while the pointers are copied
+    std::vector<ws_client_ptr_t> entries() const;
+
+    std::vector<ws_client_t> snapshot() const;
+
+    using filter_t = std::function<bool(const ws_client_entry_t&)>;
+
+    // Up to limit entries passing the filter, in first-connect order starting at cursor.
+    // Looks at max_scan entries at most and moves cursor past the last one it looked at,
+    // a cursor equal to size() means the end.
+    std::vector<ws_client_ptr_t> page(uint64_t& cursor, std::size_t limit, const filter_t& filter,
+                                      std::size_t max_scan = 4096) const;
+
+    uint64_t size() const;
+
+private:
+    static constexpr std::size_t shard_count = 64;
+
+    struct string_hash_t {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view text) const { return std::hash<std::string_view>{}(text); }
+    };
+
+    struct alignas(64) shard_t {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, ws_client_ptr_t, string_hash_t, std::equal_to<>> clients;
+    };
+
+    shard_t&       shard(std::string_view device_id);
+    const shard_t& shard(std::string_view device_id) const;
+
+    std::array<shard_t, shard_count> shards_;
+
+    // every entry by index, only appended to when a new device connects
+    mutable std::shared_mutex    order_mutex_;
+    std::vector<ws_client_ptr_t> order_;
+};
+
+// Plain copy of ws_server_stats_t, served by /get_clients/summary
+struct ws_server_summary_t {
+    uint64_t known_devices     = 0;
+    uint64_t connected_devices = 0;
+    uint64_t active_sessions   = 0;
+    uint64_t connections       = 0;
+    uint64_t handshake_errors  = 0;
+    uint64_t frames_received   = 0;
+    uint64_t bytes_received    = 0;
+    uint64_t commands_sent     = 0;
+    uint64_t malformed_messages = 0;
+
+    // frames with a sequence number and what their numbers showed, over all devices
+    uint64_t sequenced_frames  = 0;
+    int64_t  missing_frames    = 0;
+    uint64_t duplicate_frames  = 0;
+    uint64_t late_frames       = 0;
+    uint64_t sequence_restarts = 0;
+
+    // time between two frames of one device, and how long sessions lasted
+    histogram_counts_t frame_interval;
+    histogram_counts_t session_duration;
+    // from the send time in a sequenced frame to its read
+    histogram_counts_t one_way_delay;
+};
+
+// Server totals, kept up to date as things happen so a summary costs the same at any client count.
+// Per-frame counters go to one of a few stripes picked per thread, I/O threads don't share cache lines.
+class ws_server_stats_t {
+public:
+    void on_new_device() { known_devices_.fetch_add(1, std::memory_order_relaxed); }
+    void on_connect(bool first_session);
+    void on_disconnect(bool last_session, std::chrono::system_clock::duration session_duration);
+    void on_handshake_error() { handshake_errors_.fetch_add(1, std::memory_order_relaxed); }
+    // interval of 0 - the first frame of a session, nothing to measure it from
+    void on_frame(std::size_t size, std::chrono::system_clock::duration interval);
+    void on_malformed_message();
+    void on_command();
+    // was_missing - a late frame the device had counted as missing, only then it comes off the total
+    void on_sequenced_frame(sequence_tracker_t::result_t result, bool was_missing, std::chrono::microseconds delay);
+
+    ws_server_summary_t summary() const;
+
+private:
+    static constexpr std::size_t stripe_count = 16;
+
+    struct alignas(64) stripe_t {
+        std::atomic<uint64_t> frames_received{0};
+        std::atomic<uint64_t> bytes_received{0};
+        std::atomic<uint64_t> commands_sent{0};
+        std::atomic<uint64_t> malformed_messages{0};
+        std::atomic<uint64_t> sequenced_frames{0};
+        // a late frame takes one back, possibly on another stripe
+        std::atomic<int64_t>  missing_frames{0};
+        std::atomic<uint64_t> duplicate_frames{0};
+        std::atomic<uint64_t> late_frames{0};
+        std::atomic<uint64_t> sequence_restarts{0};
+        latency_histogram_t   frame_interval;
+        latency_histogram_t   session_duration;
+        latency_histogram_t   one_way_delay;
+    };
+
+    stripe_t& local_stripe();
+
+    std::array<stripe_t, stripe_count> stripes_;
+
+    std::atomic<uint64_t> known_devices_{0};
+    std::atomic<uint64_t> connected_devices_{0};
+    std::atomic<uint64_t> active_sessions_{0};
+    std::atomic<uint64_t> connections_{0};
+    std::atomic<uint64_t> handshake_errors_{0};
+};
+
+extern ws_client_registry_t ws_clients;
+extern ws_server_stats_t    ws_server_stats;